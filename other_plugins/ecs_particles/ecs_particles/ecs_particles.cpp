@@ -305,17 +305,25 @@ namespace quark::ecs_particles {
     // This code is just ripped from the spaceships example.
     // We probably don't need full physics for simple particles,
     // but I already had code that somewhat fit the role and im *lazy*.
-    for_archetype(Include<Transform, Motion> {}, Exclude<> {},
-    [&](EntityId entity_id, Transform* transform, Motion* motion) {
-      motion->velocity += motion->impulse;
-      motion->impulse = VEC3_ZERO;
-      motion->velocity += motion->acceleration * delta();
-      transform->position += motion->velocity * delta();
-
-      motion->angular_velocity += motion->angular_impulse;
-      motion->angular_impulse = VEC3_ZERO;
-      motion->angular_velocity += motion->angular_acceleration * delta();
-      transform->rotation = transform->rotation * quat_from_eul3(as_eul3(motion->angular_velocity * delta()));
+    //
+    // Particles get spawned back to back so they come through in long runs,
+    // which lets this be a plain loop over the component arrays.
+    f32 dt = delta();
+    for_archetype_runs(Include<Transform, Motion> {}, Exclude<> {},
+    [&](u64 first_index, u32 count, Transform* transforms, Motion* motions) {
+      for_every(i, count) {
+        motions[i].velocity += motions[i].impulse;
+        motions[i].impulse = VEC3_ZERO;
+        motions[i].velocity += motions[i].acceleration * dt;
+        transforms[i].position += motions[i].velocity * dt;
+      }
+
+      for_every(i, count) {
+        motions[i].angular_velocity += motions[i].angular_impulse;
+        motions[i].angular_impulse = VEC3_ZERO;
+        motions[i].angular_velocity += motions[i].angular_acceleration * dt;
+        transforms[i].rotation = transforms[i].rotation * quat_from_eul3(as_eul3(motions[i].angular_velocity * dt));
+      }
     });
   
     // Apply color shifting and size changing
@@ -336,15 +344,6 @@ namespace quark::ecs_particles {
     });
   }
 
-  void push_renderables() {
-    // Add everything to the render batches
-    for_archetype(Include<Transform, Model, ColorMaterial> {}, Exclude<> {},
-    [](EntityId entity_id, Transform* transform, Model* model, ColorMaterial* material) {
-      Drawable drawable = {*transform, *model};
-      push_drawable_instance(&drawable, material);
-    });
-  }
-
   void exit_on_esc() {
     if(is_key_down(KeyCode::Escape)) {
       set_window_should_close();
@@ -47,9 +47,6 @@ namespace quark::ecs_particles {
   // Update entities
   api_decl void update_entities();
 
-  // Push renderables
-  api_decl void push_renderables();
-
   api_decl void exit_on_esc();
 }
 
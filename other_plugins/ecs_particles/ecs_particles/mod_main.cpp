@@ -14,13 +14,11 @@ mod_main() {
   create_system("spawn_particles", spawn_particles);
   create_system("update_entities", update_entities);
   create_system("update_camera", update_camera);
-  create_system("ecs_push_renderables", ecs_particles::push_renderables);
   
   add_system("update", "update_params", "update_tag", -1);
   add_system("update", "spawn_particles", "update_tag", -1);
   add_system("update", "update_entities", "update_tag", -1);
   add_system("update", "update_camera", "update_tag", 1);
-  add_system("update", "ecs_push_renderables", "begin_frame", -1);
   add_system("update", "exit_on_esc", "", -1);
 
   // Set some engine constants
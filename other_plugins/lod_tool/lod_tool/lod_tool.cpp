@@ -40,7 +40,12 @@ static u32 scratch_model_id = 0;
       model->angular_thresholds[2] = 0.125f / 4.0f;
       model->angular_thresholds[3] = 0.125f / 16.0f;
 
-      model->mesh_ids[0] = *get_asset<MeshId>("suzanne_lod0");
+      // select_lod() only falls back to the thresholds when a lod has no error
+      for_every(i, 4) {
+        model->lod_errors[i] = 0.0f;
+      }
+
+      model->mesh_ids[0] = *get_asset<MeshId>("suzanne");
       model->mesh_ids[1] = *get_asset<MeshId>("suzanne_lod1");
       model->mesh_ids[2] = *get_asset<MeshId>("suzanne_lod2");
       model->mesh_ids[3] = *get_asset<MeshId>("suzanne_lod3");
@@ -191,12 +196,15 @@ static u32 scratch_model_id = 0;
 
     if(get_action("action").down) {
       if(state == (u32)States::SelectMesh || state == (u32)States::SelectMeshOfModel) {
-        // set current submesh to mesh
+        // set current submesh to mesh, the cooked error was for the old one
         model->mesh_ids[idxs[1]] = *get_asset_by_hash<MeshId>(hashes[idxs[0]]);
+        model->lod_errors[idxs[1]] = 0.0f;
       }
 
       else if(state == (u32)States::SelectThreshold) {
+        // clear the cooked error too, otherwise select_lod() never looks at the threshold
         model->angular_thresholds[idxs[2]] = angular_size;
+        model->lod_errors[idxs[2]] = 0.0f;
       }
 
       else if(state == (u32)States::ShowModel) {
@@ -210,10 +218,11 @@ static u32 scratch_model_id = 0;
       file = open_file_panic_with_error(builder.data, "wb", "Unique id was already taken!");
 
       const char* magic = "qmdl";
-      const u32 version = 1;
+      const u32 version = 2;
       file_write(file, (void*)magic, 4);
       file_write(file, (void*)&version, 4);
       file_write(file, model->angular_thresholds, 4 * sizeof(f32));
+      file_write(file, model->lod_errors, 4 * sizeof(f32));
 
       for_every(i, 4) {
         char* name = get_name_of_mesh((u32)model->mesh_ids[i], hashes, hashes_length);
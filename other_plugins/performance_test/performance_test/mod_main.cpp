@@ -12,6 +12,12 @@ mod_main() {
   create_system("init_entities", init_entities);
   add_system("init", "init_entities", "", -1);
 
+  // Opt in with --benchmarks, these verify and time engine paths and don't render anything
+  if(RUN_BENCHMARKS) {
+    create_system("run_benchmarks", run_benchmarks);
+    add_system("init", "run_benchmarks", "", -1);
+  }
+
   // Add update jobs to update
   create_system("update_camera", update_camera);
   create_system("update_perf_test", update_perf_test);
@@ -25,6 +31,6 @@ mod_main() {
   
   // Update some engine constants.
   // In the short future these will be moved to configuration resources
-  ECS_MAX_STORAGE = 256 * 1024;
+  ECS_MAX_STORAGE = 512 * 1024;
   PRINT_PERFORMANCE_STATISTICS = true;
 }
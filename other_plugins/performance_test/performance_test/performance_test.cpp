@@ -2,12 +2,20 @@
 #include "performance_test.hpp"
 
 namespace quark::performance_test {
+//
+// Components
+//
+
+  define_component(SparseMarker);
+
 //
 // Global Init Jobs
 //
 
   void init_performance_test() {
     set_mouse_mode(MouseMode::Captured);
+
+    init_component(SparseMarker);
   }
 
 //
@@ -58,6 +66,585 @@ namespace quark::performance_test {
     }
   }
 
+//
+// Benchmarks
+//
+
+  // Average seconds per call of f over repeat_count calls
+  template <typename F>
+  static f64 time_average(u32 repeat_count, F f) {
+    Timestamp t0 = get_timestamp();
+    for_every(r, repeat_count) {
+      f();
+    }
+    Timestamp t1 = get_timestamp();
+
+    return get_timestamp_difference(t0, t1) / repeat_count;
+  }
+
+  // Run for_archetype and for_archetype_par over the same query and make sure
+  // they visit exactly the same entities, with the parallel one visiting each only once
+  static void verify_archetype_par() {
+    EcsContext* ecs = get_resource(EcsContext);
+    u64 word_count = ecs->last_entity + 1;
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    u64* serial = arena_push_array_zero(arena, u64, word_count);
+    u64 serial_count = 0;
+
+    for_archetype(Include<Transform, LitColorMaterial> {}, Exclude<> {},
+    [&](EntityId entity_id, Transform* transform, LitColorMaterial* material) {
+      set_bitset_bit(serial, entity_id.index);
+      serial_count += 1;
+    });
+
+    // Auto sized groups, single word groups, and groups that don't divide the word count evenly
+    u32 group_sizes[] = { 0, 1, 7 };
+
+    for_every(g, count_of(group_sizes)) {
+      std::atomic_uint64_t* parallel = arena_push_array_zero(arena, std::atomic_uint64_t, word_count);
+      std::atomic_uint64_t parallel_count = 0;
+      std::atomic_uint64_t duplicate_count = 0;
+
+      for_archetype_par(group_sizes[g], Include<Transform, LitColorMaterial> {}, Exclude<> {},
+      [&](EntityId entity_id, Transform* transform, LitColorMaterial* material) {
+        u64 bit = 1ULL << (entity_id.index % 64);
+        if(parallel[entity_id.index / 64].fetch_or(bit) & bit) {
+          duplicate_count.fetch_add(1);
+        }
+        parallel_count.fetch_add(1);
+      });
+
+      if(duplicate_count.load() != 0) {
+        panic("for_archetype_par(" + group_sizes[g] + ") visited " + duplicate_count.load() + " entities more than once!");
+      }
+
+      if(parallel_count.load() != serial_count) {
+        panic("for_archetype_par(" + group_sizes[g] + ") visited " + parallel_count.load() + " entities, for_archetype visited " + serial_count + "!");
+      }
+
+      for_every(i, word_count) {
+        if(parallel[i].load() != serial[i]) {
+          panic("for_archetype_par(" + group_sizes[g] + ") visited different entities than for_archetype in word " + (u64)i + "!");
+        }
+      }
+    }
+
+    log_message("for_archetype_par matches for_archetype over " + serial_count + " entities");
+  }
+
+  // Tag every stride-th entity with a SparseMarker and time a query for it,
+  // once through for_archetype and once by scanning every word like the iterators used to.
+  // With the summary bitsets the first should follow the number of tagged entities
+  // while the second stays at the cost of the whole world.
+  static void benchmark_sparse_query() {
+    EcsContext* ecs = get_resource(EcsContext);
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    u64 entity_count = 0;
+    for_archetype(Include<Transform> {}, Exclude<> {}, [&](EntityId entity_id, Transform* transform) {
+      entity_count += 1;
+    });
+
+    EntityId* entities = arena_push_array(arena, EntityId, entity_count);
+    u64 entity_head = 0;
+    for_archetype(Include<Transform> {}, Exclude<> {}, [&](EntityId entity_id, Transform* transform) {
+      entities[entity_head] = entity_id;
+      entity_head += 1;
+    });
+
+    const u32 repeat_count = 16;
+    u32 strides[] = { 16384, 4096, 512, 64, 8, 1 };
+
+    for_every(s, count_of(strides)) {
+      u32 stride = strides[s];
+
+      SparseMarker marker = {};
+      marker.stride = stride;
+
+      for(u64 i = 0; i < entity_count; i += stride) {
+        add_components(entities[i], marker);
+      }
+
+      u64 query_count = 0;
+      f64 query_time = time_average(repeat_count, [&]() {
+        for_archetype(Include<Transform, SparseMarker> {}, Exclude<> {},
+        [&](EntityId entity_id, Transform* transform, SparseMarker* marker) {
+          query_count += 1;
+        });
+      });
+
+      u64 scan_count = 0;
+      f64 scan_time = time_average(repeat_count, [&]() {
+        for(u64 i = ecs->first_entity / 64; i <= ecs->last_entity; i += 1) {
+          u64 archetype = get_archetype_word(ecs, Include<Transform, SparseMarker> {}, Exclude<> {}, i);
+          scan_count += __builtin_popcountll(archetype);
+        }
+      });
+
+      if(query_count != scan_count) {
+        panic("benchmark_sparse_query() for_archetype found " + query_count + " entities, the full scan found " + scan_count + "!");
+      }
+
+      f32 query_us = (f32)query_time * 1000000.0f;
+      f32 scan_us = (f32)scan_time * 1000000.0f;
+      log_message("Sparse query matching " + query_count / repeat_count + " of " + entity_count + " entities: for_archetype " + query_us + "us, full scan " + scan_us + "us");
+
+      for(u64 i = 0; i < entity_count; i += stride) {
+        remove_components_template<SparseMarker>(entities[i]);
+      }
+    }
+  }
+
+  // Create and destroy N entities a "frame" for a few frames on top of the perf test world.
+  // Per operation cost should stay flat as N grows now that create_entity doesn't scan.
+  static void benchmark_entity_churn() {
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    const u32 frame_count = 8;
+    u32 batch_sizes[] = { 64, 1024, 16384, 65536 };
+
+    for_every(b, count_of(batch_sizes)) {
+      u32 batch_size = batch_sizes[b];
+      EntityId* entities = arena_push_array(arena, EntityId, batch_size);
+
+      Transform transform = {};
+      transform.rotation = QUAT_IDENTITY;
+
+      f64 create_time = 0.0;
+      f64 destroy_time = 0.0;
+
+      for_every(f, frame_count) {
+        create_time += time_average(1, [&]() {
+          for_every(i, batch_size) {
+            entities[i] = create_entity();
+            add_components(entities[i], transform);
+          }
+        });
+
+        // Destroy every other one first so the freed indices aren't handed back in order.
+        // Destroyed entities keep their component bits, so drop the Transform to keep them out of other queries.
+        destroy_time += time_average(1, [&]() {
+          for(u32 i = 0; i < batch_size; i += 2) {
+            remove_components_template<Transform>(entities[i]);
+            destroy_entity(entities[i]);
+          }
+          for(u32 i = 1; i < batch_size; i += 2) {
+            remove_components_template<Transform>(entities[i]);
+            destroy_entity(entities[i]);
+          }
+        });
+      }
+
+      f64 op_count = (f64)batch_size * frame_count;
+      log_message("Entity churn of " + batch_size + " per frame: create " + (f32)(create_time / op_count * 1000000000.0) + "ns, destroy " + (f32)(destroy_time / op_count * 1000000000.0) + "ns per entity");
+    }
+  }
+
+  // Spawn the same 100K entities one at a time and through create_entities()
+  static void benchmark_batch_spawn() {
+    EcsContext* ecs = get_resource(EcsContext);
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    const u32 spawn_count = 100 * 1000;
+    EntityId* entities = arena_push_array(arena, EntityId, spawn_count);
+
+    Transform transform = {};
+    transform.rotation = QUAT_IDENTITY;
+
+    Model model = create_model(PERF_MODELS[0], VEC3_ONE / 2.0f);
+
+    auto destroy_all = [&]() {
+      for_every(i, spawn_count) {
+        remove_components_template<Transform, Model>(entities[i]);
+        destroy_entity(entities[i]);
+      }
+    };
+
+    f64 single_time = time_average(1, [&]() {
+      for_every(i, spawn_count) {
+        entities[i] = create_entity();
+        add_components(entities[i], transform, model);
+      }
+    });
+
+    destroy_all();
+
+    u32 first_index = 0;
+    f64 batch_time = time_average(1, [&]() {
+      first_index = create_entities(spawn_count, transform, model);
+    });
+
+    for_every(i, spawn_count) {
+      entities[i] = get_entity_id_in(ecs, first_index + i);
+      if(!has_all_components_template<Transform, Model>(entities[i])) {
+        panic("create_entities() entity " + (u32)(first_index + i) + " is missing a component!");
+      }
+    }
+
+    destroy_all();
+
+    f32 single_ms = (f32)single_time * 1000.0f;
+    f32 batch_ms = (f32)batch_time * 1000.0f;
+    log_message("Spawning " + spawn_count + " entities: one at a time " + single_ms + "ms, create_entities " + batch_ms + "ms");
+  }
+
+  // Panic if the bvh and brute force disagree on a sphere that isn't sitting right on a plane,
+  // the two compute the plane distances in a different order so those can go either way
+  static void check_culling_results(vec4* spheres, u32 sphere_count, FrustumPlanes* frustum, u64* bvh_bitset, u64* brute_bitset) {
+    for_every(i, sphere_count) {
+      if(is_bitset_bit_set(bvh_bitset, i) == is_bitset_bit_set(brute_bitset, i)) {
+        continue;
+      }
+
+      vec4 sphere = spheres[i];
+      f32 dist = F32_MAX;
+      for_every(p, 6) {
+        dist = min(dist, plane_point_distance(frustum->planes[p], vec3 { sphere.x, sphere.y, sphere.z }));
+      }
+
+      if(abs(dist + sphere.w) > 0.001f) {
+        panic("cull_culling_bvh() and cull_spheres_brute_force() disagree on sphere " + (u32)i + "!");
+      }
+    }
+  }
+
+  // Cull 10K, 100K and 1M random spheres with the bvh and by testing every one of them.
+  // Everything runs on the cpu against a made up camera so this works without a window.
+  static void benchmark_culling_bvh() {
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    Camera3D camera = {};
+    camera.position = VEC3_ZERO;
+    camera.rotation = QUAT_IDENTITY;
+    camera.z_near = 0.1f;
+    camera.z_far = 1000.0f;
+    camera.projection_type = ProjectionType::Perspective;
+    camera.fov = 90.0f;
+
+    FrustumPlanes frustum = camera3d_frustum_planes(&camera, 16.0f / 9.0f);
+
+    const u32 repeat_count = 8;
+    const f32 world_size = 2000.0f;
+    u32 sphere_counts[] = { 10 * 1000, 100 * 1000, 1000 * 1000 };
+
+    for_every(c, count_of(sphere_counts)) {
+      u32 sphere_count = sphere_counts[c];
+      u64 word_count = (sphere_count + 63) / 64;
+
+      vec4* spheres = arena_push_array(arena, vec4, sphere_count);
+      for_every(i, sphere_count) {
+        vec3 position = rand_vec3_range(-VEC3_ONE * world_size / 2.0f, VEC3_ONE * world_size / 2.0f);
+        spheres[i] = as_vec4(position, rand_f32_range(0.5f, 4.0f));
+      }
+
+      u64* bvh_bitset = arena_push_array(arena, u64, word_count);
+      u64* brute_bitset = arena_push_array(arena, u64, word_count);
+
+      CullingBvh bvh = {};
+      f64 build_time = time_average(1, [&]() {
+        build_culling_bvh(&bvh, arena, spheres, sphere_count);
+      });
+
+      // Move everything a little so the refit actually has something to do
+      for_every(i, sphere_count) {
+        spheres[i].x += rand_f32_range(-1.0f, 1.0f);
+      }
+
+      f64 refit_time = time_average(1, [&]() {
+        refit_culling_bvh(&bvh);
+      });
+
+      u32 bvh_count = 0;
+      f64 bvh_time = time_average(repeat_count, [&]() {
+        zero_mem(bvh_bitset, word_count * sizeof(u64));
+        bvh_count = cull_culling_bvh(&bvh, &frustum, 1.0f, bvh_bitset);
+      });
+
+      u32 brute_count = 0;
+      f64 brute_time = time_average(repeat_count, [&]() {
+        brute_count = cull_spheres_brute_force(spheres, sphere_count, &frustum, brute_bitset);
+      });
+
+      check_culling_results(spheres, sphere_count, &frustum, bvh_bitset, brute_bitset);
+
+      f32 build_ms = (f32)build_time * 1000.0f;
+      f32 refit_ms = (f32)refit_time * 1000.0f;
+      f32 query_us = (f32)bvh_time * 1000000.0f;
+      f32 brute_us = (f32)brute_time * 1000000.0f;
+      log_message("Culling " + sphere_count + " spheres (" + bvh_count + " visible, brute force " + brute_count + "): bvh " + query_us + "us, brute force " + brute_us + "us, build " + build_ms + "ms, refit " + refit_ms + "ms");
+    }
+  }
+
+  // Unit cube centered on the origin
+  static vec3 OCCLUDER_BOX_POSITIONS[] = {
+    { -0.5f, -0.5f, -0.5f }, {  0.5f, -0.5f, -0.5f }, {  0.5f,  0.5f, -0.5f }, { -0.5f,  0.5f, -0.5f },
+    { -0.5f, -0.5f,  0.5f }, {  0.5f, -0.5f,  0.5f }, {  0.5f,  0.5f,  0.5f }, { -0.5f,  0.5f,  0.5f },
+  };
+
+  static u32 OCCLUDER_BOX_INDICES[] = {
+    0, 1, 2, 0, 2, 3, // bottom
+    4, 6, 5, 4, 7, 6, // top
+    0, 5, 1, 0, 4, 5, // front
+    3, 2, 6, 3, 6, 7, // back
+    0, 3, 7, 0, 7, 4, // left
+    1, 5, 6, 1, 6, 2, // right
+  };
+
+  // Stand in a street of a grid of buildings and test 100K spheres against the occlusion buffer.
+  // Everything is on the cpu so this runs without a window.
+  static void benchmark_occlusion_culling() {
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    OcclusionBuffer buffer = {};
+    init_occlusion_buffer(&buffer, arena, 320, 180);
+
+    Camera3D camera = {};
+    camera.position = vec3 { 12.5f, 0.0f, 2.0f };
+    camera.rotation = QUAT_IDENTITY;
+    camera.z_near = 0.1f;
+    camera.z_far = 1000.0f;
+    camera.projection_type = ProjectionType::Perspective;
+    camera.fov = 90.0f;
+
+    mat4 view_projection = camera3d_view_projection_mat4(&camera, 16.0f / 9.0f);
+    FrustumPlanes frustum = camera3d_frustum_planes(&camera, 16.0f / 9.0f);
+
+    OccluderMesh box = {};
+    box.positions = OCCLUDER_BOX_POSITIONS;
+    box.indices = OCCLUDER_BOX_INDICES;
+    box.index_count = count_of(OCCLUDER_BOX_INDICES);
+
+    // 20x20 buildings, 25 units apart with 5 unit streets in between
+    const u32 building_count_x = 20;
+    const u32 building_count_y = 20;
+    const f32 block_size = 25.0f;
+    const vec3 building_size = vec3 { 20.0f, 20.0f, 40.0f };
+
+    u32 building_count = building_count_x * building_count_y;
+    mat4* buildings = arena_push_array(arena, mat4, building_count);
+
+    for_every(x, building_count_x) {
+      for_every(y, building_count_y) {
+        vec3 position = vec3 { ((f32)x - building_count_x / 2.0f) * block_size, ((f32)y - building_count_y / 2.0f) * block_size, building_size.z / 2.0f };
+        buildings[x * building_count_y + y] = mat4_from_transform(position, QUAT_IDENTITY, building_size);
+      }
+    }
+
+    const u32 repeat_count = 8;
+
+    f64 raster_time = time_average(repeat_count, [&]() {
+      clear_occlusion_buffer(&buffer, &view_projection);
+      for_every(i, building_count) {
+        rasterize_occluder(&buffer, &box, &buildings[i]);
+      }
+    });
+
+    const u32 sphere_count = 100 * 1000;
+    vec4* spheres = arena_push_array(arena, vec4, sphere_count);
+
+    f32 world_half_size = building_count_x * block_size / 2.0f;
+    for_every(i, sphere_count) {
+      vec3 position = rand_vec3_range(vec3 { -world_half_size, -world_half_size, 0.0f }, vec3 { world_half_size, world_half_size, 30.0f });
+      spheres[i] = as_vec4(position, rand_f32_range(0.5f, 2.0f));
+    }
+
+    u32 visible_count = 0;
+    u32 occluded_count = 0;
+
+    f64 test_time = time_average(1, [&]() {
+      for_every(i, sphere_count) {
+        vec3 position = vec3 { spheres[i].x, spheres[i].y, spheres[i].z };
+        if(!is_sphere_visible(&frustum, position, spheres[i].w)) {
+          continue;
+        }
+
+        visible_count += 1;
+        if(is_sphere_occluded(&buffer, position, spheres[i].w)) {
+          occluded_count += 1;
+        }
+      }
+    });
+
+    // Right in front of the camera, the closest wall is 2.5 units away
+    vec3 forward = quat_forward(camera.rotation);
+    if(is_sphere_occluded(&buffer, camera.position + forward * 1.0f, 0.5f)) {
+      panic("benchmark_occlusion_culling() culled a sphere with nothing in front of it!");
+    }
+
+    f32 raster_us = (f32)raster_time * 1000000.0f;
+    f32 test_us = (f32)test_time * 1000000.0f;
+    log_message("Occlusion culling " + building_count + " box occluders into " + buffer.width + "x" + buffer.height + ": raster " + raster_us + "us, " + occluded_count + " of " + visible_count + " frustum visible spheres occluded in " + test_us + "us");
+  }
+
+  // The parts of the ecs a snapshot holds, copied out so a reload can be checked against them
+  struct EcsStateCopy {
+    u32 first_entity;
+    u32 last_entity;
+    u32 entity_commit_count;
+    u32 table_count;
+    u64** bitsets;
+    u8** datas;
+    u64* data_sizes;
+  };
+
+  static EcsStateCopy copy_ecs_state(Arena* arena) {
+    EcsContext* ecs = get_resource(EcsContext);
+
+    EcsStateCopy copy = {
+      .first_entity = ecs->first_entity,
+      .last_entity = ecs->last_entity,
+      .entity_commit_count = ecs->entity_commit_count,
+      .table_count = ecs->component_table_count,
+      .bitsets = arena_push_array(arena, u64*, ecs->component_table_count),
+      .datas = arena_push_array(arena, u8*, ecs->component_table_count),
+      .data_sizes = arena_push_array(arena, u64, ecs->component_table_count),
+    };
+
+    for_every(i, copy.table_count) {
+      copy.bitsets[i] = arena_push_array(arena, u64, copy.entity_commit_count / 64);
+      copy_mem(copy.bitsets[i], ecs->component_bitsets[i], copy.entity_commit_count / 8);
+
+      copy.data_sizes[i] = ecs->component_commit_sizes[i];
+      copy.datas[i] = arena_push_array(arena, u8, copy.data_sizes[i]);
+      copy_mem(copy.datas[i], ecs->component_datas[i], copy.data_sizes[i]);
+    }
+
+    return copy;
+  }
+
+  static void check_ecs_state(EcsStateCopy* copy, const char* mode) {
+    EcsContext* ecs = get_resource(EcsContext);
+
+    // first_empty_entity is left out, loading rebuilds it from the free list
+    if(ecs->first_entity != copy->first_entity || ecs->last_entity != copy->last_entity || ecs->entity_commit_count != copy->entity_commit_count) {
+      panic("Snapshot round trip (" + mode + ") restored different ecs counters!");
+    }
+
+    if(ecs->component_table_count != copy->table_count) {
+      panic("Snapshot round trip (" + mode + ") restored " + ecs->component_table_count + " tables, expected " + copy->table_count + "!");
+    }
+
+    for_every(i, copy->table_count) {
+      if(memcmp(ecs->component_bitsets[i], copy->bitsets[i], copy->entity_commit_count / 8) != 0) {
+        panic("Snapshot round trip (" + mode + ") restored a different bitset for table " + (u32)i + "!");
+      }
+
+      // Tables only commit up to a high-water mark, so the reload may have committed more than it holds
+      if(ecs->component_commit_sizes[i] < copy->data_sizes[i] || memcmp(ecs->component_datas[i], copy->datas[i], copy->data_sizes[i]) != 0) {
+        panic("Snapshot round trip (" + mode + ") restored different data for table " + (u32)i + "!");
+      }
+    }
+  }
+
+  // Save a keyframe synchronously, on the save thread, and as a mapped keyframe. Then change a few entities,
+  // save a delta, load the keyframe and delta back and make sure the ecs comes back the way it was before the load.
+  // The delta should cost about as much as the pages the changed entities sit on
+  static void verify_snapshot_round_trip() {
+    const char* keyframe_file = "perf_test_keyframe.snapshot";
+    const char* delta_file = "perf_test_delta.snapshot";
+
+    bool keep_delta_base = SNAPSHOT_KEEP_DELTA_BASE;
+    bool mapped = SNAPSHOT_MAPPED;
+    SNAPSHOT_KEEP_DELTA_BASE = true;
+    defer({
+      SNAPSHOT_KEEP_DELTA_BASE = keep_delta_base;
+      SNAPSHOT_MAPPED = mapped;
+      remove(keyframe_file);
+      remove(delta_file);
+    });
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    u64 entity_count = 0;
+    for_archetype(Include<Transform, LitColorMaterial> {}, Exclude<> {}, [&](EntityId entity_id, Transform* transform, LitColorMaterial* material) {
+      entity_count += 1;
+    });
+
+    EntityId* entities = arena_push_array(arena, EntityId, entity_count);
+    u64 entity_head = 0;
+    for_archetype(Include<Transform, LitColorMaterial> {}, Exclude<> {}, [&](EntityId entity_id, Transform* transform, LitColorMaterial* material) {
+      entities[entity_head] = entity_id;
+      entity_head += 1;
+    });
+
+    const char* mode_names[] = { "sync", "async", "mapped" };
+    u32 changed_counts[] = { 16, 1024, 16384 };
+
+    for_every(m, count_of(mode_names)) {
+      for_every(c, count_of(changed_counts)) {
+        u32 changed_count = changed_counts[c] < entity_count ? changed_counts[c] : (u32)entity_count;
+
+        SNAPSHOT_MAPPED = m == 2;
+        f64 keyframe_time = time_average(1, [&]() {
+          if(m == 1) {
+            save_snapshot_async(keyframe_file);
+            wait_for_snapshot_save();
+          } else {
+            save_snapshot(keyframe_file);
+          }
+        });
+
+        // Spread out over the world so every change lands on a different page where it can
+        SparseMarker marker = {};
+        marker.stride = (u32)(entity_count / changed_count);
+        for_every(i, changed_count) {
+          EntityId entity = entities[i * entity_count / changed_count];
+          get_component(entity, Transform)->position.z += 1.0f;
+          add_components(entity, marker);
+        }
+
+        f64 delta_time = time_average(1, [&]() {
+          save_snapshot_delta(delta_file);
+        });
+
+        TempStack stack = begin_temp_stack(arena);
+        EcsStateCopy expected = copy_ecs_state(arena);
+
+        f64 load_time = time_average(1, [&]() {
+          load_snapshot(keyframe_file);
+          load_snapshot_delta(delta_file);
+        });
+
+        check_ecs_state(&expected, mode_names[m]);
+        end_temp_stack(stack);
+
+        File* f = open_file_panic_with_error(delta_file, "rb", "Failed to open the delta snapshot!\n");
+        usize delta_size = file_size(f);
+        close_file(f);
+
+        for_every(i, changed_count) {
+          remove_components_template<SparseMarker>(entities[i * entity_count / changed_count]);
+        }
+
+        f32 keyframe_ms = (f32)keyframe_time * 1000.0f;
+        f32 delta_ms = (f32)delta_time * 1000.0f;
+        f32 load_ms = (f32)load_time * 1000.0f;
+        log_message("Snapshot round trip (" + mode_names[m] + ") with " + changed_count + " changed entities: keyframe " + keyframe_ms + "ms, delta " + (f32)delta_size / (f32)KB + "kb in " + delta_ms + "ms, load " + load_ms + "ms");
+      }
+    }
+  }
+
+  void run_benchmarks() {
+    verify_archetype_par();
+    verify_snapshot_round_trip();
+    benchmark_sparse_query();
+    benchmark_entity_churn();
+    benchmark_batch_spawn();
+    benchmark_culling_bvh();
+    benchmark_occlusion_culling();
+  }
+
 //
 // Update Jobs
 //
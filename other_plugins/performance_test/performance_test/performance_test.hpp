@@ -20,6 +20,15 @@ namespace quark::performance_test {
   static const char* PERF_MODELS[] = { "suzanne", "cylinder", "sphere", "sphere", "sphere", "sphere", "cube" };
   static const vec3 PERF_ROOT_POS = { 0.0f, 0.0f, 0.0f };
 
+//
+// Components
+//
+
+  // Tag put on a sparse subset of the world for the query benchmark
+  declare_component(SparseMarker,
+    u32 stride;
+  );
+
 //
 // Global Init Jobs
 //
@@ -32,6 +41,10 @@ namespace quark::performance_test {
 
   api_decl void init_entities();
 
+  // Checks the parallel iterators and times the ecs and culling paths against their naive versions,
+  // only registered when RUN_BENCHMARKS is set
+  api_decl void run_benchmarks();
+
 //
 // Update Jobs
 //
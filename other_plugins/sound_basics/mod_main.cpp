@@ -15,10 +15,8 @@ mod_main() {
   // Update jobs
   create_system("exit_on_esc", exit_on_esc);
   create_system("update_entities", update_entities);
-  create_system("push_renderables", push_renderables);
   
   add_system("update", "update_entities", "update_tag", -1);
-  add_system("update", "push_renderables", "begin_frame", -1);
   add_system("update", "exit_on_esc", "", -1);
 
   // Set some engine constants
@@ -121,14 +121,6 @@ namespace quark::sound_basics {
     });
   }
 
-  void push_renderables() {
-    for_archetype(Include <Transform, Model, ColorMaterial> {}, Exclude<> {},
-    [&](EntityId id, Transform* transform, Model* model, ColorMaterial* material) {
-      Drawable drawable = {*transform, *model};
-      push_drawable_instance(&drawable, material);
-    });
-  }
-
   void exit_on_esc() {
     if(is_key_down(KeyCode::Escape)) {
       set_window_should_close();
@@ -18,9 +18,6 @@ namespace quark::sound_basics {
   // Update entities
   api_decl void update_entities();
 
-  // Push renderable entities
-  api_decl void push_renderables();
-
   api_decl void exit_on_esc();
 }
 
@@ -260,12 +260,6 @@ RETRY:;
     if(is_key_down(KeyCode::F)) {
       generate_wfc();
     }
-
-    for_archetype(Include<Transform, Model, LitColorMaterial> {}, Exclude<> {},
-    [&](EntityId id, Transform* transform, Model* model, LitColorMaterial* material) {
-      Drawable drawable = {*transform, *model};
-      push_drawable_instance(&drawable, material);
-    });
   }
 
   void exit_on_esc() {
@@ -13,6 +13,13 @@ namespace quark {
 // Functions
 //
 
+  // The action states are what the "actions" named access covers
+  static void check_action_access(bool const_access) {
+    #ifdef DEBUG
+      check_system_access(SystemAccessType::Named, (u64)hash_str_fast("actions"), const_access);
+    #endif
+  }
+
   void init_actions() {
   }
 
@@ -84,6 +91,8 @@ namespace quark {
   }
 
   Action get_action(const char* action_name) {
+    check_action_access(true);
+
     u64 hash = hash_str_fast(action_name);
 
     if(_action_state_map.count(hash) == 0) {
@@ -102,6 +111,8 @@ namespace quark {
   }
 
   vec2 get_action_vec2(const char* action_x_pos, const char* action_x_neg, const char* action_y_pos, const char* action_y_neg) {
+    check_action_access(true);
+
     u64 x_pos_hash = hash_str_fast(action_x_pos);
     u64 x_neg_hash = hash_str_fast(action_x_neg);
     u64 y_pos_hash = hash_str_fast(action_y_pos);
@@ -119,6 +130,8 @@ namespace quark {
   }
 
   vec3 get_action_vec3(const char* action_x_pos, const char* action_x_neg, const char* action_y_pos, const char* action_y_neg, const char* action_z_pos, const char* action_z_neg) {
+    check_action_access(true);
+
     u64 x_pos_hash = hash_str_fast(action_x_pos);
     u64 x_neg_hash = hash_str_fast(action_x_neg);
     u64 y_pos_hash = hash_str_fast(action_y_pos);
@@ -145,10 +158,16 @@ namespace quark {
   }
 
   ActionState get_action_state(const char* action_name) {
+    check_action_access(true);
     return _action_state_map.at(hash_str_fast(action_name));
   }
 
   void update_all_actions() {
+    check_action_access(false);
+    #ifdef DEBUG
+      check_system_access(SystemAccessType::Named, (u64)hash_str_fast("window_input"), true);
+    #endif
+
     for(auto action = _action_state_map.begin(); action != _action_state_map.end(); action++) {
       auto& name = action->first;
       auto state = &action->second;
@@ -4,7 +4,10 @@
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Weverything"
 
+  #include <algorithm>
   #include <filesystem>
+  #include <string>
+  #include <vector>
 
 #pragma clang diagnostic pop
 
@@ -21,24 +24,90 @@ namespace quark {
 
   std::unordered_map<u32, AssetFileLoader> _asset_ext_loaders;
   std::unordered_map<u32, AssetFileUnloader> _asset_ext_unloaders;
+  std::unordered_map<u32, AssetFileDecoder> _asset_ext_decoders;
+  std::unordered_map<u32, AssetFileRegistrar> _asset_ext_registrars;
+
+  bool PRINT_ASSET_LOAD_STATISTICS = true;
+
+  struct AssetLoadStats {
+    std::string extension;
+    u32 file_count;
+    u64 byte_count;
+    f64 decode_time; // Summed over the workers, so it can be more than the wall time
+    f64 register_time;
+  };
+
+  // In the order the extensions were first loaded
+  std::vector<AssetLoadStats> _asset_load_stats;
+
+  // Each decode in flight owns one arena until its file is registered,
+  // so this caps both the arenas loading takes from the pool and the decoded data waiting on registration
+  constexpr u32 MAX_ASSET_DECODES_IN_FLIGHT = 8;
 
 //
 // Functions
 //
 
-  void add_asset_file_loader(const char* file_extension, AssetFileLoader loader, AssetFileUnloader unloader) {
-    u32 ext_hash = hash_str_fast(file_extension);
-
-    if(_asset_ext_loaders.find(ext_hash) != _asset_ext_loaders.end()) {
+  static void check_asset_extension_is_free(u32 ext_hash, const char* file_extension) {
+    if(_asset_ext_loaders.find(ext_hash) != _asset_ext_loaders.end() || _asset_ext_decoders.find(ext_hash) != _asset_ext_decoders.end()) {
       panic("Tried to add an asset file loader for a file extension that has already been added: Extension: \"" + file_extension + "\"");
     }
+  }
+
+  void add_asset_file_loader(const char* file_extension, AssetFileLoader loader, AssetFileUnloader unloader) {
+    u32 ext_hash = hash_str_fast(file_extension);
+    check_asset_extension_is_free(ext_hash, file_extension);
 
     _asset_ext_loaders.insert(std::make_pair(ext_hash, loader));
 
     // TODO: add unloader
   }
 
-  void load_asset_path(const std::filesystem::path& path) {
+  void add_asset_file_decoder(const char* file_extension, AssetFileDecoder decoder, AssetFileRegistrar registrar) {
+    u32 ext_hash = hash_str_fast(file_extension);
+    check_asset_extension_is_free(ext_hash, file_extension);
+
+    _asset_ext_decoders.insert(std::make_pair(ext_hash, decoder));
+    _asset_ext_registrars.insert(std::make_pair(ext_hash, registrar));
+  }
+
+  static AssetLoadStats* get_asset_load_stats(const std::string& extension) {
+    for(AssetLoadStats& stats : _asset_load_stats) {
+      if(stats.extension == extension) {
+        return &stats;
+      }
+    }
+
+    _asset_load_stats.push_back(AssetLoadStats { .extension = extension });
+    return &_asset_load_stats.back();
+  }
+
+  void print_asset_load_statistics() {
+    if(!PRINT_ASSET_LOAD_STATISTICS) {
+      return;
+    }
+
+    for(AssetLoadStats& stats : _asset_load_stats) {
+      log_message(
+        "Asset load " + stats.extension.c_str() + ": " + stats.file_count + " files, " + (u64)(stats.byte_count / KB) + " KB, " +
+        "decode " + (stats.decode_time * 1000.0) + " ms, register " + (stats.register_time * 1000.0) + " ms"
+      );
+    }
+  }
+
+  // A file that load_asset_folder() has a loader for
+  struct PendingAsset {
+    std::string path;
+    std::string name;
+    std::string extension;
+    u32 ext_hash;
+    u64 byte_count;
+    AssetFileDecoder decoder; // Null for single phase loaders
+    void* decoded;
+    f64 decode_time;
+  };
+
+  static bool get_pending_asset(const std::filesystem::path& path, PendingAsset* pending) {
     // getting nicer strings from the path
     std::string path_s = path.u8string();
 
@@ -50,30 +119,153 @@ namespace quark {
   
     u32 ext_hash = hash_str_fast(extension.c_str());
 
-    // we have a loader for the file extension
-    if (_asset_ext_loaders.find(ext_hash) != _asset_ext_loaders.end()) {
-      // call the loader func
-      _asset_ext_loaders.at(ext_hash)(path_s.c_str(), filename.c_str());
+    auto decoder = _asset_ext_decoders.find(ext_hash);
+    bool has_decoder = decoder != _asset_ext_decoders.end();
 
-      // debug logging
-      #ifdef DEBUG
-      log_message("Loaded: " + filename.c_str() + extension.c_str());
-      #endif
+    // we dont have a loader for the file extension
+    if(!has_decoder && _asset_ext_loaders.find(ext_hash) == _asset_ext_loaders.end()) {
+      return false;
     }
+
+    *pending = PendingAsset {
+      .path = path_s,
+      .name = filename,
+      .extension = extension,
+      .ext_hash = ext_hash,
+      .byte_count = (u64)std::filesystem::file_size(path),
+      .decoder = has_decoder ? decoder->second : 0,
+    };
+
+    return true;
   }
 
+  static void register_pending_asset(PendingAsset* pending) {
+    Timestamp t0 = get_timestamp();
+
+    // call the loader func
+    if(pending->decoder != 0) {
+      AssetFileRegistrar registrar = _asset_ext_registrars.at(pending->ext_hash);
+      if(registrar != 0) {
+        registrar(pending->decoded, pending->path.c_str(), pending->name.c_str());
+      }
+    } else {
+      _asset_ext_loaders.at(pending->ext_hash)(pending->path.c_str(), pending->name.c_str());
+    }
+
+    AssetLoadStats* stats = get_asset_load_stats(pending->extension);
+    stats->file_count += 1;
+    stats->byte_count += pending->byte_count;
+    stats->decode_time += pending->decode_time;
+    stats->register_time += get_timestamp_difference(t0, get_timestamp());
+
+    // debug logging
+    #ifdef DEBUG
+    log_message("Loaded: " + pending->name.c_str() + pending->extension.c_str());
+    #endif
+  }
+
+  void load_asset_path(const std::filesystem::path& path) {
+    PendingAsset pending = {};
+    if(!get_pending_asset(path, &pending)) {
+      return;
+    }
+
+    Arena* arena = 0;
+    if(pending.decoder != 0) {
+      arena = get_arena();
+
+      Timestamp t0 = get_timestamp();
+      pending.decoded = pending.decoder(pending.path.c_str(), pending.name.c_str(), arena);
+      pending.decode_time = get_timestamp_difference(t0, get_timestamp());
+    }
+
+    register_pending_asset(&pending);
+
+    if(arena != 0) {
+      free_arena(arena);
+    }
+  }
+
+  // One decode in flight, reused once its file has been registered
+  struct AssetDecodeSlot {
+    Arena* arena;
+    JobCounter counter;
+  };
+
   void load_asset_folder(const char* folder_path) {
     if(!path_exists(folder_path)) {
       return;
     }
 
-    // TODO: multithreading?
+    // Sorted so the registration order, and with it the asset ids, doesn't depend on the file system
+    std::vector<PendingAsset> assets;
 
     using std::filesystem::recursive_directory_iterator;
     for (recursive_directory_iterator it(folder_path), end; it != end; it++) {
-      if (!std::filesystem::is_directory(it->path())) {
-        load_asset_path(it->path());
+      PendingAsset pending = {};
+      if (!std::filesystem::is_directory(it->path()) && get_pending_asset(it->path(), &pending)) {
+        assets.push_back(pending);
+      }
+    }
+
+    std::sort(assets.begin(), assets.end(), [](const PendingAsset& a, const PendingAsset& b) { return a.path < b.path; });
+
+    std::vector<u32> decode_indices;
+    for_every(i, assets.size()) {
+      if(assets[i].decoder != 0) {
+        decode_indices.push_back(i);
       }
     }
+
+    u32 slot_count = job_worker_count();
+    slot_count = slot_count < MAX_ASSET_DECODES_IN_FLIGHT ? slot_count : MAX_ASSET_DECODES_IN_FLIGHT;
+    slot_count = slot_count < decode_indices.size() ? slot_count : (u32)decode_indices.size();
+
+    AssetDecodeSlot slots[MAX_ASSET_DECODES_IN_FLIGHT] = {};
+    for_every(s, slot_count) {
+      slots[s].arena = get_arena();
+    }
+
+    // Decode d always goes in slot d % slot_count, which is free again once decode d - slot_count was registered
+    u32 spawned_count = 0;
+    u32 registered_count = 0;
+
+    auto spawn_decodes = [&]() {
+      while(spawned_count < decode_indices.size() && spawned_count - registered_count < slot_count) {
+        AssetDecodeSlot* slot = &slots[spawned_count % slot_count];
+        PendingAsset* pending = &assets[decode_indices[spawned_count]];
+        Arena* arena = slot->arena;
+
+        job_spawn(&slot->counter, [pending, arena]() {
+          Timestamp t0 = get_timestamp();
+          pending->decoded = pending->decoder(pending->path.c_str(), pending->name.c_str(), arena);
+          pending->decode_time = get_timestamp_difference(t0, get_timestamp());
+        });
+
+        spawned_count += 1;
+      }
+    };
+
+    // Registration creates the gpu resources and assets, so it stays on this thread.
+    // Files go in path order as soon as their decode is done while the later ones keep decoding
+    for_every(i, assets.size()) {
+      spawn_decodes();
+
+      if(assets[i].decoder == 0) {
+        register_pending_asset(&assets[i]);
+        continue;
+      }
+
+      AssetDecodeSlot* slot = &slots[registered_count % slot_count];
+      job_wait(&slot->counter);
+
+      register_pending_asset(&assets[i]);
+      arena_reset(slot->arena);
+      registered_count += 1;
+    }
+
+    for_every(s, slot_count) {
+      free_arena(slots[s].arena);
+    }
   }
 }
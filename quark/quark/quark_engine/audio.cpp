@@ -63,6 +63,19 @@ namespace quark {
 
     ma_engine_listener_set_enabled(sound_engine(), 0, true);
     ma_engine_listener_set_world_up(sound_engine(), 0, 0, 0, 1);
+
+    // Temporary sounds get destroyed when they finish, so this writes to the EcsContext
+    SystemResourceAccess sync_sound_state_access[] = {
+      resource_access<SoundContext>(false),
+      resource_access<MainListener>(false),
+      resource_access<EcsContext>(false),
+      component_access<Transform>(true),
+      component_access<SoundOptions>(true),
+      component_access<SoundData>(true),
+      component_access<TemporarySound>(true),
+    };
+
+    set_system_access("sync_sound_state", sync_sound_state_access, count_of(sync_sound_state_access));
   }
 
   void attach_sound(EntityId id, const char* sound_path) {
@@ -154,7 +167,7 @@ namespace quark {
     ma_engine_listener_set_world_up(sound_engine(), 0, up.x, up.y, up.z);
 
     for_archetype(Include<Transform, SoundOptions, SoundData, TemporarySound> {}, Exclude<> {},
-    [&](EntityId id, Transform*, SoundOptions*, SoundData* data, TemporarySound*) {
+    [&](EntityId id, const Transform*, const SoundOptions*, const SoundData* data, const TemporarySound*) {
       if(!ma_sound_is_playing(&data->sound)) {
         destroy_entity(id);
       }
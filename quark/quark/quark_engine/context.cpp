@@ -15,15 +15,17 @@ namespace quark {
   define_component(Model);
 
   void load_assets() {
-    add_asset_file_loader(".obj", load_obj_file);
-    add_asset_file_loader(".png", load_png_file);
-    add_asset_file_loader(".qmesh", load_qmesh_file);
+    add_asset_file_decoder(".obj", decode_obj_file, 0);
+    add_asset_file_decoder(".png", decode_png_file, register_png_file);
+    add_asset_file_decoder(".qmesh", decode_qmesh_file, register_qmesh_file);
     add_asset_file_loader(".qmodel", load_qmodel_file);
 
     load_asset_folder("quark/models");
     load_asset_folder("quark/textures");
     load_asset_folder("quark/qmesh");
     load_asset_folder("quark/qmodel");
+
+    print_asset_load_statistics();
   }
 
   Timestamp frame_begin_time;
@@ -79,6 +81,9 @@ namespace quark {
       // create_system("init_builtin_component_types", init_builtin_component_types);
       create_system("init_sound_context", init_sound_context);
 
+      // Quark deinit
+      create_system("wait_for_snapshot_save", wait_for_snapshot_save);
+
       // Update
       create_system("update_window_inputs", update_window_inputs);
       create_system("update_all_actions", update_all_actions);
@@ -131,6 +136,10 @@ namespace quark {
         
       add_system("quark_init", "init_sound_context", "", -1);
 
+      // Quark deinit
+      // A background snapshot save still writing would take the process down with it
+      add_system("quark_deinit", "wait_for_snapshot_save", "", -1);
+
       // Update
       add_system("update", "update_window_inputs", "", -1);
       add_system("update", "update_all_actions", "", -1);
@@ -164,6 +173,74 @@ namespace quark {
       add_system("update", "print_performance_statistics", "", -1);
     }
 
+    // Declare system access so the scheduler can overlap them,
+    // the draw and pass systems record into the same command buffer so they stay in order.
+    // sync_sound_state is declared in init_sound_context() since its components are private to audio.cpp
+    {
+      SystemResourceAccess update_window_inputs_access[] = {
+        named_access("window_input", false),
+      };
+
+      SystemResourceAccess update_all_actions_access[] = {
+        named_access("window_input", true),
+        named_access("actions", false),
+      };
+
+      SystemResourceAccess push_renderables_access[] = {
+        resource_access<Renderer>(false),
+        resource_access<Arenas>(false),
+        component_access<Transform>(true),
+        component_access<Model>(true),
+        component_access<ColorMaterial>(true),
+        component_access<TextureMaterial>(true),
+        component_access<LitColorMaterial>(true),
+      };
+
+      SystemResourceAccess begin_frame_access[] = {
+        resource_access<Graphics>(false),
+        named_access("window_input", true),
+      };
+
+      SystemResourceAccess update_world_cameras_access[] = {
+        resource_access<MainCamera>(true),
+        resource_access<SunCamera>(true),
+        resource_access<MainCameraViewProj>(false),
+        resource_access<SunCameraViewProj>(false),
+        named_access("window_input", true),
+      };
+
+      SystemResourceAccess update_world_data_access[] = {
+        resource_access<WorldData>(false),
+        resource_access<Renderer>(true),
+        resource_access<Graphics>(true),
+        resource_access<MainCamera>(true),
+        resource_access<SunCamera>(true),
+        resource_access<MainCameraViewProj>(true),
+        resource_access<SunCameraViewProj>(true),
+        named_access("window_input", true),
+        component_access<Transform>(true),
+        component_access<PointLight>(true),
+      };
+
+      SystemResourceAccess build_material_batch_commands_access[] = {
+        resource_access<Renderer>(false),
+        resource_access<Arenas>(false),
+        resource_access<Graphics>(true),
+        resource_access<MainCamera>(true),
+        resource_access<SunCamera>(true),
+        resource_access<MainCameraViewProj>(true),
+        named_access("window_input", true),
+      };
+
+      set_system_access("update_window_inputs", update_window_inputs_access, count_of(update_window_inputs_access), true);
+      set_system_access("update_all_actions", update_all_actions_access, count_of(update_all_actions_access), true);
+      set_system_access("push_renderables", push_renderables_access, count_of(push_renderables_access));
+      set_system_access("begin_frame", begin_frame_access, count_of(begin_frame_access), true);
+      set_system_access("update_world_cameras", update_world_cameras_access, count_of(update_world_cameras_access));
+      set_system_access("update_world_data", update_world_data_access, count_of(update_world_data_access));
+      set_system_access("build_material_batch_commands", build_material_batch_commands_access, count_of(build_material_batch_commands_access));
+    }
+
     // Add states
     {
       create_state("main", "init", "update", "deinit");
@@ -172,6 +249,12 @@ namespace quark {
 
   void run() {
     run_system_list("quark_init");
+
+    #ifdef DEBUG
+    log_arena_pool_info();
+    log_ecs_table_info();
+    #endif
+
     change_state("main", false);
     run_state_init();
 
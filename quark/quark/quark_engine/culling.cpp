@@ -0,0 +1,731 @@
+#define QUARK_ENGINE_IMPLEMENTATION
+#include "quark_engine.hpp"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+
+  #include <algorithm>
+
+#pragma clang diagnostic pop
+
+namespace quark {
+//
+// Structs
+//
+
+  struct CullingBvhBuildTask {
+    u32 node;
+    u32 start;
+    u32 count;
+  };
+
+//
+// Variables
+//
+
+  // Accept and reject only when a node is clearly in or out, anything closer to a plane
+  // gets its spheres tested one by one with is_sphere_visible()
+  static constexpr f32 CULLING_BVH_EPSILON = 0.0001f;
+
+  static constexpr u32 CULLING_BVH_MAX_DEPTH = 64;
+
+  // Occluder triangles get clipped to w >= this so 1 / w stays finite
+  static constexpr f32 OCCLUSION_NEAR_W = 0.001f;
+
+  static constexpr u32 OCCLUSION_TILE_SIZE = OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT;
+
+//
+// Helpers
+//
+
+  static vec3 min_vec3(vec3 a, vec3 b) {
+    return vec3 { a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z };
+  }
+
+  static vec3 max_vec3(vec3 a, vec3 b) {
+    return vec3 { a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z };
+  }
+
+  static void update_leaf_bounds(CullingBvh* bvh, CullingBvhNode* node) {
+    node->min = vec3 {  F32_MAX,  F32_MAX,  F32_MAX };
+    node->max = vec3 { -F32_MAX, -F32_MAX, -F32_MAX };
+
+    for_range(i, node->first, node->first + node->count) {
+      vec4 sphere = bvh->spheres[bvh->indices[i]];
+      vec3 center = vec3 { sphere.x, sphere.y, sphere.z };
+
+      node->min = min_vec3(node->min, center - sphere.w);
+      node->max = max_vec3(node->max, center + sphere.w);
+    }
+  }
+
+  static void update_interior_bounds(CullingBvh* bvh, CullingBvhNode* node) {
+    CullingBvhNode* left = &bvh->nodes[node->first];
+    CullingBvhNode* right = &bvh->nodes[node->first + 1];
+
+    node->min = min_vec3(left->min, right->min);
+    node->max = max_vec3(left->max, right->max);
+  }
+
+  static void set_visible_range(u32* indices, u32 start, u32 count, u64* out_bitset) {
+    for_range(i, start, start + count) {
+      set_bitset_bit(out_bitset, indices[i]);
+    }
+  }
+
+  enum struct BoundsVisibility {
+    Outside,
+    Intersecting,
+    Inside,
+  };
+
+  static BoundsVisibility classify_bounds(FrustumPlanes* frustum, vec3 bounds_min, vec3 bounds_max) {
+    vec3 center = (bounds_min + bounds_max) / 2.0f;
+    vec3 extents = (bounds_max - bounds_min) / 2.0f;
+
+    BoundsVisibility visibility = BoundsVisibility::Inside;
+
+    for_every(i, 6) {
+      vec4 plane = frustum->planes[i];
+
+      f32 dist = plane_point_distance(plane, center);
+      f32 radius = dot(abs(vec3 { plane.x, plane.y, plane.z }), extents);
+
+      if(dist + radius < -CULLING_BVH_EPSILON) {
+        return BoundsVisibility::Outside;
+      }
+
+      if(dist - radius <= CULLING_BVH_EPSILON) {
+        visibility = BoundsVisibility::Intersecting;
+      }
+    }
+
+    return visibility;
+  }
+
+  // Test spheres[indices[first..first + count)] one by one
+  static u32 cull_sphere_range(vec4* spheres, u32* indices, u32 first, u32 count, FrustumPlanes* frustum, f32 radius_scale, u64* out_bitset) {
+    u32 visible_count = 0;
+
+    for_range(i, first, first + count) {
+      u32 index = indices[i];
+      vec4 sphere = spheres[index];
+
+      if(is_sphere_visible(frustum, vec3 { sphere.x, sphere.y, sphere.z }, sphere.w * radius_scale)) {
+        set_bitset_bit(out_bitset, index);
+        visible_count += 1;
+      }
+    }
+
+    return visible_count;
+  }
+
+  static u32 hash_grid_cell(vec4 sphere, f32 inv_cell_size, u32 cell_count) {
+    i32 x = (i32)floorf(sphere.x * inv_cell_size);
+    i32 y = (i32)floorf(sphere.y * inv_cell_size);
+    i32 z = (i32)floorf(sphere.z * inv_cell_size);
+
+    return ((u32)x * 73856093u ^ (u32)y * 19349663u ^ (u32)z * 83492791u) & (cell_count - 1);
+  }
+
+//
+// Build
+//
+
+  void build_culling_bvh(CullingBvh* bvh, Arena* arena, vec4* spheres, u32 sphere_count) {
+    // Every split leaves at least CULLING_BVH_LEAF_SIZE / 2 spheres on each side
+    u32 max_leaf_count = sphere_count / (CULLING_BVH_LEAF_SIZE / 2) + 1;
+
+    *bvh = {};
+    bvh->spheres = spheres;
+    bvh->sphere_count = sphere_count;
+    bvh->indices = arena_push_array(arena, u32, sphere_count);
+    bvh->nodes = arena_push_array(arena, CullingBvhNode, max_leaf_count * 2);
+
+    if(sphere_count == 0) {
+      return;
+    }
+
+    for_every(i, sphere_count) {
+      bvh->indices[i] = i;
+    }
+
+    CullingBvhBuildTask stack[CULLING_BVH_MAX_DEPTH];
+    u32 stack_count = 0;
+
+    bvh->node_count = 1;
+    stack[stack_count] = CullingBvhBuildTask { 0, 0, sphere_count };
+    stack_count += 1;
+
+    while(stack_count > 0) {
+      stack_count -= 1;
+      CullingBvhBuildTask task = stack[stack_count];
+
+      CullingBvhNode* node = &bvh->nodes[task.node];
+      node->first = task.start;
+      node->count = task.count;
+
+      if(task.count <= CULLING_BVH_LEAF_SIZE) {
+        continue;
+      }
+
+      // Split at the median along the axis the centers are most spread out on
+      vec3 center_min = vec3 {  F32_MAX,  F32_MAX,  F32_MAX };
+      vec3 center_max = vec3 { -F32_MAX, -F32_MAX, -F32_MAX };
+
+      for_range(i, task.start, task.start + task.count) {
+        vec4 sphere = spheres[bvh->indices[i]];
+        vec3 center = vec3 { sphere.x, sphere.y, sphere.z };
+
+        center_min = min_vec3(center_min, center);
+        center_max = max_vec3(center_max, center);
+      }
+
+      vec3 spread = center_max - center_min;
+      u32 axis = 0;
+      if(spread.y > spread[axis]) { axis = 1; }
+      if(spread.z > spread[axis]) { axis = 2; }
+
+      u32* first = bvh->indices + task.start;
+      u32* middle = first + task.count / 2;
+      u32* last = first + task.count;
+
+      std::nth_element(first, middle, last, [&](u32 a, u32 b) {
+        return spheres[a][axis] < spheres[b][axis];
+      });
+
+      // Children are always created after their parent, refit depends on this
+      u32 child = bvh->node_count;
+      bvh->node_count += 2;
+      node->first = child;
+
+      if(stack_count + 2 > CULLING_BVH_MAX_DEPTH) {
+        panic("build_culling_bvh() went deeper than CULLING_BVH_MAX_DEPTH!");
+      }
+
+      stack[stack_count + 0] = CullingBvhBuildTask { child + 1, task.start + task.count / 2, task.count - task.count / 2 };
+      stack[stack_count + 1] = CullingBvhBuildTask { child, task.start, task.count / 2 };
+      stack_count += 2;
+    }
+
+    refit_culling_bvh(bvh);
+  }
+
+  void refit_culling_bvh(CullingBvh* bvh) {
+    for(u32 i = bvh->node_count; i > 0; i -= 1) {
+      CullingBvhNode* node = &bvh->nodes[i - 1];
+
+      if(node->count > CULLING_BVH_LEAF_SIZE) {
+        update_interior_bounds(bvh, node);
+      } else {
+        update_leaf_bounds(bvh, node);
+      }
+    }
+  }
+
+//
+// Query
+//
+
+  u32 cull_culling_bvh(CullingBvh* bvh, FrustumPlanes* frustum, f32 radius_scale, u64* out_bitset) {
+    if(bvh->node_count == 0) {
+      return 0;
+    }
+
+    u32 stack[CULLING_BVH_MAX_DEPTH];
+    u32 stack_count = 0;
+
+    stack[stack_count] = 0;
+    stack_count += 1;
+
+    u32 visible_count = 0;
+
+    while(stack_count > 0) {
+      stack_count -= 1;
+      CullingBvhNode* node = &bvh->nodes[stack[stack_count]];
+
+      // Node bounds fit the unscaled spheres, so with radius_scale <= 1 both outside and inside still hold
+      BoundsVisibility visibility = classify_bounds(frustum, node->min, node->max);
+      if(visibility == BoundsVisibility::Outside) {
+        continue;
+      }
+
+      // Fully inside, the subtree's spheres start where its leftmost leaf does
+      if(visibility == BoundsVisibility::Inside) {
+        CullingBvhNode* leftmost = node;
+        while(leftmost->count > CULLING_BVH_LEAF_SIZE) {
+          leftmost = &bvh->nodes[leftmost->first];
+        }
+
+        set_visible_range(bvh->indices, leftmost->first, node->count, out_bitset);
+        visible_count += node->count;
+        continue;
+      }
+
+      if(node->count <= CULLING_BVH_LEAF_SIZE) {
+        visible_count += cull_sphere_range(bvh->spheres, bvh->indices, node->first, node->count, frustum, radius_scale, out_bitset);
+        continue;
+      }
+
+      stack[stack_count + 0] = node->first + 1;
+      stack[stack_count + 1] = node->first;
+      stack_count += 2;
+    }
+
+    return visible_count;
+  }
+
+//
+// Grid
+//
+
+  void build_culling_grid(CullingGrid* grid, Arena* arena, vec4* spheres, u32* sphere_indices, u32 sphere_count, f32 cell_size) {
+    // About two spheres per cell, cell coordinates get hashed so collisions only merge two cells
+    u32 cell_count = 1;
+    while(cell_count < sphere_count / 2) {
+      cell_count *= 2;
+    }
+
+    *grid = {};
+    grid->cell_count = cell_count;
+    grid->cell_starts = arena_push_array_zero(arena, u32, cell_count + 1);
+    grid->cell_mins = arena_push_array(arena, vec3, cell_count);
+    grid->cell_maxs = arena_push_array(arena, vec3, cell_count);
+    grid->indices = arena_push_array(arena, u32, sphere_count);
+    grid->spheres = spheres;
+    grid->sphere_count = sphere_count;
+
+    u32* cells = arena_push_array(arena, u32, sphere_count);
+    f32 inv_cell_size = 1.0f / cell_size;
+
+    for_every(c, cell_count) {
+      grid->cell_mins[c] = vec3 {  F32_MAX,  F32_MAX,  F32_MAX };
+      grid->cell_maxs[c] = vec3 { -F32_MAX, -F32_MAX, -F32_MAX };
+    }
+
+    // Cells are loose, they grow to fit whatever is in them instead of splitting spheres across cells
+    for_every(i, sphere_count) {
+      vec4 sphere = spheres[sphere_indices[i]];
+      vec3 center = vec3 { sphere.x, sphere.y, sphere.z };
+
+      u32 cell = hash_grid_cell(sphere, inv_cell_size, cell_count);
+      cells[i] = cell;
+      grid->cell_starts[cell + 1] += 1;
+
+      grid->cell_mins[cell] = min_vec3(grid->cell_mins[cell], center - sphere.w);
+      grid->cell_maxs[cell] = max_vec3(grid->cell_maxs[cell], center + sphere.w);
+    }
+
+    for_every(c, cell_count) {
+      grid->cell_starts[c + 1] += grid->cell_starts[c];
+    }
+
+    // Counting sort by cell, cells[] turns into the next write position of each sphere's cell
+    u32* heads = arena_copy_array(arena, grid->cell_starts, u32, cell_count);
+    for_every(i, sphere_count) {
+      grid->indices[heads[cells[i]]] = sphere_indices[i];
+      heads[cells[i]] += 1;
+    }
+  }
+
+  u32 cull_culling_grid(CullingGrid* grid, FrustumPlanes* frustum, f32 radius_scale, u64* out_bitset) {
+    u32 visible_count = 0;
+
+    for_every(c, grid->cell_count) {
+      u32 first = grid->cell_starts[c];
+      u32 count = grid->cell_starts[c + 1] - first;
+
+      if(count == 0) {
+        continue;
+      }
+
+      BoundsVisibility visibility = classify_bounds(frustum, grid->cell_mins[c], grid->cell_maxs[c]);
+      if(visibility == BoundsVisibility::Outside) {
+        continue;
+      }
+
+      if(visibility == BoundsVisibility::Inside) {
+        set_visible_range(grid->indices, first, count, out_bitset);
+        visible_count += count;
+        continue;
+      }
+
+      visible_count += cull_sphere_range(grid->spheres, grid->indices, first, count, frustum, radius_scale, out_bitset);
+    }
+
+    return visible_count;
+  }
+
+//
+// Brute Force
+//
+
+  u32 cull_spheres_brute_force(vec4* spheres, u32 sphere_count, FrustumPlanes* frustum, u64* out_bitset) {
+    u32 visible_count = 0;
+
+    for(u32 word_start = 0; word_start < sphere_count; word_start += 64) {
+      u32 word_end = word_start + 64 < sphere_count ? word_start + 64 : sphere_count;
+      u64 bits = 0;
+      u32 index = word_start;
+
+#ifdef __AVX2__
+      // vec4 is 4 floats, so gather every 4th float starting at x, y, z and w
+      __m256i offsets = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+
+      for(; index + 8 <= word_end; index += 8) {
+        f32* base = (f32*)&spheres[index];
+
+        __m256 x = _mm256_i32gather_ps(base + 0, offsets, 4);
+        __m256 y = _mm256_i32gather_ps(base + 1, offsets, 4);
+        __m256 z = _mm256_i32gather_ps(base + 2, offsets, 4);
+        __m256 radius = _mm256_i32gather_ps(base + 3, offsets, 4);
+
+        bits |= (u64)are_spheres_visible_8(frustum, x, y, z, radius) << (index - word_start);
+      }
+#endif
+
+      for(; index < word_end; index += 1) {
+        vec4 sphere = spheres[index];
+        if(is_sphere_visible(frustum, vec3 { sphere.x, sphere.y, sphere.z }, sphere.w)) {
+          bits |= 1ull << (index - word_start);
+        }
+      }
+
+      out_bitset[word_start / 64] = bits;
+      visible_count += __builtin_popcountll(bits);
+    }
+
+    return visible_count;
+  }
+
+//
+// Occlusion
+//
+
+  // Screen space vertex, z is 1 / w
+  struct OcclusionVertex {
+    f32 x;
+    f32 y;
+    f32 z;
+  };
+
+  static OcclusionVertex clip_to_occlusion_vertex(OcclusionBuffer* buffer, vec4 clip) {
+    f32 inv_w = 1.0f / clip.w;
+
+    OcclusionVertex vertex = {};
+    vertex.x = (clip.x * inv_w * 0.5f + 0.5f) * buffer->width;
+    vertex.y = (clip.y * inv_w * 0.5f + 0.5f) * buffer->height;
+    vertex.z = inv_w;
+
+    return vertex;
+  }
+
+  // Matrices are column major, mat4 * vec4 treats them as row major
+  static vec4 transform_point(mat4* m, vec3 point) {
+    return (*m)[0] * point.x + (*m)[1] * point.y + (*m)[2] * point.z + (*m)[3];
+  }
+
+  static f32 min3(f32 a, f32 b, f32 c) {
+    return min(min(a, b), c);
+  }
+
+  static f32 max3(f32 a, f32 b, f32 c) {
+    return max(max(a, b), c);
+  }
+
+  static i32 clamp_i32(i32 value, i32 low, i32 high) {
+    return value < low ? low : (value > high ? high : value);
+  }
+
+  static void update_tile_depth(OcclusionBuffer* buffer, u32 tile_index) {
+    f32* depth = &buffer->depth[tile_index * OCCLUSION_TILE_SIZE];
+
+#ifdef __AVX2__
+    __m256 farthest = _mm256_load_ps(depth);
+    for_range(i, 1, OCCLUSION_TILE_HEIGHT) {
+      farthest = _mm256_min_ps(farthest, _mm256_load_ps(depth + i * OCCLUSION_TILE_WIDTH));
+    }
+
+    // Horizontal min of the 8 lanes
+    __m128 half = _mm_min_ps(_mm256_castps256_ps128(farthest), _mm256_extractf128_ps(farthest, 1));
+    half = _mm_min_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_min_ss(half, _mm_shuffle_ps(half, half, 1));
+    buffer->tile_depth[tile_index] = _mm_cvtss_f32(half);
+#else
+    f32 farthest = depth[0];
+    for_range(i, 1, OCCLUSION_TILE_SIZE) {
+      farthest = min(farthest, depth[i]);
+    }
+    buffer->tile_depth[tile_index] = farthest;
+#endif
+  }
+
+  static void rasterize_occlusion_triangle(OcclusionBuffer* buffer, OcclusionVertex v0, OcclusionVertex v1, OcclusionVertex v2, vec3 depth_plane) {
+    f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+
+    // Occluders are two sided, flip everything to the same winding
+    if(area < 0.0f) {
+      OcclusionVertex temp = v1;
+      v1 = v2;
+      v2 = temp;
+      area = -area;
+    }
+
+    if(area < F32_EPSILON) {
+      return;
+    }
+
+    // Pixels with their center inside the triangle
+    i32 min_x = clamp_i32((i32)floorf(min3(v0.x, v1.x, v2.x) - 0.5f), 0, buffer->width - 1);
+    i32 max_x = clamp_i32((i32)ceilf(max3(v0.x, v1.x, v2.x) - 0.5f), 0, buffer->width - 1);
+    i32 min_y = clamp_i32((i32)floorf(min3(v0.y, v1.y, v2.y) - 0.5f), 0, buffer->height - 1);
+    i32 max_y = clamp_i32((i32)ceilf(max3(v0.y, v1.y, v2.y) - 0.5f), 0, buffer->height - 1);
+
+    if(min_x > max_x || min_y > max_y) {
+      return;
+    }
+
+    // Edge functions, a pixel is inside when all three are >= 0
+    f32 edge_a[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+    f32 edge_b[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+    f32 edge_c[3] = {
+      v1.x * v2.y - v1.y * v2.x,
+      v2.x * v0.y - v2.y * v0.x,
+      v0.x * v1.y - v0.y * v1.x,
+    };
+
+    f32 depth_a = depth_plane.x;
+    f32 depth_b = depth_plane.y;
+    f32 depth_c = depth_plane.z;
+
+    f32 nearest = max3(v0.z, v1.z, v2.z);
+
+    u32 tile_min_x = min_x / OCCLUSION_TILE_WIDTH;
+    u32 tile_max_x = max_x / OCCLUSION_TILE_WIDTH;
+    u32 tile_min_y = min_y / OCCLUSION_TILE_HEIGHT;
+    u32 tile_max_y = max_y / OCCLUSION_TILE_HEIGHT;
+
+    for_range(tile_y, tile_min_y, tile_max_y + 1) {
+      for_range(tile_x, tile_min_x, tile_max_x + 1) {
+        u32 tile_index = tile_y * buffer->tile_count_x + tile_x;
+
+        // Everything in the tile is already in front of the whole triangle
+        if(nearest <= buffer->tile_depth[tile_index]) {
+          continue;
+        }
+
+        f32* depth = &buffer->depth[tile_index * OCCLUSION_TILE_SIZE];
+        f32 x0 = (f32)(tile_x * OCCLUSION_TILE_WIDTH) + 0.5f;
+
+#ifdef __AVX2__
+        __m256 x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+        __m256 zero = _mm256_setzero_ps();
+
+        __m256 e0_x = _mm256_mul_ps(_mm256_set1_ps(edge_a[0]), x);
+        __m256 e1_x = _mm256_mul_ps(_mm256_set1_ps(edge_a[1]), x);
+        __m256 e2_x = _mm256_mul_ps(_mm256_set1_ps(edge_a[2]), x);
+        __m256 depth_x = _mm256_mul_ps(_mm256_set1_ps(depth_a), x);
+
+        for_every(row, OCCLUSION_TILE_HEIGHT) {
+          f32 y = (f32)(tile_y * OCCLUSION_TILE_HEIGHT + row) + 0.5f;
+
+          __m256 e0 = _mm256_add_ps(e0_x, _mm256_set1_ps(edge_b[0] * y + edge_c[0]));
+          __m256 e1 = _mm256_add_ps(e1_x, _mm256_set1_ps(edge_b[1] * y + edge_c[1]));
+          __m256 e2 = _mm256_add_ps(e2_x, _mm256_set1_ps(edge_b[2] * y + edge_c[2]));
+
+          __m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ));
+          inside = _mm256_and_ps(inside, _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+
+          if(_mm256_movemask_ps(inside) == 0) {
+            continue;
+          }
+
+          __m256 triangle_depth = _mm256_add_ps(depth_x, _mm256_set1_ps(depth_b * y + depth_c));
+          __m256 old_depth = _mm256_load_ps(depth + row * OCCLUSION_TILE_WIDTH);
+          __m256 new_depth = _mm256_blendv_ps(old_depth, _mm256_max_ps(old_depth, triangle_depth), inside);
+          _mm256_store_ps(depth + row * OCCLUSION_TILE_WIDTH, new_depth);
+        }
+#else
+        for_every(row, OCCLUSION_TILE_HEIGHT) {
+          f32 y = (f32)(tile_y * OCCLUSION_TILE_HEIGHT + row) + 0.5f;
+
+          for_every(column, OCCLUSION_TILE_WIDTH) {
+            f32 x = x0 + (f32)column;
+
+            f32 e0 = edge_a[0] * x + (edge_b[0] * y + edge_c[0]);
+            f32 e1 = edge_a[1] * x + (edge_b[1] * y + edge_c[1]);
+            f32 e2 = edge_a[2] * x + (edge_b[2] * y + edge_c[2]);
+
+            if(e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+              f32* pixel = &depth[row * OCCLUSION_TILE_WIDTH + column];
+              *pixel = max(*pixel, depth_a * x + (depth_b * y + depth_c));
+            }
+          }
+        }
+#endif
+
+        update_tile_depth(buffer, tile_index);
+      }
+    }
+  }
+
+  void init_occlusion_buffer(OcclusionBuffer* buffer, Arena* arena, u32 width, u32 height) {
+    if(width == 0 || height == 0 || width % OCCLUSION_TILE_WIDTH != 0 || height % OCCLUSION_TILE_HEIGHT != 0) {
+      panic("init_occlusion_buffer() needs a size that is a multiple of the tile size!");
+    }
+
+    *buffer = {};
+    buffer->width = width;
+    buffer->height = height;
+    buffer->tile_count_x = width / OCCLUSION_TILE_WIDTH;
+    buffer->tile_count_y = height / OCCLUSION_TILE_HEIGHT;
+
+    // Tile rows get loaded as aligned avx2 registers
+    buffer->depth = (f32*)arena_push_zero_with_alignment(arena, width * height * sizeof(f32), 32);
+    buffer->tile_depth = arena_push_array_zero(arena, f32, buffer->tile_count_x * buffer->tile_count_y);
+    buffer->view_projection = MAT4_IDENTITY;
+  }
+
+  void clear_occlusion_buffer(OcclusionBuffer* buffer, mat4* view_projection) {
+    zero_mem(buffer->depth, buffer->width * buffer->height * sizeof(f32));
+    zero_mem(buffer->tile_depth, buffer->tile_count_x * buffer->tile_count_y * sizeof(f32));
+    buffer->view_projection = *view_projection;
+  }
+
+  void rasterize_occluder(OcclusionBuffer* buffer, OccluderMesh* mesh, mat4* transform) {
+    mat4 world_view_projection = buffer->view_projection * *transform;
+
+    for(u32 i = 0; i + 3 <= mesh->index_count; i += 3) {
+      vec4 clip[3];
+      for_every(j, 3) {
+        clip[j] = transform_point(&world_view_projection, mesh->positions[mesh->indices[i + j]]);
+      }
+
+      bool inside[3];
+      u32 inside_count = 0;
+      for_every(j, 3) {
+        inside[j] = clip[j].w >= OCCLUSION_NEAR_W;
+        inside_count += inside[j] ? 1 : 0;
+      }
+
+      if(inside_count == 0) {
+        continue;
+      }
+
+      // 1 / w is linear in screen space. Get the plane from the unclipped triangle,
+      // vertices clipped close to the eye end up far off screen and lose too much precision
+      vec3 p0 = vec3 { clip[0].x, clip[0].y, clip[0].w };
+      vec3 p1 = vec3 { clip[1].x, clip[1].y, clip[1].w };
+      vec3 p2 = vec3 { clip[2].x, clip[2].y, clip[2].w };
+
+      vec3 normal = cross(p1 - p0, p2 - p0);
+      f32 plane_distance = dot(normal, p0);
+
+      // Seen edge on
+      if(plane_distance * plane_distance <= F32_EPSILON * dot(normal, normal)) {
+        continue;
+      }
+
+      // normal.x * ndc_x + normal.y * ndc_y + normal.z = plane_distance / w, then ndc to pixels
+      vec3 depth_plane = {};
+      depth_plane.x = normal.x * 2.0f / (buffer->width * plane_distance);
+      depth_plane.y = normal.y * 2.0f / (buffer->height * plane_distance);
+      depth_plane.z = (normal.z - normal.x - normal.y) / plane_distance;
+
+      // Clip against the near plane, a triangle turns into at most a quad
+      vec4 polygon[4];
+      u32 polygon_count = 0;
+
+      for_every(j, 3) {
+        vec4 a = clip[j];
+        vec4 b = clip[(j + 1) % 3];
+        bool a_inside = inside[j];
+        bool b_inside = inside[(j + 1) % 3];
+
+        if(a_inside) {
+          polygon[polygon_count] = a;
+          polygon_count += 1;
+        }
+
+        if(a_inside != b_inside) {
+          f32 t = (OCCLUSION_NEAR_W - a.w) / (b.w - a.w);
+          polygon[polygon_count] = a + (b - a) * t;
+          polygon[polygon_count].w = OCCLUSION_NEAR_W;
+          polygon_count += 1;
+        }
+      }
+
+      OcclusionVertex v0 = clip_to_occlusion_vertex(buffer, polygon[0]);
+      for_range(j, 2, polygon_count) {
+        OcclusionVertex v1 = clip_to_occlusion_vertex(buffer, polygon[j - 1]);
+        OcclusionVertex v2 = clip_to_occlusion_vertex(buffer, polygon[j]);
+        rasterize_occlusion_triangle(buffer, v0, v1, v2, depth_plane);
+      }
+    }
+  }
+
+  bool is_sphere_occluded(OcclusionBuffer* buffer, vec3 position, f32 radius) {
+    mat4* m = &buffer->view_projection;
+    vec4 center = transform_point(m, position);
+
+    // How far x, y and w can move from the center anywhere on the sphere
+    f32 radius_x = radius * length(vec3 { (*m)[0].x, (*m)[1].x, (*m)[2].x });
+    f32 radius_y = radius * length(vec3 { (*m)[0].y, (*m)[1].y, (*m)[2].y });
+    f32 radius_w = radius * length(vec3 { (*m)[0].w, (*m)[1].w, (*m)[2].w });
+
+    f32 min_w = center.w - radius_w;
+    f32 max_w = center.w + radius_w;
+
+    // Touching the near plane, nothing can be in front of it
+    if(min_w < OCCLUSION_NEAR_W) {
+      return false;
+    }
+
+    f32 min_clip_x = center.x - radius_x;
+    f32 max_clip_x = center.x + radius_x;
+    f32 min_clip_y = center.y - radius_y;
+    f32 max_clip_y = center.y + radius_y;
+
+    // Smallest and largest x / w and y / w over the box around the sphere
+    f32 min_ndc_x = min_clip_x / (min_clip_x >= 0.0f ? max_w : min_w);
+    f32 max_ndc_x = max_clip_x / (max_clip_x >= 0.0f ? min_w : max_w);
+    f32 min_ndc_y = min_clip_y / (min_clip_y >= 0.0f ? max_w : min_w);
+    f32 max_ndc_y = max_clip_y / (max_clip_y >= 0.0f ? min_w : max_w);
+
+    i32 min_x = clamp_i32((i32)floorf((min_ndc_x * 0.5f + 0.5f) * buffer->width), 0, buffer->width - 1);
+    i32 max_x = clamp_i32((i32)floorf((max_ndc_x * 0.5f + 0.5f) * buffer->width), 0, buffer->width - 1);
+    i32 min_y = clamp_i32((i32)floorf((min_ndc_y * 0.5f + 0.5f) * buffer->height), 0, buffer->height - 1);
+    i32 max_y = clamp_i32((i32)floorf((max_ndc_y * 0.5f + 0.5f) * buffer->height), 0, buffer->height - 1);
+
+    f32 nearest = 1.0f / min_w;
+
+    for_range(tile_y, min_y / OCCLUSION_TILE_HEIGHT, max_y / OCCLUSION_TILE_HEIGHT + 1) {
+      for_range(tile_x, min_x / OCCLUSION_TILE_WIDTH, max_x / OCCLUSION_TILE_WIDTH + 1) {
+        u32 tile_index = tile_y * buffer->tile_count_x + tile_x;
+
+        // Every pixel of the tile is in front of the sphere
+        if(nearest < buffer->tile_depth[tile_index]) {
+          continue;
+        }
+
+        // Otherwise only the pixels the sphere covers matter
+        f32* depth = &buffer->depth[tile_index * OCCLUSION_TILE_SIZE];
+
+        i32 row_start = clamp_i32(min_y - (i32)(tile_y * OCCLUSION_TILE_HEIGHT), 0, OCCLUSION_TILE_HEIGHT - 1);
+        i32 row_end = clamp_i32(max_y - (i32)(tile_y * OCCLUSION_TILE_HEIGHT), 0, OCCLUSION_TILE_HEIGHT - 1);
+        i32 column_start = clamp_i32(min_x - (i32)(tile_x * OCCLUSION_TILE_WIDTH), 0, OCCLUSION_TILE_WIDTH - 1);
+        i32 column_end = clamp_i32(max_x - (i32)(tile_x * OCCLUSION_TILE_WIDTH), 0, OCCLUSION_TILE_WIDTH - 1);
+
+        for(i32 row = row_start; row <= row_end; row += 1) {
+          for(i32 column = column_start; column <= column_end; column += 1) {
+            if(nearest >= depth[row * OCCLUSION_TILE_WIDTH + column]) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+
+    return true;
+  }
+}
@@ -18,7 +18,16 @@ namespace quark {
 // Variables
 //
 
-  u32 ECS_MAX_STORAGE = (16 * 1024);
+  u32 ECS_MAX_STORAGE = (4 * 1024 * 1024);
+  bool ECS_PREFER_LOW_INDICES = false;
+  bool ECS_USE_HUGE_PAGES = true;
+
+  // Tables are reserved for ECS_MAX_STORAGE entities up front and committed as entities touch them.
+  // Bitsets and generations grow for every table at once in steps of ECS_COMMIT_ENTITY_COUNT,
+  // component data grows per table in steps of ECS_COMMIT_SIZE bytes, or HUGE_PAGE_SIZE with huge pages.
+  // Bitsets stay on regular pages, a whole bitset is 512KB at the default ECS_MAX_STORAGE so it could never fill a 2MB page
+  static constexpr u32 ECS_COMMIT_ENTITY_COUNT = 64 * 1024;
+  static constexpr u64 ECS_COMMIT_SIZE = 64 * KB;
 
 //
 // Functions
@@ -26,8 +35,24 @@ namespace quark {
 
   // constexpr usize ECS_MAX_COMPONENT_COUNT = 4096;
 
+  static u64 get_bitset_size(u32 entity_count) {
+    return entity_count / 8;
+  }
+
+  static u64 get_summary_size(u32 entity_count) {
+    return get_bitset_size(entity_count) / 64;
+  }
+
+  static u64 get_table_commit_step() {
+    return ECS_USE_HUGE_PAGES ? HUGE_PAGE_SIZE : ECS_COMMIT_SIZE;
+  }
+
   void init_ecs() {
-    ecs->entity_capacity = 128 * KB;
+    // round up so commits never run past the end of a reservation
+    ECS_MAX_STORAGE = ((ECS_MAX_STORAGE + ECS_COMMIT_ENTITY_COUNT - 1) / ECS_COMMIT_ENTITY_COUNT) * ECS_COMMIT_ENTITY_COUNT;
+
+    ecs->entity_capacity = ECS_MAX_STORAGE;
+    ecs->entity_commit_count = 0;
     u64 size = 64 * KB;
   
     ecs->component_datas = (void**)os_reserve_mem(size);
@@ -35,14 +60,31 @@ namespace quark {
   
     ecs->component_bitsets = (u64**)os_reserve_mem(size);
     os_commit_mem((u8*)ecs->component_bitsets, size);
+
+    ecs->component_summaries = (u64**)os_reserve_mem(size);
+    os_commit_mem((u8*)ecs->component_summaries, size);
+
+    ecs->used_summary = (u64*)malloc(get_summary_size(ECS_MAX_STORAGE));
+    zero_mem(ecs->used_summary, get_summary_size(ECS_MAX_STORAGE));
   
     ecs->component_sizes_in_bytes = (u64*)os_reserve_mem(size);
     os_commit_mem((u8*)ecs->component_sizes_in_bytes, size);
+
+    ecs->component_commit_sizes = (u64*)os_reserve_mem(size);
+    os_commit_mem((u8*)ecs->component_commit_sizes, size);
+
+    ecs->component_page_kinds = (PageKind*)os_reserve_mem(size);
+    os_commit_mem((u8*)ecs->component_page_kinds, size);
   
     ecs->entity_generations = (u32*)os_reserve_mem(ECS_MAX_STORAGE * sizeof(u32));
-    os_commit_mem((u8*)ecs->entity_generations, ECS_MAX_STORAGE * sizeof(u32));
+    ecs->free_entities = (u32*)os_reserve_mem(ECS_MAX_STORAGE * sizeof(u32));
+    ecs->free_entity_count = 0;
+    ecs->next_fresh_entity = 0;
   
     ecs->component_table_capacity = size / sizeof(void*);
+
+    zero_mem(ecs->component_sizes_in_bytes, size);
+    zero_mem(ecs->component_commit_sizes, size);
   
     ecs->active_flag_id = add_ecs_table(0);
     ecs->empty_flag_id = add_ecs_table(0);
@@ -50,9 +92,9 @@ namespace quark {
     // ecs->ecs_destroyed_flag = add_ecs_table(0);
     // ecs->ecs_updated_flag = add_ecs_table(0);
 
-    zero_mem(ecs->component_sizes_in_bytes, size);
-    zero_mem(ecs->entity_generations, ECS_MAX_STORAGE * sizeof(u32));
-    memset(ecs->component_bitsets[ecs->empty_flag_id], 0xffffffff, 256 * KB);
+    // the empty flag starts out set for everything, commit_ecs_entities() keeps it that way as it grows
+    memset(ecs->component_summaries[ecs->empty_flag_id], 0xffffffff, get_summary_size(ECS_MAX_STORAGE));
+    commit_ecs_entities(ECS_COMMIT_ENTITY_COUNT);
   
     // init builtin component types
 
@@ -68,48 +110,220 @@ namespace quark {
     u32 i = ecs->component_table_count;
     ecs->component_table_count += 1;
 
-    // if(ecs_table_count) // reserve ptrs for more tables
+    if(ecs->component_table_count > ecs->component_table_capacity) {
+      panic("Ran out of ecs component tables!\n");
+    }
 
     if(component_size != 0) {
-      u32 comp_count = ECS_MAX_STORAGE;
-      u32 memsize = comp_count * component_size;
-      memsize = (memsize / (64 * KB)) + 1;
-      memsize *= 64 * KB;
+      u64 memsize = (u64)ECS_MAX_STORAGE * component_size;
+      memsize = ((memsize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
 
-      #ifdef DEBUG
-      log_message("1 mil memsize eq: " + memsize);
-      #endif
+      // only address space for now, commit_ecs_table() backs it as components get added.
+      // Tracked so snapshot deltas can find the written pages without diffing
+      ecs->component_datas[i] = (void*)os_reserve_mem_tracked(memsize);
+    }
 
-      ecs->component_datas[i] = malloc(memsize); // (void*)os_reserve_mem(memsize);
-      // os_commit_mem((u8*)ecs->ecs_comp_table[i], memsize);
-      zero_mem(ecs->component_datas[i], memsize);
+    ecs->component_bitsets[i] = (u64*)os_reserve_mem_tracked(get_bitset_size(ECS_MAX_STORAGE));
+    if(ecs->entity_commit_count != 0) {
+      os_commit_mem((u8*)ecs->component_bitsets[i], get_bitset_size(ecs->entity_commit_count));
     }
 
-    // use the global_arena???
-    u32 bt_size = 256 * KB;
-    ecs->component_bitsets[i] = (u64*)malloc(bt_size); // os_reserve_mem(bt_size);
-    // os_commit_mem((u8*)ecs->ecs_bool_table[i], bt_size);
-    zero_mem(ecs->component_bitsets[i], bt_size);
+    ecs->component_summaries[i] = (u64*)malloc(get_summary_size(ECS_MAX_STORAGE));
+    zero_mem(ecs->component_summaries[i], get_summary_size(ECS_MAX_STORAGE));
 
     ecs->component_sizes_in_bytes[i] = component_size;
+    ecs->component_commit_sizes[i] = 0;
+    ecs->component_page_kinds[i] = PageKind::Small;
     return i;
   }
 
-  EntityId create_entity(bool set_active) {
-    u32 entity_index = ecs->first_empty_entity;
-    unset_bitset_bit(ecs->component_bitsets[ecs->empty_flag_id], entity_index);
+  void commit_ecs_entities(u32 entity_count) {
+    if(entity_count <= ecs->entity_commit_count) {
+      return;
+    }
+
+    if(entity_count > ECS_MAX_STORAGE) {
+      panic("Ran out of ecs storage!\n");
+    }
+
+    u32 old_count = ecs->entity_commit_count;
+    u32 new_count = ((entity_count + ECS_COMMIT_ENTITY_COUNT - 1) / ECS_COMMIT_ENTITY_COUNT) * ECS_COMMIT_ENTITY_COUNT;
+
+    u64 bitset_offset = get_bitset_size(old_count);
+    u64 bitset_size = get_bitset_size(new_count) - bitset_offset;
+
+    // freshly committed pages are zeroed by the os
+    for_every(i, ecs->component_table_count) {
+      os_commit_mem((u8*)ecs->component_bitsets[i] + bitset_offset, bitset_size);
+    }
+
+    memset((u8*)ecs->component_bitsets[ecs->empty_flag_id] + bitset_offset, 0xffffffff, bitset_size);
+
+    os_commit_mem((u8*)(ecs->entity_generations + old_count), (new_count - old_count) * sizeof(u32));
+    os_commit_mem((u8*)(ecs->free_entities + old_count), (new_count - old_count) * sizeof(u32));
+
+    ecs->entity_commit_count = new_count;
+  }
+
+  // The committed range is always [0, commit size) since snapshots and the iterators treat it as one block,
+  // so a single entity with a high index backs every page of the table below it
+  void commit_ecs_table(u32 component_id, u32 entity_count) {
+    u64 step = get_table_commit_step();
+    u64 commit_size = ((u64)entity_count * ecs->component_sizes_in_bytes[component_id] + step - 1) / step;
+    commit_size *= step;
+
+    u64 old_size = ecs->component_commit_sizes[component_id];
+    if(commit_size <= old_size) {
+      return;
+    }
+
+    if(entity_count > ECS_MAX_STORAGE) {
+      panic("Ran out of ecs storage!\n");
+    }
+
+    u8* ptr = (u8*)ecs->component_datas[component_id] + old_size;
+
+    // 64KB steps from before ECS_USE_HUGE_PAGES was set leave old_size unaligned, so those commits stay regular
+    if(!ECS_USE_HUGE_PAGES || old_size % HUGE_PAGE_SIZE != 0) {
+      os_commit_mem(ptr, commit_size - old_size);
+      ecs->component_page_kinds[component_id] = PageKind::Small;
+    } else {
+      // A table is only reported as huge as its worst backed range
+      PageKind kind = os_commit_mem_huge_tracked(ptr, commit_size - old_size);
+      if(old_size == 0 || (u32)kind < (u32)ecs->component_page_kinds[component_id]) {
+        ecs->component_page_kinds[component_id] = kind;
+      }
+    }
+
+    ecs->component_commit_sizes[component_id] = commit_size;
+  }
+
+  void log_ecs_table_info() {
+    // Plain printf to match log_arena_pool_info()
+    for_every(i, ecs->component_table_count) {
+      if(ecs->component_commit_sizes[i] == 0) { continue; }
+
+      printf("[MESSAGE] Ecs table %d: %lluKB committed, backed by %s pages\n", (i32)i, (unsigned long long)(ecs->component_commit_sizes[i] / KB), get_page_kind_name(ecs->component_page_kinds[i]));
+    }
+  }
+
+  void update_ecs_summaries() {
+    u64 word_count = ecs->entity_commit_count / 64;
+
+    for_every(i, ecs->component_table_count) {
+      u64* bitset = ecs->component_bitsets[i];
+      u64* summary = ecs->component_summaries[i];
+      zero_mem(summary, get_summary_size(ECS_MAX_STORAGE));
+
+      for_every(j, word_count) {
+        if(bitset[j] != 0) {
+          set_bitset_bit(summary, j);
+        }
+      }
+    }
+
+    // everything past the committed range is empty
+    u64* empty_summary = ecs->component_summaries[ecs->empty_flag_id];
+    for(u64 j = word_count; j < ECS_MAX_STORAGE / 64; j += 1) {
+      set_bitset_bit(empty_summary, j);
+    }
+
+    u64* empty_bitset = ecs->component_bitsets[ecs->empty_flag_id];
+    zero_mem(ecs->used_summary, get_summary_size(ECS_MAX_STORAGE));
+    for_every(j, word_count) {
+      if(~empty_bitset[j] != 0) {
+        set_bitset_bit(ecs->used_summary, j);
+      }
+    }
+  }
+
+  void update_ecs_free_entities() {
+    u64* empty_bitset = ecs->component_bitsets[ecs->empty_flag_id];
+
+    // everything past the last used word has never been handed out
+    ecs->next_fresh_entity = (ecs->last_entity + 1) * 64;
+    ecs->next_fresh_entity = ecs->next_fresh_entity > ECS_MAX_STORAGE ? ECS_MAX_STORAGE : ecs->next_fresh_entity;
+    commit_ecs_entities(ecs->next_fresh_entity);
+
+    // push in reverse so the lowest indices get popped first
+    ecs->free_entity_count = 0;
+    for(u32 i = ecs->next_fresh_entity; i > 0; i -= 1) {
+      if(is_bitset_bit_set(empty_bitset, i - 1)) {
+        ecs->free_entities[ecs->free_entity_count] = i - 1;
+        ecs->free_entity_count += 1;
+      }
+    }
+
+    ecs->first_empty_entity = ecs->free_entity_count != 0 ? ecs->free_entities[ecs->free_entity_count - 1] : ecs->next_fresh_entity;
+  }
+
+  // Lowest empty index at or after first_empty_entity.
+  // The empty table summary lets us skip 4096 entities per word, so this stays cheap
+  // as long as first_empty_entity is kept as a lower bound.
+  static u32 find_first_empty_entity() {
+    u64* empty_bitset = ecs->component_bitsets[ecs->empty_flag_id];
+    u64* empty_summary = ecs->component_summaries[ecs->empty_flag_id];
+
+    u64 summary_word_count = ECS_MAX_STORAGE / (64 * 64);
+    for(u64 s = ecs->first_empty_entity / (64 * 64); s < summary_word_count; s += 1) {
+      if(empty_summary[s] == 0) {
+        continue;
+      }
+
+      u64 word_index = (s * 64) + __builtin_ctzll(empty_summary[s]);
+      commit_ecs_entities((word_index + 1) * 64);
+
+      return (word_index * 64) + __builtin_ctzll(empty_bitset[word_index]);
+    }
+
+    panic("Ran out of ecs storage!\n");
+    return 0;
+  }
 
-    // forward scan for new head
-    u32 head = ecs->first_empty_entity / 64;
-    while(ecs->component_bitsets[ecs->empty_flag_id][head] == 0 && head < (ECS_MAX_STORAGE / 64)) {
-      head += 1;
+  static u32 pop_empty_entity() {
+    if(ECS_PREFER_LOW_INDICES) {
+      return find_first_empty_entity();
     }
 
-    if(head == (ECS_MAX_STORAGE / 32)) {
+    // reuse the most recently freed index
+    if(ecs->free_entity_count != 0) {
+      ecs->free_entity_count -= 1;
+      return ecs->free_entities[ecs->free_entity_count];
+    }
+
+    if(ecs->next_fresh_entity >= ECS_MAX_STORAGE) {
       panic("Ran out of ecs storage!\n");
     }
 
-    ecs->first_empty_entity = (head * 64) + __builtin_ctzll(ecs->component_bitsets[ecs->empty_flag_id][head]);
+    u32 entity_index = ecs->next_fresh_entity;
+    ecs->next_fresh_entity += 1;
+
+    return entity_index;
+  }
+
+  EntityId create_entity(bool set_active) {
+    #ifdef DEBUG
+      check_system_access(SystemAccessType::Resource, (u64)ecs, false);
+    #endif
+
+    u32 entity_index = pop_empty_entity();
+    commit_ecs_entities(entity_index + 1);
+
+    u64* empty_bitset = ecs->component_bitsets[ecs->empty_flag_id];
+    unset_bitset_bit(empty_bitset, entity_index);
+    if(empty_bitset[entity_index / 64] == 0) {
+      unset_bitset_bit(ecs->component_summaries[ecs->empty_flag_id], entity_index / 64);
+    }
+    set_bitset_bit(ecs->used_summary, entity_index / 64);
+
+    // nothing below this was empty, so the next search can start here
+    if(ECS_PREFER_LOW_INDICES) {
+      ecs->first_empty_entity = entity_index;
+    }
+
+    if(entity_index >= ecs->next_fresh_entity) {
+      ecs->next_fresh_entity = entity_index + 1;
+    }
 
     // move tail right if we have gone further right
     if((entity_index / 64) > ecs->last_entity) {
@@ -127,20 +341,97 @@ namespace quark {
     return entity;
   }
 
+  u32 reserve_entities(u32 count, bool set_active) {
+    #ifdef DEBUG
+      check_system_access(SystemAccessType::Resource, (u64)ecs, false);
+    #endif
+
+    // Slots past next_fresh_entity have never been used so they are known to be empty and consecutive,
+    // this lets us flip whole bitset words at a time instead of going entity by entity
+    u32 first_index = ecs->next_fresh_entity;
+    if(count == 0) {
+      return first_index;
+    }
+
+    if((u64)first_index + count > ECS_MAX_STORAGE) {
+      panic("Ran out of ecs storage!\n");
+    }
+
+    commit_ecs_entities(first_index + count);
+
+    u64* empty_bitset = ecs->component_bitsets[ecs->empty_flag_id];
+    unset_bitset_range(empty_bitset, first_index, count);
+
+    u64 first_word = first_index / 64;
+    u64 last_word = (first_index + count - 1) / 64;
+    for(u64 i = first_word; i <= last_word; i += 1) {
+      if(empty_bitset[i] == 0) {
+        unset_bitset_bit(ecs->component_summaries[ecs->empty_flag_id], i);
+      }
+      set_bitset_bit(ecs->used_summary, i);
+    }
+
+    if(set_active) {
+      add_flag_range_unchecked(first_index, count, ECS_ACTIVE_FLAG);
+    }
+
+    ecs->next_fresh_entity = first_index + count;
+
+    if(last_word > ecs->last_entity) {
+      ecs->last_entity = last_word;
+    }
+
+    // in low index mode first_empty_entity may be pointing into the range we just took
+    if(ECS_PREFER_LOW_INDICES && ecs->first_empty_entity >= first_index && ecs->first_empty_entity < first_index + count) {
+      ecs->first_empty_entity = first_index + count;
+    }
+
+    return first_index;
+  }
+
+  // Highest word with a live entity in it, or 0 if there are none.
+  // Walks used_summary backwards from the old tail so this skips 4096 entities per step
+  static u32 find_last_used_word() {
+    for(u64 s = (ecs->last_entity / 64) + 1; s > 0; s -= 1) {
+      u64 summary = ecs->used_summary[s - 1];
+      if(summary != 0) {
+        return ((s - 1) * 64) + (63 - __builtin_clzll(summary));
+      }
+    }
+
+    return 0;
+  }
+
   void destroy_entity(EntityId entity) {
     if(!is_valid_entity(entity)) {
       panic("In destroy_entity(), an EntityId was out of date!\n");
     }
 
-    set_bitset_bit(ecs->component_bitsets[ecs->empty_flag_id], entity.index);
+    #ifdef DEBUG
+      check_system_access(SystemAccessType::Resource, (u64)ecs, false);
+    #endif
+
+    u64* empty_bitset = ecs->component_bitsets[ecs->empty_flag_id];
+    set_bitset_bit(empty_bitset, entity.index);
+    set_bitset_bit(ecs->component_summaries[ecs->empty_flag_id], entity.index / 64);
+
+    // the tail only moves when its word went fully empty
+    u32 word_index = entity.index / 64;
+    if(~empty_bitset[word_index] == 0) {
+      unset_bitset_bit(ecs->used_summary, word_index);
 
-    // scan for new tail
-    while(~ecs->component_bitsets[ecs->empty_flag_id][ecs->last_entity] == 0 && ecs->last_entity != 0) {
-      ecs->last_entity -= 1;
+      if(word_index == ecs->last_entity) {
+        ecs->last_entity = find_last_used_word();
+      }
     }
 
-    if(entity.index < ecs->first_empty_entity) {
-      ecs->first_empty_entity = entity.index;
+    if(ECS_PREFER_LOW_INDICES) {
+      if(entity.index < ecs->first_empty_entity) {
+        ecs->first_empty_entity = entity.index;
+      }
+    } else {
+      ecs->free_entities[ecs->free_entity_count] = entity.index;
+      ecs->free_entity_count += 1;
     }
 
     ecs->entity_generations[entity.index] += 1;
@@ -31,7 +31,11 @@ namespace quark {
       VmaAllocationCreateInfo alloc_info = get_buffer_alloc_info(info->type);
 
       Buffer buffer = {};
-      vk_check(vmaCreateBuffer(graphics->gpu_alloc, &buffer_info, &alloc_info, &buffer.buffer, &buffer.allocation, 0));
+      if(HEADLESS) {
+        buffer.headless_data = arena_push(global_arena(), info->size);
+      } else {
+        vk_check(vmaCreateBuffer(graphics->gpu_alloc, &buffer_info, &alloc_info, &buffer.buffer, &buffer.allocation, 0));
+      }
 
       buffer.type = info->type;
       buffer.size = info->size;
@@ -41,12 +45,20 @@ namespace quark {
   }
 
   void* map_buffer(Buffer* buffer) {
+    if(HEADLESS) {
+      return buffer->headless_data;
+    }
+
     void* ptr;
     vmaMapMemory(graphics->gpu_alloc, buffer->allocation, &ptr);
     return ptr;
   }
 
   void unmap_buffer(Buffer* buffer) {
+    if(HEADLESS) {
+      return;
+    }
+
     vmaUnmapMemory(graphics->gpu_alloc, buffer->allocation);
   }
 
@@ -57,6 +69,12 @@ namespace quark {
   }
 
   void copy_buffer(VkCommandBuffer commands, Buffer* dst, u32 dst_offset_bytes, Buffer* src, u32 src_offset_bytes, u32 size) {
+    // Nothing to record into, so just do the copy now
+    if(HEADLESS) {
+      memcpy(dst->headless_data + dst_offset_bytes, src->headless_data + src_offset_bytes, size);
+      return;
+    }
+
     VkBufferCopy copy_region = {};
     copy_region.srcOffset = src_offset_bytes;
     copy_region.dstOffset = dst_offset_bytes;
@@ -140,13 +158,16 @@ namespace quark {
 
   void create_images(Image* images, u32 n, ImageInfo* info) {
     for_every(i, n) {
-      VkImageCreateInfo image_info = get_image_info(info);
-      VmaAllocationCreateInfo alloc_info = get_image_alloc_info();
+      // Headless images are only their metadata
+      if(!HEADLESS) {
+        VkImageCreateInfo image_info = get_image_info(info);
+        VmaAllocationCreateInfo alloc_info = get_image_alloc_info();
 
-      vk_check(vmaCreateImage(graphics->gpu_alloc, &image_info, &alloc_info, &images[i].image, &images[i].allocation, 0));
+        vk_check(vmaCreateImage(graphics->gpu_alloc, &image_info, &alloc_info, &images[i].image, &images[i].allocation, 0));
 
-      VkImageViewCreateInfo view_info = get_image_view_info(info, images[i].image);
-      vk_check(vkCreateImageView(graphics->device, &view_info, 0, &images[i].view));
+        VkImageViewCreateInfo view_info = get_image_view_info(info, images[i].image);
+        vk_check(vkCreateImageView(graphics->device, &view_info, 0, &images[i].view));
+      }
 
       images[i].current_usage = ImageUsage::Unknown; // current_layout = VK_IMAGE_LAYOUT_UNDEFINED;
       images[i].resolution = info->resolution;
@@ -162,6 +183,11 @@ namespace quark {
        return;
     }
 
+    if(HEADLESS) {
+      image->current_usage = new_usage;
+      return;
+    }
+
     // Info: i'm using the fact that VkImageLayout is 0 - 7 for the flags that i want to use,
     // so i can just use it as an index into a lookup table.
     // I have to do some *slight* translation for VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, since it
@@ -367,6 +393,10 @@ namespace quark {
     transition_image(commands, dst, ImageUsage::Dst);
     transition_image(commands, src, ImageUsage::Src);
 
+    if(HEADLESS) {
+      return;
+    }
+
     // Info: create blit info and blit
     BlitInfo src_blit_info = get_blit_info(src);
     BlitInfo dst_blit_info = get_blit_info(dst);
@@ -395,6 +425,10 @@ namespace quark {
     transition_image(commands, dst, ImageUsage::Dst);
     transition_image(commands, src, ImageUsage::Src);
 
+    if(HEADLESS) {
+      return;
+    }
+
     // Info: create resolve info and resolve
     VkImageResolve img_resolve = {};
     img_resolve.extent.width = dst->resolution.x;
@@ -425,6 +459,10 @@ namespace quark {
   void copy_buffer_to_image(VkCommandBuffer commands, Image* dst, Buffer* src) {
     transition_image(commands, dst, ImageUsage::Dst);
 
+    if(HEADLESS) {
+      return;
+    }
+
     VkBufferImageCopy copy_region = {};
     copy_region.bufferOffset = 0;
     copy_region.bufferRowLength = 0;
@@ -462,6 +500,10 @@ namespace quark {
 //
 
   void create_framebuffers(VkFramebuffer* framebuffers, u32 n, FramebufferInfo* info) {
+    if(HEADLESS) {
+      return;
+    }
+
     for_every(i, n) {
       VkFramebufferCreateInfo framebuffer_info = {};
       framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -511,15 +553,17 @@ namespace quark {
   }
 
   void begin_render_pass(VkCommandBuffer commands, u32 image_index, RenderPass* render_pass, ClearValue* clear_values) {
-    VkRenderPassBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    begin_info.renderPass = render_pass->render_pass;
-    begin_info.renderArea = get_scissor(render_pass->resolution);
-    begin_info.framebuffer = render_pass->framebuffers[image_index];
-    begin_info.clearValueCount = render_pass->attachment_count;
-    begin_info.pClearValues = (VkClearValue*)clear_values;
-
-    vkCmdBeginRenderPass(commands, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    if(!HEADLESS) {
+      VkRenderPassBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      begin_info.renderPass = render_pass->render_pass;
+      begin_info.renderArea = get_scissor(render_pass->resolution);
+      begin_info.framebuffer = render_pass->framebuffers[image_index];
+      begin_info.clearValueCount = render_pass->attachment_count;
+      begin_info.pClearValues = (VkClearValue*)clear_values;
+
+      vkCmdBeginRenderPass(commands, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    }
 
     for_every(i, render_pass->attachment_count) {
       render_pass->attachments[i][image_index].current_usage = render_pass->initial_usage[i];
@@ -527,7 +571,9 @@ namespace quark {
   }
 
   void end_render_pass(VkCommandBuffer commands, u32 image_index, RenderPass* render_pass) {
-    vkCmdEndRenderPass(commands);
+    if(!HEADLESS) {
+      vkCmdEndRenderPass(commands);
+    }
 
     for_every(i, render_pass->attachment_count) {
       render_pass->attachments[i][image_index].current_usage = render_pass->final_usage[i];
@@ -535,6 +581,10 @@ namespace quark {
   }
 
   void create_vk_render_pass(VkRenderPass* render_pass, RenderPassInfo* info) {
+    if(HEADLESS) {
+      return;
+    }
+
     VkAttachmentDescription attachment_descs[info->attachment_count];
     zero_array(attachment_descs, VkAttachmentDescription, info->attachment_count);
 
@@ -600,6 +650,10 @@ namespace quark {
 //
 
   void create_samplers(Sampler* sampler, u32 n, SamplerInfo* info) {
+    if(HEADLESS) {
+      return;
+    }
+
     VkSamplerCreateInfo sampler_info = {};
     sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     sampler_info.magFilter = (VkFilter)info->filter_mode;
@@ -648,10 +702,18 @@ namespace quark {
   }
 
   void bind_resource_group(VkCommandBuffer commands, VkPipelineLayout layout, ResourceGroup* group, u32 frame_index, u32 bind_index) {
+    if(HEADLESS) {
+      return;
+    }
+
     vkCmdBindDescriptorSets(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, bind_index, 1, &group->sets[frame_index], 0, 0);
   }
 
   void create_descriptor_layout(VkDescriptorSetLayout* layout, ResourceBinding* bindings, u32 n) {
+    if(HEADLESS) {
+      return;
+    }
+
     VkDescriptorSetLayoutBinding layout_bindings[n];
     zero_array(layout_bindings, VkDescriptorSetLayoutBinding, n);
 
@@ -683,6 +745,10 @@ namespace quark {
   }
 
   void allocate_descriptor_sets(VkDescriptorSet* sets, VkDescriptorSetLayout layout) {
+    if(HEADLESS) {
+      return;
+    }
+
     VkDescriptorSetLayout layouts[_FRAME_OVERLAP] = {
       layout,
       layout,
@@ -698,6 +764,10 @@ namespace quark {
   }
 
   void update_descriptor_sets(VkDescriptorSet* sets, ResourceBinding* bindings, u32 n) {
+    if(HEADLESS) {
+      return;
+    }
+
     TempStack scratch = begin_scratch(0, 0);
     defer(end_scratch(scratch));
 
@@ -822,6 +892,10 @@ namespace quark {
   }
 
   VkCommandBuffer begin_quick_commands() {
+    if(HEADLESS) {
+      return 0;
+    }
+
     VkCommandBufferAllocateInfo allocate_info = {};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -842,6 +916,10 @@ namespace quark {
   }
   
   void end_quick_commands(VkCommandBuffer command_buffer) {
+    if(HEADLESS) {
+      return;
+    }
+
     vkEndCommandBuffer(command_buffer);
   
     VkSubmitInfo submit_info = {};
@@ -856,6 +934,10 @@ namespace quark {
   }
 
   VkCommandBuffer begin_quick_commands2() {
+    if(HEADLESS) {
+      return 0;
+    }
+
     VkCommandBufferAllocateInfo allocate_info = {};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -876,6 +958,10 @@ namespace quark {
   }
 
   void end_quick_commands2(VkCommandBuffer command_buffer) {
+    if(HEADLESS) {
+      return;
+    }
+
     vkEndCommandBuffer(command_buffer);
   
     VkSubmitInfo submit_info = {};
@@ -903,6 +989,12 @@ namespace quark {
     {
     }
 
+    // Everything gpu side turns into host memory and no-ops, so the cpu half of the frame can run anywhere
+    if(HEADLESS) {
+      graphics->render_resolution = get_window_dimensions();
+      return;
+    }
+
     init_vulkan();
     init_command_pools_and_buffers();
     init_swapchain();
@@ -1103,6 +1195,10 @@ namespace quark {
   }
 
   void begin_frame() {
+    if(HEADLESS) {
+      return;
+    }
+
     // Check for window resizes
 
     static ivec2 prev_dim = get_window_dimensions();
@@ -1145,6 +1241,12 @@ namespace quark {
   }
 
   void end_frame() {
+    if(HEADLESS) {
+      graphics->frame_count += 1;
+      graphics->frame_index = graphics->frame_count % _FRAME_OVERLAP;
+      return;
+    }
+
     vk_check(vkEndCommandBuffer(graphics->commands[graphics->frame_index]));
 
     VkPipelineStageFlags wait_stage_flags = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
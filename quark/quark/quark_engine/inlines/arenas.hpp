@@ -9,11 +9,11 @@ namespace quark {
 #endif
 
 inline Arena* global_arena() {
-  return get_resource(Arenas)->global_arena;
+  return get_resource_unchecked(Arenas)->global_arena;
 }
 
 inline Arena* frame_arena() {
-  return get_resource(Arenas)->frame_arena;
+  return get_resource_unchecked(Arenas)->frame_arena;
 }
 
 #ifndef QUARK_ENGINE_INLINES
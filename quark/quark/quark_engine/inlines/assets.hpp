@@ -31,8 +31,8 @@ namespace quark {
 
   template <typename T>
   void add_asset(const char* name, T data) {
-    static auto* data_map = create_cached_type_map<T>(&get_resource(AssetServer)->data, std::unordered_map<u32, T>());
-    static auto* name_map = create_cached_type_map<T>(&get_resource(AssetServer)->hash_to_name, std::unordered_map<u32, char*>());
+    static auto* data_map = create_cached_type_map<T>(&get_resource_unchecked(AssetServer)->data, std::unordered_map<u32, T>());
+    static auto* name_map = create_cached_type_map<T>(&get_resource_unchecked(AssetServer)->hash_to_name, std::unordered_map<u32, char*>());
 
     data_map->insert(std::make_pair(hash_str_fast(name), data));
 
@@ -50,7 +50,7 @@ namespace quark {
 
   template <typename T>
   T* get_asset(const char* name) {
-    static auto* map = create_cached_type_map<T>(&get_resource(AssetServer)->data, std::unordered_map<u32, T>());
+    static auto* map = create_cached_type_map<T>(&get_resource_unchecked(AssetServer)->data, std::unordered_map<u32, T>());
     if(map->count(hash_str_fast(name)) == 0) {
       panic("Failed to find asset: " + name);
     }
@@ -59,7 +59,7 @@ namespace quark {
 
   template <typename T>
   T* get_asset_by_hash(u32 hash) {
-    static auto* map = create_cached_type_map<T>(&get_resource(AssetServer)->data, std::unordered_map<u32, T>());
+    static auto* map = create_cached_type_map<T>(&get_resource_unchecked(AssetServer)->data, std::unordered_map<u32, T>());
     if(map->count(hash) == 0) {
       panic("Failed to find asset: " + hash);
     }
@@ -68,7 +68,7 @@ namespace quark {
 
   template <typename T>
   void get_all_asset_hashes(u32** out_hashes, u32* out_length, Arena* arena) {
-    static auto* map = create_cached_type_map<T>(&get_resource(AssetServer)->hash_to_name, std::unordered_map<u32, char*>());
+    static auto* map = create_cached_type_map<T>(&get_resource_unchecked(AssetServer)->hash_to_name, std::unordered_map<u32, char*>());
 
     // alloc into arena
     *out_length = map->size();
@@ -85,7 +85,7 @@ namespace quark {
 
   template <typename T>
   char* get_asset_name(u32 hash) {
-    static auto* map = create_cached_type_map<T>(&get_resource(AssetServer)->hash_to_name, std::unordered_map<u32, char*>());
+    static auto* map = create_cached_type_map<T>(&get_resource_unchecked(AssetServer)->hash_to_name, std::unordered_map<u32, char*>());
 
     if(map->count(hash) == 0) {
       panic("Failed to find asset: " + hash);
@@ -56,6 +56,12 @@ namespace quark {
     frustum.planes[4] = view_projection_t[3] + view_projection_t[2];
     frustum.planes[5] = view_projection_t[3] - view_projection_t[2];
 
+    // Normalize so plane_point_distance() is an actual distance and can be compared against a radius
+    for_every(i, 6) {
+      vec4 plane = frustum.planes[i];
+      frustum.planes[i] = plane / length(vec3 { plane.x, plane.y, plane.z });
+    }
+
     return frustum;
   }
 
@@ -63,20 +69,36 @@ namespace quark {
     return dot(as_vec4(point, 1.0), plane);
   }
 
-  bool is_sphere_visible(FrustumPlanes* frustum, vec3 position, float radius2) {
+  bool is_sphere_visible(FrustumPlanes* frustum, vec3 position, float radius) {
     f32 dist01 = min(plane_point_distance(frustum->planes[0], position), plane_point_distance(frustum->planes[1], position));
     f32 dist23 = min(plane_point_distance(frustum->planes[2], position), plane_point_distance(frustum->planes[3], position));
     f32 dist45 = min(plane_point_distance(frustum->planes[4], position), plane_point_distance(frustum->planes[5], position));
 
     f32 dist = min(min(dist01, dist23), dist45);
-    // f32 dist2 = dist * dist;
-    // if(dist < 0.0f) {
-    //   dist2 = -dist2;
-    // }
-   
-    return (dist + radius2) > 0.0f;
+
+    return (dist + radius) > 0.0f;
   }
 
+#ifdef __AVX2__
+  // Test 8 spheres against the 6 planes of a frustum, same as is_sphere_visible() per lane
+  inline u32 are_spheres_visible_8(FrustumPlanes* frustum, __m256 x, __m256 y, __m256 z, __m256 radius) {
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 zero = _mm256_setzero_ps();
+
+    for_every(i, 6) {
+      vec4 plane = frustum->planes[i];
+
+      __m256 dist = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_set1_ps(plane.w));
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(y, _mm256_set1_ps(plane.y)));
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(z, _mm256_set1_ps(plane.z)));
+
+      visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_GT_OQ));
+    }
+
+    return (u32)_mm256_movemask_ps(visible);
+  }
+#endif
+
 #ifndef QUARK_ENGINE_INLINES
 };
 #endif
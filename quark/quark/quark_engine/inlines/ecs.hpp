@@ -45,6 +45,33 @@ namespace quark {
     return (bitset[x] & shift) > 0;
   }
 
+  // Get the mask for the bits of [first, first + count) that land in first's word,
+  // count is clamped to the end of the word
+  inline u64 get_bitset_word_mask(u64 first, u64* count) {
+    u64 y = first % 64;
+    *count = *count < (64 - y) ? *count : (64 - y);
+
+    return *count == 64 ? ~0ULL : (((1ULL << *count) - 1) << y);
+  }
+
+  inline void set_bitset_range(u64* bitset, u64 first, u64 count) {
+    u64 end = first + count;
+    while(first < end) {
+      u64 n = end - first;
+      bitset[first / 64] |= get_bitset_word_mask(first, &n);
+      first += n;
+    }
+  }
+
+  inline void unset_bitset_range(u64* bitset, u64 first, u64 count) {
+    u64 end = first + count;
+    while(first < end) {
+      u64 n = end - first;
+      bitset[first / 64] &= ~get_bitset_word_mask(first, &n);
+      first += n;
+    }
+  }
+
 // Ecs
 
   inline bool is_valid_entity(EntityId entity) {
@@ -77,7 +104,7 @@ namespace quark {
       panic("Entity id was invalid!\n");
     }
 
-    add_flag_checked(entity, component_id);
+    add_flag_unchecked(entity, component_id);
   }
 
   inline void remove_flag_checked(EntityId entity, u32 component_id) {
@@ -85,7 +112,7 @@ namespace quark {
       panic("Entity id was invalid!\n");
     }
 
-    remove_flag_checked(entity, component_id);
+    remove_flag_unchecked(entity, component_id);
   }
 
   inline void* get_component_checked(EntityId entity, u32 component_id) {
@@ -109,6 +136,11 @@ namespace quark {
   }
 
   inline void add_component_unchecked(EntityId entity, u32 component_id, void* data) {
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
+    if((u64)(entity.index + 1) * ecs->component_sizes_in_bytes[component_id] > ecs->component_commit_sizes[component_id]) {
+      commit_ecs_table(component_id, entity.index + 1);
+    }
+
     void* dst = get_component_ptr_raw(entity.index, component_id);
     u32 size = ecs_component_sizes()[component_id];
 
@@ -122,10 +154,54 @@ namespace quark {
 
   inline void add_flag_unchecked(EntityId entity, u32 component_id) {
     set_bitset_bit(ecs_bool_table()[component_id], entity.index);
+    set_bitset_bit(ecs_summary_table()[component_id], entity.index / 64);
   }
 
   inline void remove_flag_unchecked(EntityId entity, u32 component_id) {
-    unset_bitset_bit(ecs_bool_table()[component_id], entity.index);
+    u64* bitset = ecs_bool_table()[component_id];
+    unset_bitset_bit(bitset, entity.index);
+
+    // Only drop the summary bit once the whole word is empty
+    if(bitset[entity.index / 64] == 0) {
+      unset_bitset_bit(ecs_summary_table()[component_id], entity.index / 64);
+    }
+  }
+
+  inline void add_component_range_unchecked(u32 first_index, u32 count, u32 component_id, void* data) {
+    if(count == 0) {
+      return;
+    }
+
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
+    u64 size = ecs->component_sizes_in_bytes[component_id];
+    if((u64)(first_index + count) * size > ecs->component_commit_sizes[component_id]) {
+      commit_ecs_table(component_id, first_index + count);
+    }
+
+    // Broadcast by doubling the filled part, so it ends up as a handful of large copies
+    u8* dst = (u8*)get_component_ptr_raw(first_index, component_id);
+    copy_mem(dst, data, size);
+
+    u64 filled = 1;
+    while(filled < count) {
+      u64 n = filled < (count - filled) ? filled : (count - filled);
+      copy_mem(dst + filled * size, dst, n * size);
+      filled += n;
+    }
+
+    add_flag_range_unchecked(first_index, count, component_id);
+  }
+
+  inline void add_flag_range_unchecked(u32 first_index, u32 count, u32 component_id) {
+    if(count == 0) {
+      return;
+    }
+
+    u64 first_word = first_index / 64;
+    u64 last_word = (first_index + count - 1) / 64;
+
+    set_bitset_range(ecs_bool_table()[component_id], first_index, count);
+    set_bitset_range(ecs_summary_table()[component_id], first_word, last_word - first_word + 1);
   }
 
   inline void* get_component_unchecked(EntityId entity, u32 component_id) {
@@ -141,14 +217,33 @@ namespace quark {
       panic("Entity id was invalid!\n");
     }
 
+    #ifdef DEBUG
+      (check_system_access(SystemAccessType::Component, (u64)&decltype(components)::COMPONENT_ID, false), ...);
+    #endif
+
     (add_component_unchecked(entity, decltype(components)::COMPONENT_ID, &components), ...);
   }
 
+  template <typename... T> u32 create_entities(u32 count, T... components) {
+    #ifdef DEBUG
+      (check_system_access(SystemAccessType::Component, (u64)&decltype(components)::COMPONENT_ID, false), ...);
+    #endif
+
+    u32 first_index = reserve_entities(count, true);
+    (add_component_range_unchecked(first_index, count, decltype(components)::COMPONENT_ID, &components), ...);
+
+    return first_index;
+  }
+
   template <typename... T> void remove_components_template(EntityId entity) {
     if(!is_valid_entity(entity)) {
       panic("Entity id was invalid!\n");
     }
 
+    #ifdef DEBUG
+      (check_system_access(SystemAccessType::Component, (u64)&T::COMPONENT_ID, false), ...);
+    #endif
+
     (remove_component_unchecked(entity, T::COMPONENT_ID), ...);
   }
 
@@ -157,7 +252,7 @@ namespace quark {
       panic("Entity id was invalid!\n");
     }
 
-    (add_flags_unchecked(entity, T::COMPONENT_ID), ...);
+    (add_flag_unchecked(entity, T::COMPONENT_ID), ...);
   }
 
   template <typename... T> void remove_flags_template(EntityId entity) {
@@ -165,7 +260,7 @@ namespace quark {
       panic("Entity id was invalid!\n");
     }
 
-    (remove_flags_unchecked(entity, T::COMPONENT_ID), ...);
+    (remove_flag_unchecked(entity, T::COMPONENT_ID), ...);
   }
 
   template <typename... T> auto get_components_template(EntityId entity) {
@@ -202,288 +297,271 @@ namespace quark {
     return ((has_component_unchecked(entity, T::COMPONENT_ID)) && ...);
   }
 
-  template <typename... I, typename... E, typename F>
-  void for_archetype(Include<I...> incl, Exclude<E...> excl, F f) {
-    u64 includes[] = { I::COMPONENT_ID... };
-    u64 excludes[] = { E::COMPONENT_ID... };
-
-    u64 includes_size = sizeof(includes) / sizeof(includes[0]);
-    u64 excludes_size = sizeof(excludes) / sizeof(excludes[0]);
+// Archetype Iteration (Internal)
 
+  template <typename... I, typename... E>
+  inline void check_archetype_ids(Include<I...> incl, Exclude<E...> excl) {
     #ifdef DEBUG
-      for_every(i, includes_size) {
-        if(includes[i] == (u64)-1) { panic("In for_archetype(), one of the includes was not initialized!"); }
+      u32 includes[] = { I::COMPONENT_ID..., 0 };
+      u32 excludes[] = { E::COMPONENT_ID..., 0 };
+
+      for_every(i, sizeof...(I)) {
+        if(includes[i] == (u32)-1) { panic("In for_archetype(), one of the includes was not initialized!"); }
       }
   
-      for_every(i, excludes_size) {
-        print("Exclude: " + excludes[i]);
-        if(excludes[i] == (u64)-1) { panic("In for_archetype(), one of the excludes was not initialized!"); }
+      for_every(i, sizeof...(E)) {
+        if(excludes[i] == (u32)-1) { panic("In for_archetype(), one of the excludes was not initialized!"); }
       }
-    #endif
 
-    EcsContext* ecs = get_resource(EcsContext);
+      (check_system_access(SystemAccessType::Component, (u64)&I::COMPONENT_ID, true), ...);
+      (check_system_access(SystemAccessType::Component, (u64)&E::COMPONENT_ID, true), ...);
+    #endif
+  }
 
-    for(u64 i = (ecs->first_entity / 64); i <= ecs->last_entity; i += 1) {
-      u64 archetype = ~ecs->component_bitsets[ecs->empty_flag_id][i];
+  // reads_only<T> is true when f can take the include T as a const pointer.
+  // Args are the parameters f gets in front of the component pointers
+  template <typename F, typename Args, typename... I>
+  struct ArchetypeCallback;
 
-      // build archetype mask
+  template <typename F, typename... Args, typename... I>
+  struct ArchetypeCallback<F, std::tuple<Args...>, I...> {
+    template <typename T>
+    static constexpr bool reads_only = std::is_invocable_v<F&, Args..., std::conditional_t<std::is_same_v<I, T>, const I*, I*>...>;
+  };
 
-      for(u64 j = 0; j < (includes_size); j += 1) {
-        archetype &= ecs->component_bitsets[includes[j]][i]; 
-      }
+  // check_archetype_ids() only knows the includes get read, an include f takes as a non-const pointer is a write
+  template <typename Args, typename... I, typename F>
+  inline void check_archetype_writes(Include<I...> incl, F& f) {
+    #ifdef DEBUG
+      using Callback = ArchetypeCallback<F, Args, I...>;
+      (check_system_access(SystemAccessType::Component, (u64)&I::COMPONENT_ID, Callback::template reads_only<I>), ...);
+    #endif
+  }
 
-      if ((includes_size) != 0 || (excludes_size) != 0) {
-        archetype &= ecs->component_bitsets[ecs->active_flag_id][i];
-      }
+  // Build the mask of entities in the 64-entity word that match the archetype
+  template <typename... I, typename... E>
+  inline u64 get_archetype_word(EcsContext* ecs, Include<I...> incl, Exclude<E...> excl, u64 word_index) {
+    u64 archetype = ~ecs->component_bitsets[ecs->empty_flag_id][word_index];
 
-      for(u64 j = 0; j < (excludes_size); j += 1) {
-        archetype &= ~ecs->component_bitsets[excludes[j]][i]; 
-      }
- 
-      u64 global_index = i * 64;
+    ((archetype &= ecs->component_bitsets[I::COMPONENT_ID][word_index]), ...);
 
-      // iterate through entities with the archetype
-      while(archetype != 0) {
-        u64 local_index = __builtin_ctzll(archetype);
-        archetype ^= archetype & -archetype;
- 
-        u64 entity_index = global_index + local_index;
-        u32 entity_generation = ecs->entity_generations[entity_index];
+    if (sizeof...(I) != 0 || sizeof...(E) != 0) {
+      archetype &= ecs->component_bitsets[ecs->active_flag_id][word_index];
+    }
 
-        EntityId id = {};
-        id.index = entity_index;
-        id.generation = entity_generation;
+    ((archetype &= ~ecs->component_bitsets[E::COMPONENT_ID][word_index]), ...);
 
-        u64 inc = (includes_size) - 1;
+    return archetype;
+  }
 
-        // pull components out and run the function
-        {
-          std::tuple<EntityId, I*...> t = std::tuple(id, [&] {
-            u64 k = inc;
-            inc -= 1;
-
-            u8* comp_table = (u8*)ecs->component_datas[includes[k]];
-            return (I*)&comp_table[entity_index * ecs->component_sizes_in_bytes[includes[k]]];
-          } ()...);
-          std::apply(f, t);
-        }
-      }
-    }
+  template <typename T>
+  inline T* get_component_ptr_in(EcsContext* ecs, u64 entity_index) {
+    u8* comp_table = (u8*)ecs->component_datas[T::COMPONENT_ID];
+    return (T*)&comp_table[entity_index * ecs->component_sizes_in_bytes[T::COMPONENT_ID]];
   }
 
-  template <typename... I, typename... E, typename F>
-  void for_archetype_par(u32 batch_size_x32, Include<I...> incl, Exclude<E...> excl, F f) {
-    panic("BAD");
+  inline EntityId get_entity_id_in(EcsContext* ecs, u64 entity_index) {
+    EntityId id = {};
+    id.index = entity_index;
+    id.generation = ecs->entity_generations[entity_index];
 
-    static EcsContext* ctx = get_resource(EcsContext);
+    return id;
+  }
 
-    struct ThreadWork {
-      u32 start;
-      u32 end;
-    };
+  // Split a matching word into runs of consecutive entities
+  template <typename... I, typename F>
+  inline void for_each_archetype_run_in_word(EcsContext* ecs, Include<I...> incl, u64 word_index, u64 archetype, F& f) {
+    u64 global_index = word_index * 64;
 
-    static u32 work_count = 0;
-    static ThreadWork* work = 0;
-    static std::atomic_uint32_t work_index = 0;
+    while(archetype != 0) {
+      u64 start = __builtin_ctzll(archetype);
 
-    static u32 includes[] = { I::COMPONENT_ID... };
-    static u32 excludes[] = { E::COMPONENT_ID... };
+      // The shift pulls in zeros, so after inverting the run ends at the first set bit
+      // unless the whole word was set
+      u64 rest = ~(archetype >> start);
+      u64 count = rest == 0 ? 64 : __builtin_ctzll(rest);
 
-    static u32 includes_size = sizeof...(I);
-    static u32 excludes_size = sizeof...(E);
+      archetype = count == 64 ? 0 : archetype & ~(((1ULL << count) - 1) << start);
 
-    static F f2 = f;
+      u64 first_index = global_index + start;
+      f(first_index, (u32)count, get_component_ptr_in<I>(ecs, first_index)...);
+    }
+  }
 
-    #ifdef DEBUG
-      for_every(i, includes_size) {
-        if(includes[i] == (u32)-1) { panic("In for_archetype(), one of the includes was not initialized!"); }
-      }
-  
-      for_every(i, excludes_size) {
-        if(excludes[i] == (u32)-1) { panic("In for_archetype(), one of the excludes was not initialized!"); }
+  // Call f(word_index, archetype) for every non-empty archetype word in [word_start, word_end)
+  //
+  // With includes we only visit words whose bit is set in every include summary,
+  // so the cost follows the number of matching words instead of the world size.
+  // Excludes and the empty flag can't be checked at this level since a set summary bit
+  // only means that some entity in the word has the flag.
+  template <typename... I, typename... E, typename F>
+  inline void for_each_archetype_word(EcsContext* ecs, Include<I...> incl, Exclude<E...> excl, u64 word_start, u64 word_end, F&& f) {
+    if constexpr (sizeof...(I) == 0) {
+      for_range(i, word_start, word_end) {
+        u64 archetype = get_archetype_word(ecs, incl, excl, i);
+        if(archetype != 0) {
+          f(i, archetype);
+        }
       }
-    #endif
-
-    TempStack scratch = begin_scratch(0, 0);
-    defer(end_scratch(scratch));
+    } else {
+      for(u64 s = word_start / 64; s * 64 < word_end; s += 1) {
+        u64 candidates = ecs->component_summaries[ecs->active_flag_id][s];
+        ((candidates &= ecs->component_summaries[I::COMPONENT_ID][s]), ...);
+
+        // mask off the words outside of the range
+        u64 base = s * 64;
+        if(word_start > base) {
+          candidates &= ~0ULL << (word_start - base);
+        }
+        if(word_end < base + 64) {
+          candidates &= (1ULL << (word_end - base)) - 1;
+        }
 
-    work_count = ((ctx->last_entity - (ctx->first_entity / 64)) / batch_size_x32) + 1;
-    work = arena_push_array(scratch.arena, ThreadWork, work_count);
-    work_index.store(0, std::memory_order_seq_cst);
+        while(candidates != 0) {
+          u64 i = base + __builtin_ctzll(candidates);
+          candidates ^= candidates & -candidates;
 
-    for_every(i, work_count) {
-      work[i].start = i * batch_size_x32;
-      work[i].end = (i + 1) * batch_size_x32;
+          u64 archetype = get_archetype_word(ecs, incl, excl, i);
+          if(archetype != 0) {
+            f(i, archetype);
+          }
+        }
+      }
     }
+  }
 
-    // entity_tail is inclusive so we add 1
-    work[work_count - 1].end = ctx->last_entity + 1;
+  // Number of 64-entity words an archetype query has to look at
+  inline u64 get_archetype_word_range(EcsContext* ecs, u64* first_word) {
+    *first_word = ecs->first_entity / 64;
 
-    for_every(i, work_count) {
-      thread_pool_push([]() {
-        u32 work_i = work_index.fetch_add(1, std::memory_order_seq_cst);
-        if(work_i > work_count) {
-          return;
-        }
+    // last_entity is inclusive so we add 1
+    return ecs->last_entity + 1 - *first_word;
+  }
 
-        ThreadWork my_work = work[work_i];
+  // Spread the archetype words across the job workers in groups of group_size words,
+  // w(worker_index) runs at the start of each group and f(worker_index, word_index, archetype) for each non-empty word
+  template <typename... I, typename... E, typename W, typename F>
+  inline void for_archetype_words_par(u32 group_size, Include<I...> incl, Exclude<E...> excl, W w, F f) {
+    check_archetype_ids(incl, excl);
 
-        for(u32 i = my_work.start; i <= my_work.end; i += 1) {
-          u64 archetype = ~ctx->component_bitsets[ctx->empty_flag_id][i];
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
 
-          for(u32 j = 0; j < (includes_size); j += 1) {
-            archetype &= ctx->component_bitsets[includes[j]][i]; 
-          }
+    u64 first_word = 0;
+    u64 word_count = get_archetype_word_range(ecs, &first_word);
 
-          if ((includes_size) != 0 || (excludes_size) != 0) {
-            archetype &= ctx->component_bitsets[ctx->active_flag_id][i];
-          }
+    // Default to a few groups per worker so uneven groups still balance out through stealing
+    if(group_size == 0) {
+      u64 target_group_count = (u64)job_worker_count() * 4;
+      group_size = (u32)((word_count + target_group_count - 1) / target_group_count);
+      group_size = group_size == 0 ? 1 : group_size;
+    }
 
-          for(u32 j = 0; j < (excludes_size); j += 1) {
-            archetype &= ~ctx->component_bitsets[excludes[j]][i]; 
-          }
- 
-          u32 global_index = i * 32;
- 
-          while(archetype != 0) {
-            u64 local_index = __builtin_ctzll(archetype);
-            archetype ^= 1ULL << local_index;
- 
-            u32 entity_index = global_index + local_index;
-            u32 entity_generation = ctx->entity_generations[entity_index];
+    job_parallel_for(word_count, group_size, [&](usize start, usize end) {
+      u32 worker_index = (u32)job_worker_index();
 
-            EntityId id = {};
-            id.index = entity_index;
-            id.generation = entity_generation;
- 
-            u32 inc = (includes_size) - 1;
- 
-            {
-              std::tuple<EntityId, I*...> t = std::tuple(id, [&] {
-                u32 i = inc;
-                inc -= 1;
-
-                u8* comp_table = (u8*)ctx->component_datas[includes[i]];
-                return (I*)&comp_table[entity_index * ctx->component_sizes_in_bytes[includes[i]]];
-              } ()...);
-              std::apply(f2, t);
-            }
-          }
-        }
-      });
-    }
+      w(worker_index);
 
-    thread_pool_join();
+      for_each_archetype_word(ecs, incl, excl, first_word + start, first_word + end, [&](u64 word_index, u64 archetype) {
+        f(worker_index, word_index, archetype);
+      });
+    });
   }
 
-  template <typename... I, typename... E, typename W, typename G, typename F>
-  void for_archetype_par_grp(u32 batch_size_x32, Include<I...> incl, Exclude<E...> excl, W w, G g, F f) {
-    panic("bad!\n");
-    
-    static EcsContext* ctx = get_resource(EcsContext);
+// Archetype Iteration
 
-    struct ThreadWork {
-      u32 start;
-      u32 end;
-    };
+  template <typename... I, typename... E, typename F>
+  void for_archetype(Include<I...> incl, Exclude<E...> excl, F f) {
+    check_archetype_ids(incl, excl);
+    check_archetype_writes<std::tuple<EntityId>>(incl, f);
 
-    static u32 work_count = 0;
-    static ThreadWork* work = 0;
-    static std::atomic_uint32_t work_index = 0;
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
 
-    static u32 includes[] = { I::COMPONENT_ID... };
-    static u32 excludes[] = { E::COMPONENT_ID... };
+    u64 first_word = 0;
+    u64 word_count = get_archetype_word_range(ecs, &first_word);
 
-    static u32 includes_size = sizeof...(I);
-    static u32 excludes_size = sizeof...(E);
+    for_each_archetype_word(ecs, incl, excl, first_word, first_word + word_count, [&](u64 word_index, u64 archetype) {
+      u64 global_index = word_index * 64;
 
-    static W w2 = w;
-    static G g2 = g;
-    static F f2 = f;
+      // iterate through entities with the archetype
+      while(archetype != 0) {
+        u64 local_index = __builtin_ctzll(archetype);
+        archetype ^= archetype & -archetype;
+ 
+        u64 entity_index = global_index + local_index;
 
-    #ifdef DEBUG
-      for_every(i, includes_size) {
-        if(includes[i] == (u32)-1) { panic("In for_archetype(), one of the includes was not initialized!"); }
-      }
-  
-      for_every(i, excludes_size) {
-        if(excludes[i] == (u32)-1) { panic("In for_archetype(), one of the excludes was not initialized!"); }
+        // pull components out and run the function
+        f(get_entity_id_in(ecs, entity_index), get_component_ptr_in<I>(ecs, entity_index)...);
       }
-    #endif
+    });
+  }
 
-    TempStack scratch = begin_scratch(0, 0);
-    defer(end_scratch(scratch));
+  template <typename... I, typename... E, typename F>
+  void for_archetype_runs(Include<I...> incl, Exclude<E...> excl, F f) {
+    check_archetype_ids(incl, excl);
+    check_archetype_writes<std::tuple<u64, u32>>(incl, f);
 
-    work_count = ((ctx->last_entity - (ctx->first_entity / 64)) / batch_size_x32) + 1;
-    work = arena_push_array(scratch.arena, ThreadWork, work_count);
-    work_index = 0;
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
 
-    for_every(i, work_count) {
-      work[i].start = i * batch_size_x32;
-      work[i].end = (i + 1) * batch_size_x32;
-    }
+    u64 first_word = 0;
+    u64 word_count = get_archetype_word_range(ecs, &first_word);
 
-    // entity_tail is inclusive so we add 1
-    work[work_count - 1].end = ctx->last_entity + 1;
+    for_each_archetype_word(ecs, incl, excl, first_word, first_word + word_count, [&](u64 word_index, u64 archetype) {
+      for_each_archetype_run_in_word(ecs, incl, word_index, archetype, f);
+    });
+  }
 
-    for_every(i, work_count) {
-      thread_pool_push([]() {
-        u32 work_i = work_index.fetch_add(1, std::memory_order_seq_cst);
-        if(work_i > work_count) {
-          return;
-        }
+  template <typename... I, typename... E, typename F>
+  void for_archetype_runs_par(u32 group_size, Include<I...> incl, Exclude<E...> excl, F f) {
+    check_archetype_writes<std::tuple<u64, u32>>(incl, f);
 
-        ThreadWork my_work = work[work_i];
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
 
-        w2();
+    for_archetype_words_par(group_size, incl, excl,
+    [](u32 worker_index) {},
+    [&](u32 worker_index, u64 word_index, u64 archetype) {
+      for_each_archetype_run_in_word(ecs, incl, word_index, archetype, f);
+    });
+  }
 
-        for(u32 i = my_work.start; i < my_work.end; i += 1) {
-          u64 archetype = ~ctx->component_bitsets[ctx->empty_flag_id][i];
+  // for_archetype_par_grp() without the include write check, for_archetype_par() checks against its own f
+  template <typename... I, typename... E, typename W, typename G, typename F>
+  void for_archetype_par_grp_unchecked(u32 group_size, Include<I...> incl, Exclude<E...> excl, W w, G g, F f) {
+    EcsContext* ecs = get_resource_unchecked(EcsContext);
 
-          for(u32 j = 0; j < (includes_size); j += 1) {
-            archetype &= ctx->component_bitsets[includes[j]][i]; 
-          }
+    for_archetype_words_par(group_size, incl, excl, w,
+    [&](u32 worker_index, u64 word_index, u64 archetype) {
+      g(worker_index, archetype);
 
-          if ((includes_size) != 0 || (excludes_size) != 0) {
-            archetype &= ctx->component_bitsets[ctx->active_flag_id][i];
-          }
+      u64 global_index = word_index * 64;
 
-          for(u32 j = 0; j < (excludes_size); j += 1) {
-            archetype &= ~ctx->component_bitsets[excludes[j]][i]; 
-          }
+      while(archetype != 0) {
+        u64 local_index = __builtin_ctzll(archetype);
+        archetype ^= archetype & -archetype;
 
-          g2(archetype);
- 
-          u32 global_index = i * 32;
- 
-          while(archetype != 0) {
-            u32 local_index = __builtin_ctzll(archetype);
-            archetype ^= 1ULL << local_index;
- 
-            u32 entity_index = global_index + local_index;
-            u32 entity_generation = ctx->entity_generations[entity_index];
-            EntityId id = {};
-            id.index = entity_index;
-            id.generation = entity_generation;
- 
-            u32 inc = (includes_size) - 1;
- 
-            {
-              std::tuple<EntityId, I*...> t = std::tuple(id, [&] {
-                u32 i = inc;
-                inc -= 1;
-
-                u8* comp_table = (u8*)ctx->component_datas[includes[i]];
-                return (I*)&comp_table[entity_index * ctx->component_sizes_in_bytes[includes[i]]];
-              } ()...);
-              std::apply(f2, t);
-            }
-          }
-        }
-      });
-    }
+        u64 entity_index = global_index + local_index;
 
-    thread_pool_join();
+        f(worker_index, get_entity_id_in(ecs, entity_index), get_component_ptr_in<I>(ecs, entity_index)...);
+      }
+    });
+  }
+
+  template <typename... I, typename... E, typename W, typename G, typename F>
+  void for_archetype_par_grp(u32 group_size, Include<I...> incl, Exclude<E...> excl, W w, G g, F f) {
+    check_archetype_writes<std::tuple<u32, EntityId>>(incl, f);
+    for_archetype_par_grp_unchecked(group_size, incl, excl, w, g, f);
+  }
+
+  template <typename... I, typename... E, typename F>
+  void for_archetype_par(u32 group_size, Include<I...> incl, Exclude<E...> excl, F f) {
+    check_archetype_writes<std::tuple<EntityId>>(incl, f);
+
+    for_archetype_par_grp_unchecked(group_size, incl, excl,
+      [](u32 worker_index) {},
+      [](u32 worker_index, u64 archetype) {},
+      [&](u32 worker_index, EntityId id, I*... components) {
+        f(id, components...);
+      }
+    );
   }
 
 #ifndef QUARK_ENGINE_INLINES
@@ -9,11 +9,11 @@ namespace quark {
 #endif
 
   inline VkCommandBuffer graphics_commands() {
-    return get_resource(Graphics)->commands[get_resource(Graphics)->frame_index];
+    return get_resource_unchecked(Graphics)->commands[get_resource_unchecked(Graphics)->frame_index];
   }
 
   inline u32 frame_index() {
-    return get_resource(Graphics)->frame_index;
+    return get_resource_unchecked(Graphics)->frame_index;
   }
 
 #ifndef QUARK_ENGINE_INLINES
@@ -13,7 +13,7 @@ namespace quark {
 #endif
 
   void* get_material_instance(u32 material_id, u32 material_instance_index) {
-    Renderer* context = get_resource(Renderer);
+    Renderer* context = get_resource_unchecked(Renderer);
     MaterialBatch* batch = &context->batches[material_id];
     MaterialInfo* type = &context->infos[material_id];
 
@@ -21,7 +21,7 @@ namespace quark {
   }
 
   void push_drawable_instance(u32 material_id, Drawable* drawable, void* material) {
-    Renderer* context = get_resource(Renderer);
+    Renderer* context = get_resource_unchecked(Renderer);
     MaterialBatch* batch = &context->batches[material_id];
     MaterialInfo* type = &context->infos[material_id];
 
@@ -41,19 +41,24 @@ namespace quark {
     push_drawable_instance(T::MATERIAL_ID, drawable, material_instance);
   }
 
+  template <typename T>
+  RenderInstanceId add_render_instance(Drawable* drawable, T* material_instance) {
+    return add_render_instance(T::MATERIAL_ID, drawable, material_instance);
+  }
+
   inline auto push_drawable_instance_n(u32 n, u32 material_id) {
     struct Return {
       Drawable* drawables;
       void* materials;
     };
   
-    Renderer* context = get_resource(Renderer);
+    Renderer* context = get_resource_unchecked(Renderer);
     MaterialBatch* batch = &context->batches[material_id];
     MaterialInfo* type = &context->infos[material_id];
 
     u32 i = __atomic_fetch_add(&batch->batch_count, n, __ATOMIC_SEQ_CST);
 
-    if(i > type->batch_capacity) {
+    if(i + n > type->batch_capacity) {
       printf("PANIC!\n");
       panic("Attempted to draw more than a material batch could handle!\n");
     }
@@ -66,7 +71,7 @@ namespace quark {
   }
 
   void push_drawable(u32 material_id, Drawable* drawable, u32 material_instance_index) {
-    Renderer* context = get_resource(Renderer);
+    Renderer* context = get_resource_unchecked(Renderer);
     MaterialBatch* batch = &context->batches[material_id];
     MaterialInfo* info = &context->infos[material_id];
 
@@ -75,7 +80,7 @@ namespace quark {
 
   template <typename T, typename TIndex, typename TWorld>
   void update_material2(const char* vertex_shader_name, const char* fragment_shader_name, u32 max_draw_count, u32 mat_inst_cap) {
-    Renderer* context = get_resource(Renderer);
+    Renderer* context = get_resource_unchecked(Renderer);
 
     update_component(T);
     update_component(TIndex);
@@ -84,10 +89,11 @@ namespace quark {
       .material_size = (u32)align_forward(sizeof(T), 16),
 
       .world_size = sizeof(TWorld),
-      .world_ptr = get_resource(TWorld),
+      .world_ptr = get_resource_unchecked(TWorld),
       .world_buffers = TWorld::BUFFERS,
       .material_buffers = TWorld::MATERIAL_BUFFERS,
       .transform_buffers = TWorld::TRANSFORM_BUFFERS,
+      .instance_buffers = TWorld::INSTANCE_BUFFERS,
 
       .batch_capacity = max_draw_count,
       .material_instance_capacity = mat_inst_cap,
@@ -117,6 +123,14 @@ namespace quark {
 
     create_buffers(TWorld::TRANSFORM_BUFFERS, 2, &transform_buffer_info);
 
+    // Forward pass instances then shadow pass instances
+    BufferInfo instance_buffer_info {
+      .type = BufferType::Upload,
+      .size = (u32)sizeof(u32) * max_draw_count * 2,
+    };
+
+    create_buffers(TWorld::INSTANCE_BUFFERS, 2, &instance_buffer_info);
+
     Buffer* world_buffers[_FRAME_OVERLAP] = { 
       &TWorld::BUFFERS[0], 
       &TWorld::BUFFERS[1], 
@@ -132,7 +146,12 @@ namespace quark {
       &TWorld::TRANSFORM_BUFFERS[1],
     };
 
-    ResourceBinding bindings[3] = {}; 
+    Buffer* instance_buffers[_FRAME_OVERLAP] = {
+      &TWorld::INSTANCE_BUFFERS[0],
+      &TWorld::INSTANCE_BUFFERS[1],
+    };
+
+    ResourceBinding bindings[4] = {}; 
     bindings[0].count = 1; 
     bindings[0].max_count = 1; 
     bindings[0].buffers = world_buffers; 
@@ -144,6 +163,10 @@ namespace quark {
     bindings[2].count = 1; 
     bindings[2].max_count = 1; 
     bindings[2].buffers = transform_buffers;
+
+    bindings[3].count = 1;
+    bindings[3].max_count = 1;
+    bindings[3].buffers = instance_buffers;
  
     ResourceGroupInfo resource_info { 
       .bindings_count = count_of(bindings),
@@ -6,7 +6,9 @@
 
   #include <thread>
 
-  #include <windows.h>
+  #ifdef _WIN64
+    #include <windows.h>
+  #endif
 
 #pragma clang diagnostic pop
 
@@ -48,6 +50,139 @@ namespace quark {
   static std::atomic_uint32_t job_index = 0;
   static SystemListInfo* list_info; // = &_system_lists.at(system_list);
 
+  // Declared accesses of a system, systems without an entry conflict with everything
+  struct SystemAccessInfo {
+    system_id system;
+    std::vector<SystemResourceAccess> accesses;
+    bool main_thread;
+  };
+
+  std::unordered_map<system_id, SystemAccessInfo> _system_accesses;
+
+  bool RUN_SYSTEMS_IN_PARALLEL = true;
+  bool RUN_BENCHMARKS = false;
+
+  void set_system_access(const char* system_name, SystemResourceAccess* accesses, usize access_count, bool main_thread) {
+    system_id name_hash = (system_id)hash_str_fast(system_name);
+
+    if(_system_functions.find(name_hash) == _system_functions.end()) {
+      panic("Attempted to set the access of a system that does not exist: \"" + system_name + "\"\n");
+    }
+
+    SystemAccessInfo info = {};
+    info.system = name_hash;
+    info.accesses = std::vector<SystemResourceAccess>(accesses, accesses + access_count);
+    info.main_thread = main_thread;
+
+    // Component iteration reads the entity flags, so a system that destroys entities
+    // has to wait for the systems iterating them
+    bool has_component_access = false;
+    bool has_ecs_access = false;
+    for_every(i, access_count) {
+      has_component_access |= accesses[i].type == SystemAccessType::Component;
+      has_ecs_access |= accesses[i].type == SystemAccessType::Resource && accesses[i].resource_id == (u64)get_resource_unchecked(EcsContext);
+    }
+
+    if(has_component_access && !has_ecs_access) {
+      info.accesses.push_back(resource_access<EcsContext>(true));
+    }
+
+    _system_accesses[name_hash] = info;
+
+    for(auto list = _system_lists.begin(); list != _system_lists.end(); list++) {
+      list->second.levels_dirty = true;
+    }
+  }
+
+  void check_system_access(SystemAccessType type, u64 resource_id, bool const_access) {
+    #ifdef DEBUG
+      // Jobs spawned by a system carry its access, so this is right even for jobs another system's thread picked up in job_wait()
+      SystemAccessInfo* info = (SystemAccessInfo*)job_get_context();
+      if(info == 0) {
+        return;
+      }
+
+      for_every(i, info->accesses.size()) {
+        SystemResourceAccess* access = &info->accesses[i];
+        if(access->type == type && access->resource_id == resource_id) {
+          if(access->const_access && !const_access) {
+            panic("System \"" + get_system_name(info->system) + "\" wrote to something it declared as const!\n");
+          }
+
+          return;
+        }
+      }
+
+      panic("System \"" + get_system_name(info->system) + "\" used something it did not declare access to!\n");
+    #endif
+  }
+
+  static bool do_systems_conflict(system_id a, system_id b) {
+    // tags don't run anything
+    if(_system_functions.at(a) == 0 || _system_functions.at(b) == 0) {
+      return false;
+    }
+
+    auto a_info = _system_accesses.find(a);
+    auto b_info = _system_accesses.find(b);
+    if(a_info == _system_accesses.end() || b_info == _system_accesses.end()) {
+      return true;
+    }
+
+    for_every(i, a_info->second.accesses.size()) {
+      SystemResourceAccess* a_access = &a_info->second.accesses[i];
+
+      for_every(j, b_info->second.accesses.size()) {
+        SystemResourceAccess* b_access = &b_info->second.accesses[j];
+
+        if(a_access->type == b_access->type && a_access->resource_id == b_access->resource_id && !(a_access->const_access && b_access->const_access)) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  // A system goes in the level after the last earlier system it conflicts with,
+  // so running the levels in order keeps the list order for everything that conflicts
+  static void update_system_levels(SystemListInfo* list) {
+    usize count = list->systems.size();
+
+    list->system_levels.resize(count);
+    list->level_count = 0;
+
+    for_every(i, count) {
+      u32 level = 0;
+
+      for_every(j, i) {
+        if(list->system_levels[j] + 1 > level && do_systems_conflict(list->systems[i], list->systems[j])) {
+          level = list->system_levels[j] + 1;
+        }
+      }
+
+      list->system_levels[i] = level;
+      list->level_count = level + 1 > list->level_count ? level + 1 : list->level_count;
+    }
+
+    list->levels_dirty = false;
+  }
+
+  static void run_system(system_id id, VoidFunctionPtr system, Timestamp* out_runtime) {
+    void* previous_context = job_get_context();
+
+    auto info = _system_accesses.find(id);
+    job_set_context(info != _system_accesses.end() ? &info->second : 0);
+
+    Timestamp t0 = get_timestamp();
+    system();
+    Timestamp t1 = get_timestamp();
+
+    *out_runtime = get_timestamp_difference(t0, t1);
+
+    job_set_context(previous_context);
+  }
+
   void run_system_list_id(system_list_id system_list) {
     if(_system_lists.find(system_list) == _system_lists.end()) {
       panic("Attempted to run a system list that does not exist!");
@@ -56,23 +191,79 @@ namespace quark {
     SystemListInfo* list = &_system_lists.at(system_list);
     list_info = list;
 
+    if(list->levels_dirty) {
+      update_system_levels(list);
+    }
+
     if(_system_runtimes.count(system_list) == 0) {
       _system_runtimes[system_list] = {};
     }
 
-    _system_runtimes[system_list].clear();
-    _system_runtimes[system_list].push_back(get_timestamp());
-    job_index.store(0, std::memory_order_seq_cst);
-    for_every(i, list->systems.size()) {
-      // Optionally log/time the functions being run
-      VoidFunctionPtr system = _system_functions.at(list->systems[i]);
-      if(system != 0) { // we optionally allow tags in the form of a system
+    usize count = list->systems.size();
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    Timestamp* runtimes = arena_push_array_zero(arena, Timestamp, count);
+    VoidFunctionPtr* systems = arena_push_array(arena, VoidFunctionPtr, count);
+    for_every(i, count) {
+      systems[i] = _system_functions.at(list->systems[i]);
+    }
+
+    Timestamp start = get_timestamp();
+
+    u32 level_count = RUN_SYSTEMS_IN_PARALLEL ? list->level_count : 1;
+    for_every(level, level_count) {
+      JobCounter counter = {};
+
+      // Hand the rest of the level to the job system, then run the main thread systems while it works
+      for_every(i, count) {
+        if(systems[i] == 0 || (RUN_SYSTEMS_IN_PARALLEL && list->system_levels[i] != level)) {
+          continue;
+        }
+
+        auto info = _system_accesses.find(list->systems[i]);
+        bool main_thread = !RUN_SYSTEMS_IN_PARALLEL || info == _system_accesses.end() || info->second.main_thread;
+        if(main_thread) {
+          continue;
+        }
+
+        system_id id = list->systems[i];
+        VoidFunctionPtr system = systems[i];
+        Timestamp* runtime = &runtimes[i];
+
+        job_spawn(&counter, [id, system, runtime]() {
+          run_system(id, system, runtime);
+        });
+      }
+
+      for_every(i, count) {
+        if(systems[i] == 0 || (RUN_SYSTEMS_IN_PARALLEL && list->system_levels[i] != level)) {
+          continue;
+        }
+
+        auto info = _system_accesses.find(list->systems[i]);
+        bool main_thread = !RUN_SYSTEMS_IN_PARALLEL || info == _system_accesses.end() || info->second.main_thread;
+        if(!main_thread) {
+          continue;
+        }
+
+        // Optionally log/time the functions being run
         // print("Running: " + _system_names.at(list->systems[i]).c_str() + "\n");
         job_index.store(i, std::memory_order_seq_cst);
-        system();
+        run_system(list->systems[i], systems[i], &runtimes[i]);
         // print("Finished: " + _system_names.at(list->systems[i]).c_str() + "\n");
       }
-      _system_runtimes[system_list].push_back(get_timestamp());
+
+      job_wait(&counter);
+    }
+
+    // Systems overlap now, so store the runtimes back to back to keep the differences meaningful
+    std::vector<Timestamp>* timestamps = &_system_runtimes[system_list];
+    timestamps->clear();
+    timestamps->push_back(start);
+    for_every(i, count) {
+      timestamps->push_back(timestamps->back() + runtimes[i]);
     }
   }
 
@@ -152,6 +343,7 @@ namespace quark {
       }
 
       list->systems.push_back(system_hash);
+      list->levels_dirty = true;
       return;
     }
 
@@ -165,11 +357,13 @@ namespace quark {
 
       if(absolute_position == list->systems.size()) {
         list->systems.push_back(system_hash);
+        list->levels_dirty = true;
         return;
       }
 
       auto index = list->systems.begin() + absolute_position;
       list->systems.insert(index, system_hash);
+      list->levels_dirty = true;
       return;
     } else {
       auto relative_index_iter = std::find(list->systems.begin(), list->systems.end(), relative_hash);
@@ -182,6 +376,7 @@ namespace quark {
 
       auto index = list->systems.begin() + absolute_position;
       list->systems.insert(index, system_hash);
+      list->levels_dirty = true;
     } 
   }
 
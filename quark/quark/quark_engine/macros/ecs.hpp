@@ -39,7 +39,7 @@
 //
 /*
   #define for_archetype_internal(comps, c, excl, e, f...) { \
-    EcsContext* ctx = get_resource(EcsContext); \
+    EcsContext* ctx = get_resource_unchecked(EcsContext); \
     for(u32 i = (ctx->ecs_entity_head / 32); i <= ctx->ecs_entity_tail; i += 1) { \
       u32 archetype = ~ctx->ecs_bool_table[ctx->ecs_empty_flag][i]; \
       for(u32 j = 0; j < (c); j += 1) { \
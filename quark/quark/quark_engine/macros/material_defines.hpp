@@ -36,6 +36,7 @@
       static Buffer BUFFERS[_FRAME_OVERLAP]; \
       static Buffer MATERIAL_BUFFERS[_FRAME_OVERLAP]; \
       static Buffer TRANSFORM_BUFFERS[_FRAME_OVERLAP]; \
+      static Buffer INSTANCE_BUFFERS[_FRAME_OVERLAP]; \
       static ResourceGroup RESOURCE_GROUP; \
       static name##World RESOURCE; \
     } \
@@ -45,6 +46,7 @@
     Buffer name##World::BUFFERS[_FRAME_OVERLAP]; \
     Buffer name##World::MATERIAL_BUFFERS[_FRAME_OVERLAP]; \
     Buffer name##World::TRANSFORM_BUFFERS[_FRAME_OVERLAP]; \
+    Buffer name##World::INSTANCE_BUFFERS[_FRAME_OVERLAP]; \
     ResourceGroup name##World::RESOURCE_GROUP
 
   #define update_material(name, vertex_shader_name, fragment_shader_name, max_draw_count, max_material_instance_count) \
@@ -17,17 +17,46 @@
 #define define_resource(name, x...) \
   name name::RESOURCE = x \
 
+// PE section names are capped at 8 chars, ELF needs a plain identifier so the linker makes __start_/__stop_ symbols for it
+#ifdef _WIN64
+  #define QUARK_STATIC_SECTION ".static"
+#else
+  #define QUARK_STATIC_SECTION "quark_static"
+#endif
+
 #define define_savable_resource(name, x...) \
-  __attribute__((section (".static"))) name name::RESOURCE = x \
+  __attribute__((section (QUARK_STATIC_SECTION), used)) name name::RESOURCE = x \
+
+#define savable __attribute__((section (QUARK_STATIC_SECTION), used))
+
+#ifndef _WIN64
 
-#define savable __attribute__((section (".static")))
+  // Hidden so every module gets its own range, weak so modules without savables get null
+  extern "C" char __start_quark_static[] __attribute__((weak, visibility("hidden")));
+  extern "C" char __stop_quark_static[] __attribute__((weak, visibility("hidden")));
+
+  // Emitted into every module that includes the engine, snapshots.cpp dlsym's it per module
+  extern "C" inline __attribute__((used, visibility("default"))) void quark_get_static_section(usize* static_size, void** static_ptr) {
+    *static_size = (usize)(__stop_quark_static - __start_quark_static);
+    *static_ptr = __start_quark_static;
+  }
+
+#endif
 
 #define declare_resource_duplicate(name, inherits) \
   struct api_decl name : inherits { \
     static name RESOURCE; \
   }; \
 
-#define get_resource(name) (&name::RESOURCE)
+#define get_resource_unchecked(name) (&name::RESOURCE)
+
+// In debug builds, panic if the running system didn't declare access to the resource.
+// Reads and writes look the same through the pointer, so any declared access passes
+#ifdef DEBUG
+  #define get_resource(name) (quark::check_system_access(quark::SystemAccessType::Resource, (u64)&name::RESOURCE, true), &name::RESOURCE)
+#else
+  #define get_resource(name) get_resource_unchecked(name)
+#endif
 
 #define get_resource_as(name, type) ((type*)get_resource(name))
 
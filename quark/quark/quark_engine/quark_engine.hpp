@@ -18,6 +18,10 @@
   #include <vulkan/vulkan.h>
   #include <vk_mem_alloc.h>
 
+  #ifdef __AVX2__
+    #include <immintrin.h>
+  #endif
+
   typedef struct ma_engine ma_engine;
 
 #pragma clang diagnostic pop
@@ -155,6 +159,13 @@ namespace quark {
   //
   declare_enum(system_list_id, u32);
 
+  // What the resource_id of a SystemResourceAccess refers to
+  declare_enum(SystemAccessType, u32,
+    Resource  = 0, // Address of the resource
+    Component = 1, // Address of the component's COMPONENT_ID, so it can be declared before the component is initialized
+    Named     = 2, // hash_str_fast() of a name, for state that isn't a resource like window input or the gpu
+  );
+
   //
   declare_enum(state_id, u32);
 
@@ -328,6 +339,68 @@ namespace quark {
     vec4 planes[6];
   };
 
+  // Nodes with more spheres than this get split
+  static constexpr u32 CULLING_BVH_LEAF_SIZE = 16;
+
+  // CullingBvhNode, count is the number of spheres under the node.
+  // Nodes over CULLING_BVH_LEAF_SIZE are interior and have their children at first and first + 1,
+  // leaves cover indices[first..first + count)
+  struct CullingBvhNode {
+    vec3 min;
+    u32 first;
+    vec3 max;
+    u32 count;
+  };
+
+  // CullingBvh,
+  struct CullingBvh {
+    CullingBvhNode* nodes;
+    u32 node_count;
+
+    u32* indices; // Sphere indices in tree order, every subtree is a contiguous range
+
+    vec4* spheres;
+    u32 sphere_count;
+  };
+
+  // CullingGrid, spheres bucketed by the cell their center is in. Cells are loose,
+  // their bounds grow to fit every sphere in them so a sphere never has to be split across cells
+  struct CullingGrid {
+    u32 cell_count;   // Power of 2, cell coordinates get hashed into it
+    u32* cell_starts; // indices[cell_starts[c]..cell_starts[c + 1]) are in cell c
+    vec3* cell_mins;
+    vec3* cell_maxs;
+
+    u32* indices;
+
+    vec4* spheres;
+    u32 sphere_count;
+  };
+
+  // Occlusion buffers are stored in tiles of 8x4 pixels so a tile row is one avx2 register
+  static constexpr u32 OCCLUSION_TILE_WIDTH = 8;
+  static constexpr u32 OCCLUSION_TILE_HEIGHT = 4;
+
+  // OcclusionBuffer, low resolution cpu depth buffer that occluders get rasterized into
+  struct OcclusionBuffer {
+    u32 width;
+    u32 height;
+    u32 tile_count_x;
+    u32 tile_count_y;
+
+    f32* depth;      // 1 / w per pixel with 0 being infinitely far, stored tile by tile
+    f32* tile_depth; // Farthest depth in each tile
+
+    mat4 view_projection;
+  };
+
+  // OccluderMesh, triangles that hide what is behind them, usually a box or a coarse lod of the real mesh
+  struct OccluderMesh {
+    vec3* positions;
+    u32* indices;
+    u32 index_count;
+  };
+
   // ActionProperties,
   struct ActionProperties {
     std::vector<InputId> input_ids;
@@ -355,11 +428,17 @@ namespace quark {
   //
   struct SystemListInfo {
     std::vector<system_id> systems;
+
+    // Systems in the same level don't conflict and run at the same time, rebuilt when the list or any system access changes
+    std::vector<u32> system_levels;
+    u32 level_count = 0;
+    bool levels_dirty = true;
   };
 
-  //
+  // Something a system reads from or writes to, see set_system_access()
   struct SystemResourceAccess {
-    i32 resource_id;
+    SystemAccessType type;
+    u64 resource_id;
     bool const_access;
   };
 
@@ -382,6 +461,8 @@ namespace quark {
     VmaAllocation allocation;
     VkBuffer buffer;
 
+    u8* headless_data; // Plain host memory standing in for the allocation when HEADLESS
+
     // Metadata
     BufferType type;
     u32 size;
@@ -519,12 +600,26 @@ namespace quark {
   struct MeshInstance {
     u32 offset; // Triangle offset in the global mesh buffer
     u32 count;  // Triangle count in the global mesh buffer
+    i32 vertex_offset; // Added to every index by the draw, so indices stay local to the mesh
+  };
+
+  static constexpr u32 UPLOAD_RING_SEGMENT_COUNT = 4;
+
+  // One slice of the staging buffer, everything copied through it is submitted together under one fence.
+  // The cpu fills the next segment while the gpu copies this one
+  struct UploadSegment {
+    VkCommandBuffer commands;
+    VkFence fence;
+    u32 used;
+    bool recording;
+    bool in_flight;
   };
 
   //
   struct ModelInstance {
     f32 angular_thresholds[4];
     MeshId mesh_ids[4];
+    f32 lod_errors[4]; // Simplification error in normalized mesh units, lods with 0 fall back to angular_thresholds
   };
 
   // MeshProperties, general properties of a mesh
@@ -562,7 +657,7 @@ namespace quark {
     u32 index_offset;
     u32 index_count;
     f32 threshold;
-    u32 _pad0;
+    f32 error; // Simplification error in normalized mesh units, 0 for the source mesh
   };
 
   // .qmesh file format
@@ -610,6 +705,7 @@ namespace quark {
     Buffer* world_buffers;
     Buffer* material_buffers;
     Buffer* transform_buffers;
+    Buffer* instance_buffers; // Drawable index of every instance, indexed by gl_InstanceIndex
 
     u32 batch_capacity;
     u32 material_instance_capacity;
@@ -623,6 +719,34 @@ namespace quark {
     u32 batch_count;
     Drawable* drawables_batch;
     u8* materials_batch;
+
+    // Render instances sit at the start of the batch and survive reset_material_batches(),
+    // pushed drawables come after them. Only slots in a frames dirty list get uploaded again
+    u32 retained_count;
+    u32* retained_slots;   // Handle -> slot
+    u32* retained_handles; // Slot -> handle
+    u32 handle_count;
+    u32 free_handle_count;
+    u32* free_handles;
+
+    u32 dirty_counts[_FRAME_OVERLAP];
+    u32* dirty_slots[_FRAME_OVERLAP];
+    u64* dirty_bitsets[_FRAME_OVERLAP];
+
+    // Render instances are culled through a bvh, the ones that moved since it was built through a loose grid instead.
+    // Adding or removing rebuilds the bvh, once enough have moved it gets refit
+    vec4* retained_spheres; // Slot -> bounding sphere
+    u64* moved_bitset;
+    u32 moved_count;
+    bool bvh_dirty;
+    Arena* bvh_arena; // Only taken once the batch gets a render instance
+    CullingBvh bvh;
+  };
+
+  //
+  struct RenderInstanceId {
+    u32 material_id;
+    u32 index;
   };
 
   //
@@ -737,13 +861,22 @@ namespace quark {
     u32 last_entity = 0;
     u32* entity_generations = 0;
     u32 entity_capacity = 0;
+    u32 entity_commit_count = 0; // Entities with committed bitsets and generations
     u32 first_empty_entity = 0;
 
+    u32* free_entities = 0;     // Stack of destroyed entity indices to hand out again
+    u32 free_entity_count = 0;
+    u32 next_fresh_entity = 0;  // Entities at or past this have never been created
+
     u32 component_table_count = 0;
     u32 component_table_capacity = 0;
     u64* component_sizes_in_bytes = 0;
+    u64* component_commit_sizes = 0; // Committed bytes of each table in component_datas
+    PageKind* component_page_kinds = 0; // What backs each table in component_datas, see log_ecs_table_info()
     void** component_datas = 0;
     u64** component_bitsets = 0;
+    u64** component_summaries = 0; // One bit per 64-entity word of component_bitsets, set if the word is non-zero
+    u64* used_summary = 0;         // One bit per 64-entity word, set if the word holds any live entity. Finds the tail on destroy
 
     u32 active_flag_id = 0;
     u32 empty_flag_id = 0;
@@ -843,6 +976,12 @@ namespace quark {
     Buffer vertex_uvs_buffer;
     Buffer index_buffer;
 
+    // Uploads, the staging buffer is split into a ring of segments
+    u8* staging_ptr;
+    u32 upload_segment_size;
+    u32 upload_segment_index;
+    UploadSegment upload_segments[UPLOAD_RING_SEGMENT_COUNT];
+
     // Samplers
     Sampler texture_sampler;
 
@@ -891,6 +1030,7 @@ namespace quark {
     Buffer shadow_pass_commands[_FRAME_OVERLAP];
 
     u32 total_draw_count;
+    u32 total_command_count;
     u32 total_culled_count;
     u32 total_triangle_count;
     u32 material_draw_offset[16];
@@ -898,18 +1038,30 @@ namespace quark {
     u32 material_cull_count[16];
 
     u32 shadow_total_draw_count;
+    u32 shadow_total_command_count;
     u32 shadow_total_culled_count;
     u32 shadow_total_triangle_count;
     u32 shadow_draw_offset[16];
     u32 shadow_draw_count[16];
     u32 shadow_cull_count[16];
 
+    // Occlusion culling, occluders get pushed every frame like drawables
+    OcclusionBuffer occlusion_buffer;
+    std::atomic_uint32_t occluder_count;
+    OccluderMesh** occluder_meshes;
+    mat4* occluder_transforms;
+
+    u32 total_occluded_count;
+
     // Statistics
     u32 saved_total_draw_count;
+    u32 saved_total_command_count;
     u32 saved_total_culled_count;
     u32 saved_total_triangle_count;
+    u32 saved_total_occluded_count;
 
     u32 saved_shadow_total_draw_count;
+    u32 saved_shadow_total_command_count;
     u32 saved_shadow_total_culled_count;
     u32 saved_shadow_total_triangle_count;
   );
@@ -981,12 +1133,25 @@ namespace quark {
 // Ecs (ecs.hpp)
 
   engine_var u32 ECS_MAX_STORAGE;
+  engine_var bool ECS_PREFER_LOW_INDICES; // Hand out the lowest free index instead of the most recently freed one, set before init_ecs()
+  engine_var bool ECS_USE_HUGE_PAGES;     // Commit component data in 2MB steps backed by 2MB pages where the OS allows it, set before init_ecs()
   constexpr u32 ECS_ACTIVE_FLAG = 0;
   constexpr u32 ECS_EMPTY_FLAG = 1;
 
 // Renderer (renderer.cpp)
 
   engine_var bool PRINT_PERFORMANCE_STATISTICS;
+  engine_var bool SORT_DRAWS_FRONT_TO_BACK; // Sort forward pass instances and commands near to far so the depth prepass rejects more
+
+  engine_var u32 LOD_CHAIN_LENGTH;       // Lods generated when cooking an .obj, 1 to 4
+  engine_var f32 LOD_CHAIN_RATIOS[4];    // Target index count of each lod relative to the source mesh
+  engine_var f32 LOD_SLOPPY_BELOW_RATIO; // Lods with a smaller ratio use meshopt_simplifySloppy
+  engine_var f32 LOD_PIXEL_ERROR;        // Screen-space error in pixels a lod is allowed to have before a finer one is picked
+
+// Systems (jobs.cpp)
+
+  engine_var bool RUN_SYSTEMS_IN_PARALLEL; // Run non-conflicting systems of a system list at the same time on the job system
+  engine_var bool RUN_BENCHMARKS;          // Plugins only register their benchmark and verification systems when set, the loader sets it with --benchmarks
 
 //
 // Functions (Initialization)
@@ -1075,37 +1240,48 @@ namespace quark {
 
   // Delta time between frames
   inline f32 delta() {
-    return get_resource(TimeInfo)->delta;
+    return get_resource_unchecked(TimeInfo)->delta;
   }
 
   // Total time the program has been running
   //
   // Time is calculated in discrete steps every frame
   inline f32 time() {
-    return get_resource(TimeInfo)->time;
+    return get_resource_unchecked(TimeInfo)->time;
   }
 
 // Ecs (ecs.cpp)
 
   inline void** ecs_component_tables() {
-    return get_resource(EcsContext)->component_datas;
+    return get_resource_unchecked(EcsContext)->component_datas;
   }
 
   inline u64* ecs_component_sizes() {
-    return get_resource(EcsContext)->component_sizes_in_bytes;
+    return get_resource_unchecked(EcsContext)->component_sizes_in_bytes;
   }
 
   inline u32* ecs_entity_generations() {
-    return get_resource(EcsContext)->entity_generations;
+    return get_resource_unchecked(EcsContext)->entity_generations;
   }
 
   inline u64** ecs_bool_table() {
-    return get_resource(EcsContext)->component_bitsets;
+    return get_resource_unchecked(EcsContext)->component_bitsets;
+  }
+
+  inline u64** ecs_summary_table() {
+    return get_resource_unchecked(EcsContext)->component_summaries;
   }
 
   engine_api u32 add_ecs_table(u32 component_size); // Add a new component with the given size. Returns the COMPONENT_ID.
+  engine_api void update_ecs_summaries();           // Rebuild the summary bitsets after the component bitsets were written directly.
+  engine_api void update_ecs_free_entities();       // Rebuild the free entity list after the empty flags were written directly.
+
+  engine_api void commit_ecs_entities(u32 entity_count);               // Make sure the bitsets and generations of every table are backed for entity_count entities.
+  engine_api void commit_ecs_table(u32 component_id, u32 entity_count); // Make sure the data of a component table is backed for entities [0, entity_count), commits up to a high-water mark.
+  engine_api void log_ecs_table_info();                                // Print the committed size and backing page kind of every component table with data.
 
   engine_api EntityId create_entity(bool set_active = true); // Create a new entity returning a unique id.
+  engine_api u32 reserve_entities(u32 count, bool set_active = true); // Create count entities in consecutive never-used slots, returns the first index.
   engine_api void destroy_entity(EntityId id);               // Destroy the entity with the id.
 
 // Bitsets
@@ -1114,6 +1290,8 @@ namespace quark {
   inline void unset_bitset_bit(u64* bitset, u64 index);
   inline void toggle_bitset_bit(u64* bitset, u64 index);
   inline bool is_bitset_bit_set(u64* bitset, u64 index);
+  inline void set_bitset_range(u64* bitset, u64 first, u64 count);
+  inline void unset_bitset_range(u64* bitset, u64 first, u64 count);
 
 // Ecs
 
@@ -1135,6 +1313,9 @@ namespace quark {
   inline void* get_component_unchecked(EntityId entity, u32 component_id);            // Get the data from a component for an entity.
   inline bool has_component_unchecked(EntityId entity, u32 component_id);             // Check if the given entity has the component.
 
+  inline void add_component_range_unchecked(u32 first_index, u32 count, u32 component_id, void* data); // Copy one component into count consecutive entities.
+  inline void add_flag_range_unchecked(u32 first_index, u32 count, u32 component_id);                  // Set a component flag to true for count consecutive entities.
+
   #define add_component(entity, data) add_component_checked(entity, decltype(data)::COMPONENT_ID, &data)
   #define remove_component(entity, type) remove_component_checked(entity, type::COMPONENT_ID)
   #define add_flag(entity, type) add_flag_checked(entity, type::COMPONENT_ID)
@@ -1145,6 +1326,7 @@ namespace quark {
 //
 
   template<typename... T> void add_components(EntityId entity, T... components);
+  template<typename... T> u32 create_entities(u32 count, T... components); // Create count active entities that start with the given components, returns the first index.
   template<typename... T> void remove_components_template(EntityId entity);
   template<typename... T> void add_flags_template(EntityId entity);
   template<typename... T> void remove_flags_template(EntityId entity);
@@ -1159,9 +1341,33 @@ namespace quark {
   #define has_any_components(entity, types...) has_any_components_template<types>(entity)
   #define has_all_components(entity, types...) has_all_components_template<types>(entity)
 
+  // Call f(EntityId, I*...) for every entity that has all of I and none of E
   template <typename... I, typename... E, typename F>
   void for_archetype(Include<I...> incl, Exclude<E...> excl, F f);
 
+  // Call f(first_index, count, I*...) for every run of consecutive matching entities.
+  // The pointers are to the components of the first entity in the run so systems can loop over
+  // ptr[0..count) directly, a fully matching 64-entity word comes through as a single run of 64
+  template <typename... I, typename... E, typename F>
+  void for_archetype_runs(Include<I...> incl, Exclude<E...> excl, F f);
+
+  // Parallel for_archetype_runs(), see for_archetype_par() for group_size
+  template <typename... I, typename... E, typename F>
+  void for_archetype_runs_par(u32 group_size, Include<I...> incl, Exclude<E...> excl, F f);
+
+  // Parallel for_archetype, the 64-entity words are split into groups of group_size words
+  // that get spread across the job workers, a group_size of 0 picks one based on the worker count.
+  // f may run on any worker, so it must only write to the entity it was given
+  template <typename... I, typename... E, typename F>
+  void for_archetype_par(u32 group_size, Include<I...> incl, Exclude<E...> excl, F f);
+
+  // Same as for_archetype_par() but with extra callbacks and a worker index for writing to per-worker outputs.
+  // w(worker_index) runs at the start of every group, g(worker_index, archetype) for every non-empty word
+  // before its entities, and f(worker_index, EntityId, I*...) for every entity.
+  // worker_index is in [0, job_worker_count())
+  template <typename... I, typename... E, typename W, typename G, typename F>
+  void for_archetype_par_grp(u32 group_size, Include<I...> incl, Exclude<E...> excl, W w, G g, F f);
+
   #include "inlines/ecs.hpp"
 
 // Snapshots (snapshots.cpp)
@@ -1170,6 +1376,20 @@ namespace quark {
   engine_api void save_snapshot(const char* file);
   engine_api void load_snapshot(const char* file);
 
+  // Deltas only hold the pages that changed since the last snapshot that was saved or loaded.
+  // Chain them on a keyframe: load_snapshot(keyframe) then load_snapshot_delta() every delta in the order they were saved
+  engine_api void save_snapshot_delta(const char* file);
+  engine_api void load_snapshot_delta(const char* file);
+
+  // Copies the world into memory and leaves compressing and writing to a background thread.
+  // Any other snapshot call waits for the save in flight to finish first, and so does quark_deinit
+  engine_api void save_snapshot_async(const char* file);
+  engine_api bool is_snapshot_save_finished();
+  engine_api void wait_for_snapshot_save();
+
+  engine_var bool SNAPSHOT_KEEP_DELTA_BASE; // Track what changed since the last saved or loaded snapshot. Memory the os can't track writes to keeps a copy to diff against
+  engine_var bool SNAPSHOT_MAPPED; // Save keyframes uncompressed and page aligned so loading copies straight out of a file mapping, files get a lot bigger
+
 // Camera
 
   inline mat4 camera3d_view_mat4(Camera3D* camera);
@@ -1179,10 +1399,49 @@ namespace quark {
   inline FrustumPlanes camera3d_frustum_planes(Camera3D* camera, f32 aspect);
 
   inline f32 plane_point_distance(vec4 plane, vec3 point);
-  inline bool is_sphere_visible(FrustumPlanes* frustum, vec3 position, float radius2);
+  inline bool is_sphere_visible(FrustumPlanes* frustum, vec3 position, float radius);
+
+#ifdef __AVX2__
+  inline u32 are_spheres_visible_8(FrustumPlanes* frustum, __m256 x, __m256 y, __m256 z, __m256 radius); // One bit per visible sphere
+#endif
 
   #include "inlines/cameras.hpp"
 
+// Culling (culling.cpp)
+
+  // Build a bvh over bounding spheres (xyz center, w radius), spheres are referenced by index so the array has to outlive the bvh
+  engine_api void build_culling_bvh(CullingBvh* bvh, Arena* arena, vec4* spheres, u32 sphere_count);
+
+  // Update the node bounds after the spheres moved, the tree gets worse as things move so rebuild every so often
+  engine_api void refit_culling_bvh(CullingBvh* bvh);
+
+  // Set a bit in out_bitset for every visible sphere, whole subtrees get accepted or rejected at once.
+  // Spheres are tested with their radius times radius_scale, which has to be <= 1.
+  // out_bitset has to be zeroed and have room for sphere_count bits, returns the visible count
+  engine_api u32 cull_culling_bvh(CullingBvh* bvh, FrustumPlanes* frustum, f32 radius_scale, u64* out_bitset);
+
+  // Bucket spheres[sphere_indices[i]] into a loose grid. Cheap enough to rebuild every frame for things that move,
+  // the spheres array has to outlive the grid
+  engine_api void build_culling_grid(CullingGrid* grid, Arena* arena, vec4* spheres, u32* sphere_indices, u32 sphere_count, f32 cell_size);
+
+  // Same as cull_culling_bvh(), bits are set at the sphere indices the grid was built with
+  engine_api u32 cull_culling_grid(CullingGrid* grid, FrustumPlanes* frustum, f32 radius_scale, u64* out_bitset);
+
+  // Test every sphere, same output as cull_culling_bvh() up to spheres touching a plane, writes every word of out_bitset
+  engine_api u32 cull_spheres_brute_force(vec4* spheres, u32 sphere_count, FrustumPlanes* frustum, u64* out_bitset);
+
+  // Width and height have to be multiples of OCCLUSION_TILE_WIDTH and OCCLUSION_TILE_HEIGHT
+  engine_api void init_occlusion_buffer(OcclusionBuffer* buffer, Arena* arena, u32 width, u32 height);
+
+  // Reset the depth to infinitely far and set the camera occluders and tests use. Only perspective projections work
+  engine_api void clear_occlusion_buffer(OcclusionBuffer* buffer, mat4* view_projection);
+
+  engine_api void rasterize_occluder(OcclusionBuffer* buffer, OccluderMesh* mesh, mat4* transform);
+
+  // True when every pixel the sphere could cover has an occluder in front of it.
+  // Occluders are sampled at pixel centers, so a sliver thinner than a pixel can still get culled
+  engine_api bool is_sphere_occluded(OcclusionBuffer* buffer, vec3 position, f32 radius);
+
 // Actions (actions.cpp)
 
   engine_api void create_action(const char* action_name, f32 max_value = 1.0f);
@@ -1231,6 +1490,33 @@ namespace quark {
 
   engine_api const char* get_system_name(system_id id);
 
+  // Declare what a system reads and writes so it can run alongside systems it doesn't conflict with.
+  // Two systems conflict when they share an access and at least one of them writes to it.
+  // Systems without declared access conflict with everything and keep running in list order.
+  // Accessing components implies reading the EcsContext, systems that create or destroy entities should write it.
+  // main_thread systems (glfw, vulkan queue submission) always run on the thread running the list.
+  engine_api void set_system_access(const char* system_name, SystemResourceAccess* accesses, usize access_count, bool main_thread = false);
+
+  // In debug builds, panic if the running system didn't declare the access.
+  // get_resource() checks every resource it hands out, component iteration checks writes through non-const pointers
+  engine_api void check_system_access(SystemAccessType type, u64 resource_id, bool const_access);
+
+  template <typename T> SystemResourceAccess resource_access(bool const_access);
+  template <typename T> SystemResourceAccess component_access(bool const_access);
+  inline SystemResourceAccess named_access(const char* name, bool const_access);
+
+  template <typename T> SystemResourceAccess resource_access(bool const_access) {
+    return SystemResourceAccess { SystemAccessType::Resource, (u64)get_resource_unchecked(T), const_access };
+  }
+
+  template <typename T> SystemResourceAccess component_access(bool const_access) {
+    return SystemResourceAccess { SystemAccessType::Component, (u64)&T::COMPONENT_ID, const_access };
+  }
+
+  inline SystemResourceAccess named_access(const char* name, bool const_access) {
+    return SystemResourceAccess { SystemAccessType::Named, (u64)hash_str_fast(name), const_access };
+  }
+
 // States (jobs.cpp)
 
   engine_api void create_state(const char* state_name, const char* init_system_list, const char* update_system_list, const char* deinit_system_list);
@@ -1251,12 +1537,28 @@ namespace quark {
   using AssetFileLoader = void (*)(const char* path, const char* name);
   using AssetFileUnloader = void (*)(const char* path, const char* name, asset_id id);
 
+  // Two phase loaders, load_asset_folder() runs the decoders of a folder on the job system
+  // then the registrars on the calling thread in path order, so asset ids stay deterministic.
+  // Decoders must only allocate from the arena they get, the scratch arenas are shared between threads.
+  // The registrar gets whatever the decoder returned and is optional
+  using AssetFileDecoder = void* (*)(const char* path, const char* name, Arena* arena);
+  using AssetFileRegistrar = void (*)(void* decoded, const char* path, const char* name);
+
   engine_api void add_asset_file_loader(const char* file_extension, AssetFileLoader loader, AssetFileUnloader unloader = 0);
+  engine_api void add_asset_file_decoder(const char* file_extension, AssetFileDecoder decoder, AssetFileRegistrar registrar);
   engine_api void load_asset_folder(const char* folder_path);
 
+  // Files, bytes and time spent per file extension over every load_asset_folder() call
+  engine_var bool PRINT_ASSET_LOAD_STATISTICS;
+  engine_api void print_asset_load_statistics();
+
   engine_api void load_obj_file(const char* path, const char* name);
   engine_api void load_png_file(const char* path, const char* name);
 
+  engine_api void* decode_obj_file(const char* path, const char* name, Arena* arena);
+  engine_api void* decode_png_file(const char* path, const char* name, Arena* arena);
+  engine_api void register_png_file(void* decoded, const char* path, const char* name);
+
   #include "inlines/assets.hpp"
 
 // Buffers (graphics.cpp)
@@ -1368,6 +1670,9 @@ namespace quark {
 
   engine_api void load_qmesh_file(const char* path, const char* name);
   engine_api void load_qmodel_file(const char* path, const char* name);
+
+  engine_api void* decode_qmesh_file(const char* path, const char* name, Arena* arena);
+  engine_api void register_qmesh_file(void* decoded, const char* path, const char* name);
   engine_api void load_vert_shader(const char* path, const char* name);
   engine_api void load_frag_shader(const char* path, const char* name);
 
@@ -1390,6 +1695,16 @@ namespace quark {
   inline void push_drawable_instance(u32 material_id, Drawable* drawable, void* material_instance); // Push a new instance of a drawable onto the render stack
   generic(T) void push_drawable_instance(Drawable* drawable, T* material_instance);                 // Push a new instance of a drawable onto the render stack
 
+  // Render instances are kept across frames, so static things don't have to be pushed every frame.
+  // Not thread safe, so don't add or remove them while drawables are being pushed from jobs
+  engine_api RenderInstanceId add_render_instance(u32 material_id, Drawable* drawable, void* material_instance); // Add a drawable that is drawn every frame until it is removed
+  engine_api void update_render_instance(RenderInstanceId id, Drawable* drawable);                             // Update the transform and model of a render instance
+  engine_api void update_render_instance_material(RenderInstanceId id, void* material_instance);               // Update the material of a render instance
+  engine_api void remove_render_instance(RenderInstanceId id);
+  generic(T) RenderInstanceId add_render_instance(Drawable* drawable, T* material_instance);
+
+  engine_api void push_occluder(OccluderMesh* mesh, mat4* transform); // Push an occluder for this frame, drawables fully behind occluders are left out of the forward pass. Safe to call from jobs, as long as they finish before the frame is drawn
+
   #include "inlines/materials.hpp"
 
 // UI (ui.cpp)
@@ -1410,6 +1725,11 @@ namespace quark {
 
   engine_api MeshInstance create_mesh(vec3* positions, vec3* normals, vec2* uvs, usize vertex_count, u32* indices, usize index_count);
 
+  // Copies are batched per staging segment, so nothing is guaranteed to be on the gpu until flush_uploads().
+  // The frame flushes on its own before building commands
+  engine_api void upload_to_buffer(Buffer* dst, usize dst_offset, void* src, usize size);
+  engine_api void flush_uploads(); // Submit the current batch and wait for every batch in flight
+
 // Sound (sound.cpp)
 
   // The current problem is i want to provide
@@ -7,6 +7,7 @@
 #pragma clang diagnostic ignored "-Weverything"
 
   #include <iostream>
+  #include <cstddef>
 
   #include <VkBootstrap.h>
   #include <tiny_obj_loader.h>
@@ -27,6 +28,12 @@
 
 #define MAX_POINT_LIGHT_COUNT 256
 
+#define MAX_MESH_COUNT 1024
+
+#define MAX_OCCLUDER_COUNT 1024
+#define OCCLUSION_BUFFER_WIDTH 320
+#define OCCLUSION_BUFFER_HEIGHT 180
+
 namespace quark {
   define_resource(Renderer, {});
 
@@ -56,8 +63,8 @@ namespace quark {
 
   void init_renderer_pre_assets() {
     renderer->mesh_counts = 0;
-    renderer->mesh_instances = arena_push_array_zero(global_arena(), MeshInstance, 1024);
-    renderer->mesh_scales = arena_push_array_zero(global_arena(), vec3, 1024);
+    renderer->mesh_instances = arena_push_array_zero(global_arena(), MeshInstance, MAX_MESH_COUNT);
+    renderer->mesh_scales = arena_push_array_zero(global_arena(), vec3, MAX_MESH_COUNT);
 
     renderer->model_counts = 0;
     renderer->model_instances = arena_push_array_zero(global_arena(), ModelInstance, 1024);
@@ -66,7 +73,7 @@ namespace quark {
     {
       BufferInfo info ={
         .type = BufferType::Commands,
-        .size = 1024 * 1024 * sizeof(VkDrawIndexedIndirectCommand),
+        .size = count_of(renderer->infos) * MAX_MESH_COUNT * sizeof(VkDrawIndexedIndirectCommand), // One command per mesh per material
       };
 
       create_buffers(renderer->forward_pass_commands, _FRAME_OVERLAP, &info);
@@ -90,7 +97,12 @@ namespace quark {
       create_buffers(renderer->visible_light_buffers, _FRAME_OVERLAP, &info);
     }
 
-    {
+    init_occlusion_buffer(&renderer->occlusion_buffer, global_arena(), OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT);
+    renderer->occluder_count = 0;
+    renderer->occluder_meshes = arena_push_array_zero(global_arena(), OccluderMesh*, MAX_OCCLUDER_COUNT);
+    renderer->occluder_transforms = arena_push_array_zero(global_arena(), mat4, MAX_OCCLUDER_COUNT);
+
+    if(!HEADLESS) {
       VkDescriptorPoolSize pool_sizes[] = {
         { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4096, },
         { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1024, },
@@ -128,6 +140,25 @@ namespace quark {
     };
     create_buffers(&graphics->staging_buffer, 1, &staging_buffer_info);
 
+    // Stays mapped, uploads write straight into their segment
+    renderer->staging_ptr = (u8*)map_buffer(&graphics->staging_buffer);
+    renderer->upload_segment_size = staging_buffer_info.size / UPLOAD_RING_SEGMENT_COUNT;
+    renderer->upload_segment_index = 0;
+
+    if(!HEADLESS) {
+      VkCommandBuffer commands[UPLOAD_RING_SEGMENT_COUNT];
+      auto command_allocate_info = get_cmd_alloc_info(graphics->transfer_cmd_pool, UPLOAD_RING_SEGMENT_COUNT, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+      vk_check(vkAllocateCommandBuffers(graphics->device, &command_allocate_info, commands));
+
+      VkFenceCreateInfo fence_info = {};
+      fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+      for_every(i, UPLOAD_RING_SEGMENT_COUNT) {
+        renderer->upload_segments[i].commands = commands[i];
+        vk_check(vkCreateFence(graphics->device, &fence_info, 0, &renderer->upload_segments[i].fence));
+      }
+    }
+
     // Info: 1 mil vertices and indices
     u32 vertex_count = 1'000'000;
     u32 index_count = 1'000'000;
@@ -197,6 +228,9 @@ namespace quark {
   }
 
   void init_renderer_post_assets() {
+    // Asset loading leaves the last mesh upload batch open
+    flush_uploads();
+
     // TODO: Should probably update when resolution changes
     // internally we can just re-init this (probably)
     init_render_passes();
@@ -403,6 +437,11 @@ namespace quark {
       update_material(LitColorMaterial, "lit_color", "lit_color", 1024 * 1024, 128);
     }
 
+    // The materials still set up their batches and buffers, there just aren't any pipelines
+    if(HEADLESS) {
+      return;
+    }
+
     // init depth prepass pipelines
     {
       VkDescriptorSetLayout set_layouts[renderer->material_effects[0].resource_bundle.group_count];
@@ -543,33 +582,115 @@ namespace quark {
   LinearAllocationTracker _gpu_vertices_tracker = create_linear_allocation_tracker(100 * MB);
   LinearAllocationTracker _gpu_indices_tracker = create_linear_allocation_tracker(100 * MB);
 
-  MeshInstance create_mesh(vec3* positions, vec3* normals, vec2* uvs, usize vertex_count, u32* indices, usize index_count) {
-    usize vertex_offset = alloc(&_gpu_vertices_tracker, vertex_count);
-    usize index_offset = alloc(&_gpu_indices_tracker, index_count);
+  // Get the current segment ready to record into,
+  // if its last batch is still in flight wait for it since its staging memory gets overwritten
+  static UploadSegment* begin_upload_segment() {
+    UploadSegment* segment = &renderer->upload_segments[renderer->upload_segment_index];
 
-    for_every(i, index_count) {
-      indices[i] += vertex_offset;
+    if(segment->recording) {
+      return segment;
     }
 
-    MeshInstance mesh = {};
-    mesh.count = index_count;
-    mesh.offset = (u32)index_offset;
+    if(segment->in_flight) {
+      vk_check(vkWaitForFences(graphics->device, 1, &segment->fence, true, _OP_TIMEOUT));
+      vk_check(vkResetFences(graphics->device, 1, &segment->fence));
+      segment->in_flight = false;
+    }
 
-    auto copy_into_buffer = [&](Buffer* dst, usize dst_offset, void* src, usize src_size) {
-      VkCommandBuffer commands = begin_quick_commands();
+    if(!HEADLESS) {
+      vk_check(vkResetCommandBuffer(segment->commands, 0));
 
-      write_buffer(&graphics->staging_buffer, 0, src, 0, src_size);
+      VkCommandBufferBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-      copy_buffer(commands, dst, dst_offset, &graphics->staging_buffer, 0, src_size);
+      vk_check(vkBeginCommandBuffer(segment->commands, &begin_info));
+    }
 
-      end_quick_commands(commands);
-    };
+    segment->used = 0;
+    segment->recording = true;
+
+    return segment;
+  }
+
+  static void submit_upload_segment(UploadSegment* segment) {
+    if(!segment->recording) {
+      return;
+    }
+
+    segment->recording = false;
+
+    // Headless copies already happened when they were recorded
+    if(HEADLESS) {
+      return;
+    }
+
+    vk_check(vkEndCommandBuffer(segment->commands));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &segment->commands;
+
+    vk_check(vkQueueSubmit(graphics->transfer_queue, 1, &submit_info, segment->fence));
+    segment->in_flight = true;
+  }
+
+  void upload_to_buffer(Buffer* dst, usize dst_offset, void* src, usize size) {
+    u8* src_bytes = (u8*)src;
+
+    while(size > 0) {
+      UploadSegment* segment = begin_upload_segment();
+      u32 space = renderer->upload_segment_size - segment->used;
+
+      // Full, send it off and move on to the next segment while the gpu copies this one
+      if(space == 0) {
+        submit_upload_segment(segment);
+        renderer->upload_segment_index = (renderer->upload_segment_index + 1) % UPLOAD_RING_SEGMENT_COUNT;
+        continue;
+      }
+
+      u32 chunk_size = size < space ? (u32)size : space;
+      u32 staging_offset = renderer->upload_segment_index * renderer->upload_segment_size + segment->used;
+
+      copy_mem(renderer->staging_ptr + staging_offset, src_bytes, chunk_size);
+      copy_buffer(segment->commands, dst, dst_offset, &graphics->staging_buffer, staging_offset, chunk_size);
+
+      segment->used += chunk_size;
+      src_bytes += chunk_size;
+      dst_offset += chunk_size;
+      size -= chunk_size;
+    }
+  }
+
+  void flush_uploads() {
+    submit_upload_segment(&renderer->upload_segments[renderer->upload_segment_index]);
+
+    for_every(i, UPLOAD_RING_SEGMENT_COUNT) {
+      UploadSegment* segment = &renderer->upload_segments[i];
+
+      if(segment->in_flight) {
+        vk_check(vkWaitForFences(graphics->device, 1, &segment->fence, true, _OP_TIMEOUT));
+        vk_check(vkResetFences(graphics->device, 1, &segment->fence));
+        segment->in_flight = false;
+      }
+    }
+  }
+
+  MeshInstance create_mesh(vec3* positions, vec3* normals, vec2* uvs, usize vertex_count, u32* indices, usize index_count) {
+    usize vertex_offset = alloc(&_gpu_vertices_tracker, vertex_count);
+    usize index_offset = alloc(&_gpu_indices_tracker, index_count);
 
-    copy_into_buffer(&renderer->vertex_positions_buffer, vertex_offset * sizeof(vec3), positions, vertex_count * sizeof(vec3));
-    copy_into_buffer(&renderer->vertex_normals_buffer, vertex_offset * sizeof(vec3), normals, vertex_count * sizeof(vec3));
-    copy_into_buffer(&renderer->vertex_uvs_buffer, vertex_offset * sizeof(vec2), uvs, vertex_count * sizeof(vec2));
+    MeshInstance mesh = {};
+    mesh.count = index_count;
+    mesh.offset = (u32)index_offset;
+    mesh.vertex_offset = (i32)vertex_offset;
+
+    upload_to_buffer(&renderer->vertex_positions_buffer, vertex_offset * sizeof(vec3), positions, vertex_count * sizeof(vec3));
+    upload_to_buffer(&renderer->vertex_normals_buffer, vertex_offset * sizeof(vec3), normals, vertex_count * sizeof(vec3));
+    upload_to_buffer(&renderer->vertex_uvs_buffer, vertex_offset * sizeof(vec2), uvs, vertex_count * sizeof(vec2));
 
-    copy_into_buffer(&renderer->index_buffer, index_offset * sizeof(u32), indices, index_count * sizeof(u32));
+    upload_to_buffer(&renderer->index_buffer, index_offset * sizeof(u32), indices, index_count * sizeof(u32));
 
     return mesh;
   }
@@ -585,6 +706,10 @@ namespace quark {
     effect->resource_bundle.group_count = info->resource_bundle_info.group_count;
     effect->resource_bundle.groups = arena_copy_array(arena, info->resource_bundle_info.groups, ResourceGroup*, info->resource_bundle_info.group_count);
 
+    if(HEADLESS) {
+      return;
+    }
+
     VkPipelineLayoutCreateInfo layout_info = {};
     layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     layout_info.setLayoutCount = info->resource_bundle_info.group_count;
@@ -734,6 +859,10 @@ namespace quark {
   }
 
   void bind_effect(VkCommandBuffer commands, MaterialEffect* effect) {
+    if(HEADLESS) {
+      return;
+    }
+
     vkCmdBindPipeline(graphics->commands[graphics->frame_index], VK_PIPELINE_BIND_POINT_GRAPHICS, effect->pipeline);
     bind_effect_resources(graphics->commands[graphics->frame_index], effect, graphics->frame_index);
   }
@@ -778,6 +907,11 @@ namespace quark {
   void end_main_color_pass() {
     end_render_pass(graphics->commands[graphics->frame_index], graphics->frame_index, &renderer->color_pass);
 
+    // No swapchain to present to
+    if(HEADLESS) {
+      return;
+    }
+
     Image swapchain_image = {
       .image = graphics->swapchain_images[graphics->swapchain_image_index],
       .view = graphics->swapchain_image_views[graphics->swapchain_image_index],
@@ -817,6 +951,7 @@ namespace quark {
   }
 
   bool PRINT_PERFORMANCE_STATISTICS = true;
+  bool SORT_DRAWS_FRONT_TO_BACK = false;
   bool PERFORMANCE_STATISTICS_SHORT = false;
 
   void print_performance_statistics() {
@@ -845,12 +980,15 @@ namespace quark {
         "\n"
         "-- Rendering Info --\n"
         "Forward Pass Draw Count: " + renderer->saved_total_draw_count + "\n"
+        "Forward Pass Command Count: " + renderer->saved_total_command_count + "\n"
         "Forward Pass Cull Count: " + renderer->saved_total_culled_count + "\n"
+        "Forward Pass Occluded Count: " + renderer->saved_total_occluded_count + "\n"
         "Depth Prepass Triangle Count: " + renderer->saved_total_triangle_count + "\n"
         "Forward Pass Triangle Count: " + renderer->saved_total_triangle_count + "\n"
         "Forward Pass Resolution: (" + graphics->render_resolution.x + ", " + graphics->render_resolution.y + ")\n"
         "Forward Pass Msaa: 4x" + "\n"
         "Shadow Pass Draw Count: " + renderer->saved_shadow_total_draw_count + "\n"
+        "Shadow Pass Command Count: " + renderer->saved_shadow_total_command_count + "\n"
         "Shadow Pass Cull Count: " + renderer->saved_shadow_total_culled_count + "\n"
         "Shadow Pass Triangle Count: " + renderer->saved_shadow_total_triangle_count + "\n"
         "Shadow Pass Resolution: (" + renderer->shadow_resolution.x + ", " + renderer->shadow_resolution.y + ")\n"
@@ -886,57 +1024,38 @@ namespace quark {
 
   template <typename T>
   void push_all_renderables_of_material_type() {
-    u32 count = 0;
-    for_archetype(Include<Transform, Model, T> {}, Exclude<> {},
-    [&](EntityId entity_id, Transform* transform, Model* model, T* material) {
-      count += 1;
-    });
-  
-    static thread_local u32 index = 0;
-    static thread_local Drawable* data_a = 0;
-    static thread_local LitColorMaterial* data_b = 0;
-    static thread_local u32 my_index;
-    static std::atomic_uint32_t work_index;
-
-    struct ThreadWork {
-      u32 index = 0;
-      Drawable* data_a = 0;
-      T* data_b = 0;
-      u8 pad[36];
+    // Where each worker is currently writing, padded so workers don't share cache lines
+    struct alignas(64) WorkerOutput {
+      u32 index;
+      Drawable* drawables;
+      T* materials;
     };
 
-    static ThreadWork* thread_work = 0;
-
-    u32 work_count = (count / (64 * 64)) + 1;
+    WorkerOutput* outputs = arena_push_array_zero(frame_arena(), WorkerOutput, job_worker_count());
 
-    thread_work = 0;
-    thread_work = arena_push_array_zero(frame_arena(), ThreadWork, work_count);
+    for_archetype_par_grp(0, Include<Transform, Model, T> {}, Exclude<> {},
+    [&](u32 worker_index) {},
+    [&](u32 worker_index, u64 archetype) {
+      // Reserve space for the whole word at once
+      auto ptrs = push_drawable_instance_n(__builtin_popcountll(archetype), T::MATERIAL_ID);
 
-    work_index = 0;
-
-    for_archetype_par_grp(64, Include<Transform, Model, T> {}, Exclude<> {},
-    [&]() {
-      my_index = work_index.fetch_add(1, std::memory_order_seq_cst);
-    },
-    [&](u64 bitset) {
-      auto ptrs = push_drawable_instance_n(__builtin_popcountll(bitset), T::MATERIAL_ID);
-      thread_work[my_index].data_a = ptrs.drawables;
-      thread_work[my_index].data_b = (T*)ptrs.materials;
-      thread_work[my_index].index = 0;
+      WorkerOutput* output = &outputs[worker_index];
+      output->index = 0;
+      output->drawables = ptrs.drawables;
+      output->materials = (T*)ptrs.materials;
     },
-    [&](EntityId entity_id, Transform* transform, Model* model, T* material) {
-      thread_work[my_index].data_a[thread_work[my_index].index] = Drawable{ *transform, *model };
-      thread_work[my_index].data_b[thread_work[my_index].index] = *material;
-      thread_work[my_index].index += 1;
+    [&](u32 worker_index, EntityId entity_id, const Transform* transform, const Model* model, const T* material) {
+      WorkerOutput* output = &outputs[worker_index];
+      output->drawables[output->index] = Drawable { *transform, *model };
+      output->materials[output->index] = *material;
+      output->index += 1;
     });
   }
 
   void push_renderables() {
-    /*
     push_all_renderables_of_material_type<ColorMaterial>();
     push_all_renderables_of_material_type<TextureMaterial>();
     push_all_renderables_of_material_type<LitColorMaterial>();
-    */
   }
 
 //
@@ -1003,8 +1122,8 @@ namespace quark {
 
       u32 point_light_count = 0;
       for_archetype(Include<Transform, PointLight> {}, Exclude<> {},
-      [&](EntityId id, Transform* transform, PointLight* light) {
-        if(is_sphere_visible(&frustum, transform->position, light->range * light->range)) {
+      [&](EntityId id, const Transform* transform, const PointLight* light) {
+        if(is_sphere_visible(&frustum, transform->position, light->range)) {
           PointLightData data = {};
           data.position = transform->position;
           data.color_combined = light->base_color * light->brightness;
@@ -1029,19 +1148,30 @@ namespace quark {
 // Materials API
 //
 
-  MeshId select_lod(ModelInstance* instance, f32 angular_size) {
+  u32 LOD_CHAIN_LENGTH = 4;
+  f32 LOD_CHAIN_RATIOS[4] = { 1.0f, 0.5f, 0.25f, 0.0625f };
+  f32 LOD_SLOPPY_BELOW_RATIO = 0.2f;
+  f32 LOD_PIXEL_ERROR = 1.0f;
+
+  // Drawables are scaled from normalized mesh units by about sqrt(radius2 / 3),
+  // so a lod is fine when angular_size * error^2 <= 3 * (pixel error in radians)^2
+  static f32 get_lod_error_scale(f32 fov_degrees, f32 resolution_y) {
+    f32 pixel_size = LOD_PIXEL_ERROR * 2.0f * tan(0.5f * rad(fov_degrees)) / resolution_y;
+    return 3.0f * pixel_size * pixel_size;
+  }
+
+  MeshId select_lod(ModelInstance* instance, f32 angular_size, f32 lod_error_scale) {
     u32 index = 0;
 
-    if(instance->angular_thresholds[1] > angular_size) {
-      index = 1;
-    }
-  
-    if(instance->angular_thresholds[2] > angular_size) {
-      index = 2;
-    }
-  
-    if(instance->angular_thresholds[3] > angular_size) {
-      index = 3;
+    for_range(i, 1, 4) {
+      f32 error = instance->lod_errors[i];
+      bool fine_enough = error > 0.0f
+        ? angular_size * error * error <= lod_error_scale
+        : instance->angular_thresholds[i] > angular_size;
+
+      if(fine_enough) {
+        index = i;
+      }
     }
 
     return instance->mesh_ids[index];
@@ -1062,6 +1192,26 @@ namespace quark {
     batch->drawables_batch = (Drawable*)arena_push_zero(global_arena(), info->batch_capacity * sizeof(Drawable));
     batch->materials_batch = arena_push_zero(global_arena(),  info->batch_capacity * info->material_size);
 
+    batch->retained_count = 0;
+    batch->retained_slots = arena_push_array(global_arena(), u32, info->batch_capacity);
+    batch->retained_handles = arena_push_array(global_arena(), u32, info->batch_capacity);
+    batch->handle_count = 0;
+    batch->free_handle_count = 0;
+    batch->free_handles = arena_push_array(global_arena(), u32, info->batch_capacity);
+
+    for_every(frame, _FRAME_OVERLAP) {
+      batch->dirty_counts[frame] = 0;
+      batch->dirty_slots[frame] = arena_push_array(global_arena(), u32, info->batch_capacity);
+      batch->dirty_bitsets[frame] = arena_push_array_zero(global_arena(), u64, info->batch_capacity / 64 + 1);
+    }
+
+    batch->retained_spheres = arena_push_array(global_arena(), vec4, info->batch_capacity);
+    batch->moved_bitset = arena_push_array_zero(global_arena(), u64, info->batch_capacity / 64 + 1);
+    batch->moved_count = 0;
+    batch->bvh_dirty = false;
+    batch->bvh_arena = 0;
+    batch->bvh = {};
+
     return i;
   }
 
@@ -1077,11 +1227,593 @@ namespace quark {
     return i;
   }
 
+//
+// Render Instances
+//
+
+  // Every frame has its own copy of the gpu buffers, so a changed slot has to be uploaded once per frame
+  static void mark_render_instance_dirty(MaterialBatch* batch, u32 slot) {
+    for_every(frame, _FRAME_OVERLAP) {
+      if(!is_bitset_bit_set(batch->dirty_bitsets[frame], slot)) {
+        set_bitset_bit(batch->dirty_bitsets[frame], slot);
+        batch->dirty_slots[frame][batch->dirty_counts[frame]] = slot;
+        batch->dirty_counts[frame] += 1;
+      }
+    }
+  }
+
+  static vec4 get_drawable_sphere(Drawable* drawable) {
+    return as_vec4(drawable->transform.position, length(drawable->model.half_extents));
+  }
+
+  static void move_batch_slot(MaterialBatch* batch, MaterialInfo* info, u32 dst, u32 src) {
+    batch->drawables_batch[dst] = batch->drawables_batch[src];
+    copy_mem(&batch->materials_batch[dst * info->material_size], &batch->materials_batch[src * info->material_size], info->material_size);
+  }
+
+  RenderInstanceId add_render_instance(u32 material_id, Drawable* drawable, void* material_instance) {
+    MaterialBatch* batch = &renderer->batches[material_id];
+    MaterialInfo* info = &renderer->infos[material_id];
+
+    if(batch->batch_count >= info->batch_capacity) {
+      panic("Attempted to add more render instances than a material batch could handle!\n");
+    }
+
+    // Drawables pushed this frame start at retained_count, so move the first one to the end to make room
+    u32 slot = batch->retained_count;
+    if(batch->batch_count > slot) {
+      move_batch_slot(batch, info, batch->batch_count, slot);
+    }
+
+    batch->retained_count += 1;
+    batch->batch_count += 1;
+
+    u32 handle = 0;
+    if(batch->free_handle_count > 0) {
+      batch->free_handle_count -= 1;
+      handle = batch->free_handles[batch->free_handle_count];
+    } else {
+      handle = batch->handle_count;
+      batch->handle_count += 1;
+    }
+
+    batch->retained_slots[handle] = slot;
+    batch->retained_handles[slot] = handle;
+
+    batch->drawables_batch[slot] = *drawable;
+    copy_mem(&batch->materials_batch[slot * info->material_size], material_instance, info->material_size);
+    mark_render_instance_dirty(batch, slot);
+
+    batch->retained_spheres[slot] = get_drawable_sphere(drawable);
+    batch->bvh_dirty = true;
+
+    return RenderInstanceId { material_id, handle };
+  }
+
+  void update_render_instance(RenderInstanceId id, Drawable* drawable) {
+    MaterialBatch* batch = &renderer->batches[id.material_id];
+    u32 slot = batch->retained_slots[id.index];
+
+    batch->drawables_batch[slot] = *drawable;
+    mark_render_instance_dirty(batch, slot);
+
+    batch->retained_spheres[slot] = get_drawable_sphere(drawable);
+    if(!is_bitset_bit_set(batch->moved_bitset, slot)) {
+      set_bitset_bit(batch->moved_bitset, slot);
+      batch->moved_count += 1;
+    }
+  }
+
+  void update_render_instance_material(RenderInstanceId id, void* material_instance) {
+    MaterialBatch* batch = &renderer->batches[id.material_id];
+    MaterialInfo* info = &renderer->infos[id.material_id];
+    u32 slot = batch->retained_slots[id.index];
+
+    copy_mem(&batch->materials_batch[slot * info->material_size], material_instance, info->material_size);
+    mark_render_instance_dirty(batch, slot);
+  }
+
+  void remove_render_instance(RenderInstanceId id) {
+    MaterialBatch* batch = &renderer->batches[id.material_id];
+    MaterialInfo* info = &renderer->infos[id.material_id];
+
+    u32 slot = batch->retained_slots[id.index];
+    u32 last = batch->retained_count - 1;
+
+    // Swap the last render instance into the hole
+    if(slot != last) {
+      move_batch_slot(batch, info, slot, last);
+
+      u32 moved_handle = batch->retained_handles[last];
+      batch->retained_slots[moved_handle] = slot;
+      batch->retained_handles[slot] = moved_handle;
+      mark_render_instance_dirty(batch, slot);
+
+      batch->retained_spheres[slot] = batch->retained_spheres[last];
+    }
+
+    batch->bvh_dirty = true;
+
+    // Then fill the slot it left with the last pushed drawable of this frame
+    batch->retained_count -= 1;
+    batch->batch_count -= 1;
+    if(batch->batch_count > last) {
+      move_batch_slot(batch, info, last, batch->batch_count);
+    }
+
+    batch->free_handles[batch->free_handle_count] = id.index;
+    batch->free_handle_count += 1;
+  }
+
+  void push_occluder(OccluderMesh* mesh, mat4* transform) {
+    // Claim the slot atomically so jobs can push occluders too
+    u32 i = renderer->occluder_count.fetch_add(1, std::memory_order_relaxed);
+
+    if(i >= MAX_OCCLUDER_COUNT) {
+      panic("Attempted to push more than MAX_OCCLUDER_COUNT occluders!\n");
+    }
+
+    renderer->occluder_meshes[i] = mesh;
+    renderer->occluder_transforms[i] = *transform;
+  }
+
+  // Everything a block of drawables needs to cull and build its commands
+  struct BuildCommandsContext {
+    MaterialBatch* batch;
+    MaterialInfo* info;
+
+    u8* material_data;
+    u8* transform_data;
+    u32* instance_data; // Drawable indices grouped by mesh, the shadow pass starts at info->batch_capacity
+
+    FrustumPlanes* main_frustum;
+    FrustumPlanes* shadow_frustum;
+    vec3 camera_position;
+    f32 lod_error_scale;
+
+    OcclusionBuffer* occlusion_buffer; // Null when there are no occluders this frame
+
+    CullingGrid moved_grid; // Render instances that moved since the bvh was built
+
+    u64* bitset;
+    u64* shadow_bitset;
+
+    // Lod picked for every drawable that is visible in either pass
+    u32* mesh_ids;
+
+    // Visible drawables of each mesh per block at [block * mesh_count + mesh],
+    // turned into where each block writes its instances once every block is counted
+    u32 mesh_count;
+    u32* block_mesh_counts;
+    u32* shadow_block_mesh_counts;
+
+    // Only set when SORT_DRAWS_FRONT_TO_BACK is on, otherwise forward_instances is instance_data.
+    // Forward instances get gathered on the cpu, sorted near to far per mesh, then copied over
+    u16* sort_keys; // Quantized camera distance of every drawable
+    u32* forward_instances;
+    u32* sort_scratch;
+    VkDrawIndexedIndirectCommand* unsorted_commands;
+
+    // Already offset to the start of this materials command range
+    VkDrawIndexedIndirectCommand* forward_pass_commands;
+    VkDrawIndexedIndirectCommand* shadow_pass_commands;
+
+    std::atomic_uint32_t draw_count;
+    std::atomic_uint32_t shadow_draw_count;
+    std::atomic_uint32_t occluded_count;
+
+    u32 command_count;
+    u32 shadow_command_count;
+
+    u32 triangle_count;
+    u32 shadow_triangle_count;
+  };
+
+  // Top 16 bits of a positive float sort the same way the float does,
+  // which leaves 7 bits of mantissa so about a 1% step in distance
+  static u16 distance_sort_key(f32 distance2) {
+    u32 bits;
+    copy_mem(&bits, &distance2, sizeof(u32));
+    return (u16)(bits >> 16);
+  }
+
+  // Pick the lod of every drawable visible in either pass and count them per mesh
+  static void count_block_meshes(BuildCommandsContext* ctx, u32 block_index, u32 start, u32 end) {
+    u32* mesh_counts = &ctx->block_mesh_counts[block_index * ctx->mesh_count];
+    u32* shadow_mesh_counts = &ctx->shadow_block_mesh_counts[block_index * ctx->mesh_count];
+
+    for_range(bitset_index, start / 64, (end + 63) / 64) {
+      u64 draw_bits = ctx->bitset[bitset_index];
+      u64 shadow_bits = ctx->shadow_bitset[bitset_index];
+      u64 bits = draw_bits | shadow_bits;
+
+      while(bits != 0) {
+        u64 local_index = __builtin_ctzll(bits);
+        u64 bit = 1ULL << local_index;
+        bits ^= bit;
+
+        u32 index = bitset_index * 64 + local_index;
+        Drawable* drawable = &ctx->batch->drawables_batch[index];
+
+        f32 radius2 = length2(drawable->model.half_extents);
+        f32 distance2 = length2(ctx->camera_position - drawable->transform.position);
+        f32 angular_size = radius2 / distance2;
+
+        ModelInstance* model_instance = &renderer->model_instances[(u32)drawable->model.id];
+        u32 mesh_id = (u32)select_lod(model_instance, angular_size, ctx->lod_error_scale);
+        ctx->mesh_ids[index] = mesh_id;
+
+        if(ctx->sort_keys != 0) {
+          ctx->sort_keys[index] = distance_sort_key(distance2);
+        }
+
+        mesh_counts[mesh_id] += (draw_bits & bit) != 0 ? 1 : 0;
+        shadow_mesh_counts[mesh_id] += (shadow_bits & bit) != 0 ? 1 : 0;
+      }
+    }
+  }
+
+  // Write one command per mesh with instances and turn the per block counts into write offsets.
+  // Instances are ordered by mesh, then block, then drawable index so the output doesn't depend on job timing
+  static u32 write_mesh_commands(BuildCommandsContext* ctx, u32 block_count, u32* block_mesh_counts, VkDrawIndexedIndirectCommand* commands, u32 first_instance, u32* out_triangle_count) {
+    u32 command_count = 0;
+    u32 triangle_count = 0;
+    u32 offset = first_instance;
+
+    for_every(mesh_id, ctx->mesh_count) {
+      u32 mesh_start = offset;
+
+      for_every(block_index, block_count) {
+        u32* count = &block_mesh_counts[block_index * ctx->mesh_count + mesh_id];
+        u32 block_offset = offset;
+        offset += *count;
+        *count = block_offset;
+      }
+
+      u32 instance_count = offset - mesh_start;
+      if(instance_count == 0) {
+        continue;
+      }
+
+      MeshInstance* mesh_instance = &renderer->mesh_instances[mesh_id];
+      triangle_count += (mesh_instance->count / 3) * instance_count;
+
+      commands[command_count] = {
+        .indexCount = mesh_instance->count,
+        .instanceCount = instance_count,
+        .firstIndex = mesh_instance->offset,
+        .vertexOffset = mesh_instance->vertex_offset,
+        .firstInstance = mesh_start, // offset into the instance buffer
+      };
+
+      command_count += 1;
+    }
+
+    *out_triangle_count = triangle_count;
+    return command_count;
+  }
+
+  // Write the drawable indices of the visible drawables in the bitset to their meshes instance range
+  static void write_block_instances(BuildCommandsContext* ctx, u64* bitset, u32* block_mesh_offsets, u32* instances, u32 start, u32 end) {
+    for_range(bitset_index, start / 64, (end + 63) / 64) {
+      u64 bits = bitset[bitset_index];
+
+      while(bits != 0) {
+        u64 local_index = __builtin_ctzll(bits);
+        bits ^= 1ULL << local_index;
+
+        u32 index = bitset_index * 64 + local_index;
+        u32* offset = &block_mesh_offsets[ctx->mesh_ids[index]];
+
+        instances[*offset] = index;
+        *offset += 1;
+      }
+    }
+  }
+
+  // Stable LSD radix sort of values by keys[value], two 8 bit passes so the result ends up back in values.
+  // Being stable keeps equal keys in drawable order so sorted output is still deterministic
+  static void radix_sort_by_key(u32* values, u32* scratch, u32 count, u16* keys) {
+    u32* src = values;
+    u32* dst = scratch;
+
+    for(u32 shift = 0; shift < 16; shift += 8) {
+      u32 offsets[256] = {};
+
+      for_every(i, count) {
+        offsets[(keys[src[i]] >> shift) & 0xff] += 1;
+      }
+
+      u32 sum = 0;
+      for_every(i, 256) {
+        u32 bucket_count = offsets[i];
+        offsets[i] = sum;
+        sum += bucket_count;
+      }
+
+      for_every(i, count) {
+        u32 value = src[i];
+        dst[offsets[(keys[value] >> shift) & 0xff]++] = value;
+      }
+
+      u32* temp = src;
+      src = dst;
+      dst = temp;
+    }
+  }
+
+  // Shadows are cast from slightly shrunk bounds
+  static constexpr f32 SHADOW_RADIUS_SCALE = 0.8f;
+
+  static u64 cull_drawables_scalar(BuildCommandsContext* ctx, u32 start, u32 end, u64* out_shadow_bits) {
+    u64 bits = 0;
+    u64 shadow_bits = 0;
+
+    for_range(index, start, end) {
+      Drawable* drawable = &ctx->batch->drawables_batch[index];
+      f32 radius = length(drawable->model.half_extents);
+      u64 bit = 1ULL << (index % 64);
+
+      if(is_sphere_visible(ctx->main_frustum, drawable->transform.position, radius)) {
+        bits |= bit;
+      }
+
+      if(is_sphere_visible(ctx->shadow_frustum, drawable->transform.position, radius * SHADOW_RADIUS_SCALE)) {
+        shadow_bits |= bit;
+      }
+    }
+
+    *out_shadow_bits = shadow_bits;
+    return bits;
+  }
+
+  // Cull [start, end) against the main and shadow frustums a whole bitset word at a time.
+  // Bits get or'd in so the render instances below start keep theirs, the words have to belong to this block
+  static void cull_drawables(BuildCommandsContext* ctx, u32 start, u32 end, u32* out_draw_count, u32* out_shadow_draw_count) {
+    u32 draw_count = 0;
+    u32 shadow_draw_count = 0;
+
+    for(u32 word_start = start - start % 64; word_start < end; word_start += 64) {
+      u32 word_end = (word_start + 64) < end ? (word_start + 64) : end;
+      u64 bits = 0;
+      u64 shadow_bits = 0;
+      u32 index = word_start > start ? word_start : start;
+
+    #ifdef __AVX2__
+      // Drawables are AoS, gather them into SoA lanes 8 at a time
+      const i32 stride = sizeof(Drawable) / sizeof(f32);
+      const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+      const i32 half_extents_offset = offsetof(Drawable, model) / sizeof(f32);
+
+      for(; index + 8 <= word_end; index += 8) {
+        f32* base = (f32*)&ctx->batch->drawables_batch[index];
+
+        __m256 x = _mm256_i32gather_ps(base + 0, offsets, 4);
+        __m256 y = _mm256_i32gather_ps(base + 1, offsets, 4);
+        __m256 z = _mm256_i32gather_ps(base + 2, offsets, 4);
+
+        __m256 hx = _mm256_i32gather_ps(base + half_extents_offset + 0, offsets, 4);
+        __m256 hy = _mm256_i32gather_ps(base + half_extents_offset + 1, offsets, 4);
+        __m256 hz = _mm256_i32gather_ps(base + half_extents_offset + 2, offsets, 4);
+
+        __m256 radius2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(hx, hx), _mm256_mul_ps(hy, hy)), _mm256_mul_ps(hz, hz));
+        __m256 radius = _mm256_sqrt_ps(radius2);
+        __m256 shadow_radius = _mm256_mul_ps(radius, _mm256_set1_ps(SHADOW_RADIUS_SCALE));
+
+        u64 shift = index - word_start;
+        bits |= (u64)are_spheres_visible_8(ctx->main_frustum, x, y, z, radius) << shift;
+        shadow_bits |= (u64)are_spheres_visible_8(ctx->shadow_frustum, x, y, z, shadow_radius) << shift;
+      }
+    #endif
+
+      // Whatever doesn't fill a full group of 8
+      if(index < word_end) {
+        u64 tail_shadow_bits = 0;
+        bits |= cull_drawables_scalar(ctx, index, word_end, &tail_shadow_bits);
+        shadow_bits |= tail_shadow_bits;
+      }
+
+      ctx->bitset[word_start / 64] |= bits;
+      ctx->shadow_bitset[word_start / 64] |= shadow_bits;
+
+      draw_count += __builtin_popcountll(bits);
+      shadow_draw_count += __builtin_popcountll(shadow_bits);
+    }
+
+    *out_draw_count = draw_count;
+    *out_shadow_draw_count = shadow_draw_count;
+  }
+
+  // Clear the bits of frustum visible drawables that are hidden behind occluders, returns how many were cleared.
+  // Only the forward pass is tested, the occlusion buffer is from the main camera
+  static u32 cull_occluded_drawables(BuildCommandsContext* ctx, u32 start, u32 end) {
+    u32 occluded_count = 0;
+
+    for_range(bitset_index, start / 64, (end + 63) / 64) {
+      u64 bits = ctx->bitset[bitset_index];
+      u64 visible_bits = bits;
+
+      while(bits != 0) {
+        u64 local_index = __builtin_ctzll(bits);
+        bits ^= 1ULL << local_index;
+
+        Drawable* drawable = &ctx->batch->drawables_batch[bitset_index * 64 + local_index];
+        if(is_sphere_occluded(ctx->occlusion_buffer, drawable->transform.position, length(drawable->model.half_extents))) {
+          visible_bits ^= 1ULL << local_index;
+          occluded_count += 1;
+        }
+      }
+
+      ctx->bitset[bitset_index] = visible_bits;
+    }
+
+    return occluded_count;
+  }
+
+  static constexpr f32 RENDER_INSTANCE_GRID_CELL_SIZE = 32.0f;
+
+  // Rebuild the bvh when render instances were added or removed, refit it once enough of them moved.
+  // Everything that moved since then goes in this frames grid
+  static void update_render_instance_culling(BuildCommandsContext* ctx) {
+    MaterialBatch* batch = ctx->batch;
+    u32 retained_count = batch->retained_count;
+
+    bool rebuild = batch->bvh_dirty;
+    bool refit = !rebuild && batch->moved_count > retained_count / 4;
+
+    if(rebuild) {
+      if(batch->bvh_arena == 0) {
+        batch->bvh_arena = get_arena();
+      }
+
+      arena_clear(batch->bvh_arena);
+      build_culling_bvh(&batch->bvh, batch->bvh_arena, batch->retained_spheres, retained_count);
+    } else if(refit) {
+      refit_culling_bvh(&batch->bvh);
+    }
+
+    if(rebuild || refit) {
+      zero_mem(batch->moved_bitset, (ctx->info->batch_capacity / 64 + 1) * sizeof(u64));
+      batch->moved_count = 0;
+      batch->bvh_dirty = false;
+    }
+
+    u32* moved = arena_push_array(frame_arena(), u32, batch->moved_count);
+    u32 moved_count = 0;
+
+    for_every(word_index, (retained_count + 63) / 64) {
+      u64 bits = batch->moved_bitset[word_index];
+
+      while(bits != 0) {
+        u64 local_index = __builtin_ctzll(bits);
+        bits ^= 1ULL << local_index;
+
+        moved[moved_count] = word_index * 64 + local_index;
+        moved_count += 1;
+      }
+    }
+
+    build_culling_grid(&ctx->moved_grid, frame_arena(), batch->retained_spheres, moved, moved_count, RENDER_INSTANCE_GRID_CELL_SIZE);
+  }
+
+  // Cull the render instances against one frustum, this runs before the blocks so they only have to cull pushed drawables
+  static void cull_render_instances(BuildCommandsContext* ctx, FrustumPlanes* frustum, f32 radius_scale, u64* bitset, std::atomic_uint32_t* draw_count) {
+    MaterialBatch* batch = ctx->batch;
+    u32 word_count = (batch->retained_count + 63) / 64;
+
+    cull_culling_bvh(&batch->bvh, frustum, radius_scale, bitset);
+
+    // The bvh still has the moved ones where they were when it was built
+    if(ctx->moved_grid.sphere_count != 0) {
+      for_every(i, word_count) {
+        bitset[i] &= ~batch->moved_bitset[i];
+      }
+
+      cull_culling_grid(&ctx->moved_grid, frustum, radius_scale, bitset);
+    }
+
+    u32 visible_count = 0;
+    for_every(i, word_count) {
+      visible_count += __builtin_popcountll(bitset[i]);
+    }
+
+    draw_count->fetch_add(visible_count, std::memory_order_relaxed);
+  }
+
+  static void cull_material_block(BuildCommandsContext* ctx, u32 block_index, u32 start, u32 end) {
+    // Copy the pushed drawables to the gpu, render instances only upload their dirty slots
+    u32 pushed_start = start > ctx->batch->retained_count ? start : ctx->batch->retained_count;
+    if(pushed_start < end) {
+      u32 count = end - pushed_start;
+
+      // "Drawawbles" map directly to "Transforms" on the shader side of things
+      usize transforms_size = sizeof(Drawable) * count;
+      usize materials_size = ctx->info->material_size * count;
+
+      usize transforms_offset = sizeof(Drawable) * pushed_start;
+      usize materials_offset = ctx->info->material_size * pushed_start;
+
+      u8* transforms = (u8*)ctx->batch->drawables_batch + transforms_offset;
+      u8* materials = ctx->batch->materials_batch + materials_offset;
+
+      // Copy data from buffers to gpu
+      copy_mem(ctx->transform_data + transforms_offset, transforms, transforms_size);
+      copy_mem(ctx->material_data + materials_offset, materials, materials_size);
+    }
+
+    // Write bitset jump list, render instances were already culled by cull_render_instances()
+    u32 material_draw_count = 0;
+    u32 shadow_draw_count = 0;
+    if(pushed_start < end) {
+      cull_drawables(ctx, pushed_start, end, &material_draw_count, &shadow_draw_count);
+    }
+
+    ctx->draw_count.fetch_add(material_draw_count, std::memory_order_relaxed);
+    ctx->shadow_draw_count.fetch_add(shadow_draw_count, std::memory_order_relaxed);
+
+    // Occlusion covers the render instances too, their visible count went into draw_count in cull_render_instances()
+    if(ctx->occlusion_buffer != 0) {
+      u32 occluded_count = cull_occluded_drawables(ctx, start, end);
+      ctx->draw_count.fetch_sub(occluded_count, std::memory_order_relaxed);
+      ctx->occluded_count.fetch_add(occluded_count, std::memory_order_relaxed);
+    }
+
+    count_block_meshes(ctx, block_index, start, end);
+  }
+
+  // Upload the render instances that changed since this frames buffers were last written
+  static void upload_dirty_render_instances(BuildCommandsContext* ctx, u32* dirty_slots, u32 start, u32 end) {
+    u32 material_size = ctx->info->material_size;
+
+    for_range(i, start, end) {
+      u32 slot = dirty_slots[i];
+
+      // Removed since it was marked, so it's a pushed drawable now and gets copied with those
+      if(slot >= ctx->batch->retained_count) {
+        continue;
+      }
+
+      copy_mem(ctx->transform_data + sizeof(Drawable) * slot, &ctx->batch->drawables_batch[slot], sizeof(Drawable));
+      copy_mem(ctx->material_data + material_size * slot, ctx->batch->materials_batch + material_size * slot, material_size);
+    }
+  }
+
+  static void write_material_block_instances(BuildCommandsContext* ctx, u32 block_index, u32 start, u32 end) {
+    write_block_instances(ctx, ctx->bitset, &ctx->block_mesh_counts[block_index * ctx->mesh_count], ctx->forward_instances, start, end);
+    write_block_instances(ctx, ctx->shadow_bitset, &ctx->shadow_block_mesh_counts[block_index * ctx->mesh_count], ctx->instance_data, start, end);
+  }
+
+  // Sort one meshes forward instances near to far and copy them to the instance buffer
+  static void sort_mesh_instances(BuildCommandsContext* ctx, u32 first, u32 count) {
+    radix_sort_by_key(&ctx->forward_instances[first], &ctx->sort_scratch[first], count, ctx->sort_keys);
+    copy_mem(&ctx->instance_data[first], &ctx->forward_instances[first], count * sizeof(u32));
+  }
+
+  // Order the commands by their nearest instance, instances are already sorted so that's the first one
+  static void sort_mesh_commands(BuildCommandsContext* ctx) {
+    u32 count = ctx->command_count;
+    u16* command_keys = arena_push_array(frame_arena(), u16, count);
+    u32* order = arena_push_array(frame_arena(), u32, count);
+    u32* scratch = arena_push_array(frame_arena(), u32, count);
+
+    for_every(i, count) {
+      command_keys[i] = ctx->sort_keys[ctx->forward_instances[ctx->unsorted_commands[i].firstInstance]];
+      order[i] = i;
+    }
+
+    radix_sort_by_key(order, scratch, count, command_keys);
+
+    for_every(i, count) {
+      ctx->forward_pass_commands[i] = ctx->unsorted_commands[order[i]];
+    }
+  }
+
   void build_material_batch_commands() {
+    // Meshes created since last frame have to land before anything draws them
+    flush_uploads();
+
     FrustumPlanes main_frustum = camera3d_frustum_planes(get_resource(MainCamera), get_window_aspect());
     FrustumPlanes shadow_frustum = camera3d_frustum_planes(get_resource(SunCamera), 1);
-
-    VkCommandBuffer commands = graphics->commands[graphics->frame_index];
   
     VkDrawIndexedIndirectCommand* forward_pass_commands = (VkDrawIndexedIndirectCommand*)map_buffer(&renderer->forward_pass_commands[graphics->frame_index]);
     defer(unmap_buffer(&renderer->forward_pass_commands[graphics->frame_index]));
@@ -1089,9 +1821,31 @@ namespace quark {
     VkDrawIndexedIndirectCommand* shadow_pass_commands = (VkDrawIndexedIndirectCommand*)map_buffer(&renderer->shadow_pass_commands[graphics->frame_index]);
     defer(unmap_buffer(&renderer->shadow_pass_commands[graphics->frame_index]));
 
-    u32 frame_index = graphics->frame_index;
+    // Rasterize this frames occluders before any commands get written.
+    // The buffer stores 1 / w which is constant for orthographic cameras, so those skip it
+    OcclusionBuffer* occlusion_buffer = 0;
+    u32 occluder_count = renderer->occluder_count.load(std::memory_order_relaxed);
+    if(occluder_count > 0 && get_resource(MainCamera)->projection_type == ProjectionType::Perspective) {
+      occlusion_buffer = &renderer->occlusion_buffer;
+      clear_occlusion_buffer(occlusion_buffer, get_resource_as(MainCameraViewProj, mat4));
+
+      for_every(i, occluder_count) {
+        rasterize_occluder(occlusion_buffer, renderer->occluder_meshes[i], &renderer->occluder_transforms[i]);
+      }
+    }
+
+    // Blocks are a multiple of 64 so two blocks never write to the same bitset word
+    const u32 block_size = 2048;
+    static_assert(block_size % 64 == 0);
+
+    BuildCommandsContext* contexts = arena_push_array_zero(frame_arena(), BuildCommandsContext, renderer->materials_count);
+    JobCounter counter = {};
+
+    // Every material gets a command range with room for one command per mesh up front,
+    // so all of the materials can be culled at the same time instead of one after another
+    u32 command_offset = 0;
+    u32 mesh_count = renderer->mesh_counts;
 
-    // Loop through material batches and copy data to gpu and build indirect commands
     for_every(i, renderer->materials_count) {
       MaterialInfo* info = &renderer->infos[i];
       MaterialBatch* batch = &renderer->batches[i];
@@ -1110,354 +1864,200 @@ namespace quark {
         copy_mem(ptr, material_world_ptr, material_world_size);
         unmap_buffer(material_world_buffer);
       }
-    
-      // Map data buffers
-      u8* material_data = (u8*)map_buffer(&info->material_buffers[graphics->frame_index]);
-      defer(unmap_buffer(&info->material_buffers[graphics->frame_index]));
 
-      u8* transform_data = (u8*)map_buffer(&info->transform_buffers[graphics->frame_index]);
-      defer(unmap_buffer(&info->transform_buffers[graphics->frame_index]));
+      u32 batch_count = (u32)batch->batch_count;
+
+      BuildCommandsContext* ctx = &contexts[i];
+      ctx->batch = batch;
+      ctx->info = info;
+
+      // Map data buffers, these get unmapped once all of the jobs are done
+      ctx->material_data = (u8*)map_buffer(&info->material_buffers[graphics->frame_index]);
+      ctx->transform_data = (u8*)map_buffer(&info->transform_buffers[graphics->frame_index]);
+      ctx->instance_data = (u32*)map_buffer(&info->instance_buffers[graphics->frame_index]);
+
+      ctx->main_frustum = &main_frustum;
+      ctx->shadow_frustum = &shadow_frustum;
+      ctx->camera_position = get_resource(MainCamera)->position;
+      ctx->lod_error_scale = get_lod_error_scale(get_resource(MainCamera)->fov, (f32)graphics->render_resolution.y);
+      ctx->occlusion_buffer = occlusion_buffer;
+
+      ctx->bitset = arena_push_array_zero(frame_arena(), u64, batch_count / 64 + 1);
+      ctx->shadow_bitset = arena_push_array_zero(frame_arena(), u64, batch_count / 64 + 1);
+
+      u32 block_count = (batch_count + block_size - 1) / block_size;
+      ctx->mesh_ids = arena_push_array(frame_arena(), u32, batch_count);
+      ctx->mesh_count = mesh_count;
+      ctx->block_mesh_counts = arena_push_array_zero(frame_arena(), u32, block_count * mesh_count);
+      ctx->shadow_block_mesh_counts = arena_push_array_zero(frame_arena(), u32, block_count * mesh_count);
+
+      if(SORT_DRAWS_FRONT_TO_BACK) {
+        ctx->sort_keys = arena_push_array(frame_arena(), u16, batch_count);
+        ctx->forward_instances = arena_push_array(frame_arena(), u32, batch_count);
+        ctx->sort_scratch = arena_push_array(frame_arena(), u32, batch_count);
+        ctx->unsorted_commands = arena_push_array(frame_arena(), VkDrawIndexedIndirectCommand, mesh_count);
+      } else {
+        ctx->forward_instances = ctx->instance_data;
+      }
 
-      // Build commands
-      u32 batch_count = (i32)batch->batch_count;
-      const u32 block_size = 2048;
+      ctx->forward_pass_commands = forward_pass_commands + command_offset;
+      ctx->shadow_pass_commands = shadow_pass_commands + command_offset;
 
-      // Make sure blocks are large enough to prevent multi-threading issues
-      assert(block_size > 32);
+      renderer->material_draw_offset[i] = command_offset;
+      renderer->shadow_draw_offset[i] = command_offset;
+      command_offset += mesh_count;
 
-      // Multi-threaded
-      // if(batch_count >= block_size * 2) {
-        struct ThreadWork {
-          u64 start;
-          u64 end;
-        };
+      if(batch->retained_count > 0 || batch->bvh_dirty) {
+        update_render_instance_culling(ctx);
+      }
 
-        // TODO: this is in need of some kind of better structure for doing this kind of thing.
-        // For now this is okay.
-        //
-        // All of the vars needed for building the commands
-        // These need to be moved into some kind of unified structure in the future
-        // that gets passed by ptr.
-        static std::atomic_uint32_t total_material_draw_count = 0;
-        static std::atomic_uint32_t total_shadow_draw_count = 0;
-      
-        static std::atomic_uint32_t total_material_triangle_count = 0;
-        static std::atomic_uint32_t total_shadow_triangle_count = 0;
-  
-        static u32 work_count = 0;
-        static ThreadWork* work = 0;
-        static std::atomic_uint32_t work_index = 0;
+      if(batch->retained_count > 0) {
+        job_spawn(&counter, [ctx]() {
+          cull_render_instances(ctx, ctx->main_frustum, 1.0f, ctx->bitset, &ctx->draw_count);
+        });
 
-        static u64* bitset = 0;
-        static u64* shadow_bitset = 0;
+        job_spawn(&counter, [ctx]() {
+          cull_render_instances(ctx, ctx->shadow_frustum, SHADOW_RADIUS_SCALE, ctx->shadow_bitset, &ctx->shadow_draw_count);
+        });
+      }
 
-        static FrustumPlanes* main_frustum_ptr = 0;
-        static FrustumPlanes* shadow_frustum_ptr = 0;
-      
-        static VkDrawIndexedIndirectCommand* forward_pass_commands_ptr = 0;
-        static VkDrawIndexedIndirectCommand* shadow_pass_commands_ptr = 0;
+      u32 dirty_count = batch->dirty_counts[graphics->frame_index];
+      u32* dirty_slots = batch->dirty_slots[graphics->frame_index];
 
-        static MaterialBatch* batch_ptr = 0;
-        static MaterialInfo* info_ptr = 0;
+      for(u32 start = 0; start < dirty_count; start += block_size) {
+        u32 end = (start + block_size) < dirty_count ? (start + block_size) : dirty_count;
 
-        static u8* material_data_ptr = 0;
-        static u8* transform_data_ptr = 0;
+        job_spawn(&counter, [ctx, dirty_slots, start, end]() {
+          upload_dirty_render_instances(ctx, dirty_slots, start, end);
+        });
+      }
+    }
 
-        // Init the vars for the current material
-        total_material_draw_count = 0;
-        total_shadow_draw_count = 0;
-      
-        total_material_triangle_count = 0;
-        total_shadow_triangle_count = 0;
+    job_wait(&counter);
 
-        work_count = batch_count / block_size + 1;
-        work = arena_push_array_zero(frame_arena(), ThreadWork, work_count);
-        work_index = 0;
+    // Pushed drawables, render instance bits are in by now
+    for_every(i, renderer->materials_count) {
+      MaterialBatch* batch = &renderer->batches[i];
+      BuildCommandsContext* ctx = &contexts[i];
 
-        bitset = arena_push_array_zero(frame_arena(), u64, batch_count / 64 + 1);
-        shadow_bitset = arena_push_array_zero(frame_arena(), u64, batch_count / 64 + 1);
+      if(batch->batch_count == 0) {
+        continue;
+      }
 
-        main_frustum_ptr = &main_frustum;
-        shadow_frustum_ptr = &shadow_frustum;
+      u32 batch_count = (u32)batch->batch_count;
+      u32 block_count = (batch_count + block_size - 1) / block_size;
 
-        forward_pass_commands_ptr = forward_pass_commands;
-        shadow_pass_commands_ptr = shadow_pass_commands;
+      for_every(block_index, block_count) {
+        u32 start = block_index * block_size;
+        u32 end = (start + block_size) < batch_count ? (start + block_size) : batch_count;
 
-        batch_ptr = batch;
-        info_ptr = info;
-      
-        material_data_ptr = material_data;
-        transform_data_ptr = transform_data;
+        job_spawn(&counter, [ctx, block_index, start, end]() {
+          cull_material_block(ctx, block_index, start, end);
+        });
+      }
+    }
 
-        // Build work commands
-        for_every(i, work_count) {
-          work[i].start = i * block_size;
-          work[i].end = (i + 1) * block_size;
-        }
+    job_wait(&counter);
 
-        work[work_count - 1].end = batch_count;
-
-        // Issue work commands
-        for_every(i, work_count) {
-          thread_pool_push([]() {
-            // Grab our work
-            u32 work_i = work_index.fetch_add(1, std::memory_order_seq_cst);
-            if(work_i >= work_count) {
-              return;
-            }
-
-            ThreadWork my_work = work[work_i];
-
-            // Copy material data to gpu
-            {
-              u32 count = my_work.end - my_work.start;
-
-              // "Drawawbles" map directly to "Transforms" on the shader side of things
-              usize transforms_size = sizeof(Drawable) * count;
-              usize materials_size = info_ptr->material_size * count;
-
-              usize transforms_offset = sizeof(Drawable) * my_work.start;
-              usize materials_offset = info_ptr->material_size * my_work.start;
-
-              u8* transforms = (u8*)batch_ptr->drawables_batch + transforms_offset;
-              u8* materials = batch_ptr->materials_batch + materials_offset;
-
-              // Copy data from buffers to gpu
-              copy_mem(transform_data_ptr + transforms_offset, transforms, transforms_size);
-              copy_mem(material_data_ptr + materials_offset, materials, materials_size);
-            }
-
-            // printf("time: %lf\n", total_time);
-
-            u32 material_draw_count = 0;
-            u32 shadow_draw_count = 0;
-
-            // Write bitset jump list
-            for_range(index, my_work.start, my_work.end) {
-              Drawable* drawable = &batch_ptr->drawables_batch[index];
-              // MeshInstance* mesh_instance = &renderer->mesh_instances[(u32)drawable->model.id];
-              // MeshInstance* mesh_instance = &renderer->mesh_instances[(u32)drawable->model.id];
-
-              // Check for frustum culling
-              f32 radius2 = length(drawable->model.half_extents) * 1.0f;
-
-              if(!is_sphere_visible(main_frustum_ptr, drawable->transform.position, radius2 * radius2)) {
-                unset_bitset_bit(bitset, index);
-              } else {
-                set_bitset_bit(bitset, index);
-                material_draw_count += 1;
-              }
-
-              radius2 *= 0.8f;
-              if(!is_sphere_visible(shadow_frustum_ptr, drawable->transform.position, radius2 * radius2)) {
-                unset_bitset_bit(shadow_bitset, index);
-              } else {
-                set_bitset_bit(shadow_bitset, index);
-                shadow_draw_count += 1;
-              }
-            }
-
-            // Count how many things we have
-            // u32 material_draw_count = 0;
-            // for_range(bitset_index, my_work.start / 32, my_work.end / 32) {
-            //   material_draw_count += __builtin_popcount(bitset[bitset_index]);
-            // }
-
-            // Assert that our calculated draw count is correct
-            // #ifdef DEBUG
-            // if(material_draw_count != true_draw_count) {
-            //   panic("True draw count: " + true_draw_count + ", Calculated draw count: " + material_draw_count + "\n");
-            // }
-            // #endif
-
-            u32 material_start = total_material_draw_count.fetch_add(material_draw_count, std::memory_order_seq_cst);
-            u32 material_offset = 0;
-            u32 material_triangle_count = 0;
-
-            // if(work_i == work_count - 1) {
-            //   my_work.end += 64;
-            // }
-
-            // Walk the jumplist and push commands
-            for_range(bitset_index, my_work.start / 64, my_work.end / 64) {
-              u64 bits = bitset[bitset_index];
-              u64 global_index = bitset_index * 64;
-
-              // Loop unculled objects
-              while(bits != 0) {
-                u64 local_index = __builtin_ctzll(bits);
-                bits ^= 1ULL << local_index;
-
-                u32 index = global_index + local_index;
-
-                Drawable* drawable = &batch_ptr->drawables_batch[index];
-
-                f32 radius2 = length2(drawable->model.half_extents);
-                f32 distance2 = length2(get_resource(MainCamera)->position - drawable->transform.position);
-                f32 angular_size = radius2 / distance2;
-
-                ModelInstance* model_instance = &renderer->model_instances[(u32)drawable->model.id];
-                MeshId lod_id = select_lod(model_instance, angular_size);
-                MeshInstance* mesh_instance = &renderer->mesh_instances[(u32)lod_id];
-
-                material_triangle_count += (mesh_instance->count / 3);
-
-                forward_pass_commands_ptr[renderer->total_draw_count + material_start + material_offset] = {
-                  .indexCount = mesh_instance->count,
-                  .instanceCount = 1,
-                  .firstIndex = mesh_instance->offset,
-                  .vertexOffset = 0,
-                  .firstInstance = index, // material index
-                };
-
-                material_offset += 1;
-              }
-            }
-
-            total_material_triangle_count.fetch_add(material_triangle_count, std::memory_order_seq_cst);
-        
-            u32 shadow_start = total_shadow_draw_count.fetch_add(shadow_draw_count, std::memory_order_seq_cst);
-            u32 shadow_local_offset = 0;
-            u32 shadow_triangle_count = 0;
-
-            // Move through the jumplist and push commands
-            for_range(bitset_index, my_work.start / 64, my_work.end / 64) {
-              u64 bits = shadow_bitset[bitset_index];
-              u64 global_index = bitset_index * 64;
-
-              // Loop unculled objects
-              while(bits != 0) {
-                u64 local_index = __builtin_ctzll(bits);
-                bits ^= 1ULL << local_index;
-
-                u32 index = global_index + local_index;
-
-                Drawable* drawable = &batch_ptr->drawables_batch[index];
-
-                f32 radius2 = length2(drawable->model.half_extents);
-                f32 distance2 = length2(get_resource(MainCamera)->position - drawable->transform.position);
-                f32 angular_size = radius2 / distance2;
-
-                ModelInstance* model_instance = &renderer->model_instances[(u32)drawable->model.id];
-                MeshId lod_id = select_lod(model_instance, angular_size);
-                MeshInstance* mesh_instance = &renderer->mesh_instances[(u32)lod_id];
-
-                shadow_triangle_count += (mesh_instance->count / 3);
-
-                shadow_pass_commands_ptr[renderer->shadow_total_draw_count + shadow_start + shadow_local_offset] = {
-                  .indexCount = mesh_instance->count,
-                  .instanceCount = 1,
-                  .firstIndex = mesh_instance->offset,
-                  .vertexOffset = 0,
-                  .firstInstance = index, // material index
-                };
-
-                shadow_local_offset += 1;
-              }
-            }
-          
-            total_shadow_triangle_count.fetch_add(shadow_triangle_count, std::memory_order_seq_cst);
-          });
-        }
+    // Once every block is counted each mesh knows its instance range, then the blocks fill them in
+    for_every(i, renderer->materials_count) {
+      MaterialInfo* info = &renderer->infos[i];
+      MaterialBatch* batch = &renderer->batches[i];
+      BuildCommandsContext* ctx = &contexts[i];
 
-        thread_pool_join();
-
-        // Update values
-        renderer->material_draw_offset[i] = renderer->total_draw_count;
-        renderer->total_draw_count += total_material_draw_count.load();
-        renderer->material_draw_count[i] = total_material_draw_count.load();
-        renderer->material_cull_count[i] = batch_count - renderer->material_draw_count[i];
-        renderer->total_culled_count += renderer->material_cull_count[i];
-        renderer->total_triangle_count += total_material_triangle_count.load();
-
-        renderer->shadow_draw_offset[i] = renderer->shadow_total_draw_count;
-        renderer->shadow_total_draw_count += total_shadow_draw_count.load();
-        renderer->shadow_draw_count[i] = total_shadow_draw_count.load();
-        renderer->shadow_cull_count[i] = batch_count - renderer->shadow_draw_count[i];
-        renderer->shadow_total_culled_count += renderer->shadow_cull_count[i];
-        renderer->shadow_total_triangle_count += total_shadow_triangle_count.load();
+      if(batch->batch_count == 0) {
+        continue;
       }
 
-      // printf("lksjdflkjsdflkj\n");
+      u32 batch_count = (u32)batch->batch_count;
+      u32 block_count = (batch_count + block_size - 1) / block_size;
 
-      // Build commands single-threaded
-      /* else {
-        // Copy material data to gpu
-        {
-          Drawable* transforms = batch->drawables_batch; // "Drawawbles" map directly to "Transforms" on the shader side of things
-          u8* materials = batch->materials_batch;
+      VkDrawIndexedIndirectCommand* forward_commands = ctx->unsorted_commands != 0 ? ctx->unsorted_commands : ctx->forward_pass_commands;
+      ctx->command_count = write_mesh_commands(ctx, block_count, ctx->block_mesh_counts, forward_commands, 0, &ctx->triangle_count);
+      ctx->shadow_command_count = write_mesh_commands(ctx, block_count, ctx->shadow_block_mesh_counts, ctx->shadow_pass_commands, info->batch_capacity, &ctx->shadow_triangle_count);
 
-          usize transforms_size = sizeof(Drawable) * batch->batch_count;
-          usize materials_size = info->material_size * batch->batch_count;
+      for_every(block_index, block_count) {
+        u32 start = block_index * block_size;
+        u32 end = (start + block_size) < batch_count ? (start + block_size) : batch_count;
 
-          // Copy data from buffers to gpu
+        job_spawn(&counter, [ctx, block_index, start, end]() {
+          write_material_block_instances(ctx, block_index, start, end);
+        });
+      }
+    }
 
-          copy_mem(transform_data, transforms, transforms_size);
-          copy_mem(material_data, materials, materials_size);
-        }
-      
-        // Write forward pass commands
-        for_iter(u32, index, 0, batch->batch_count) {
-          Drawable* drawable = &batch->drawables_batch[index];
-          MeshInstance* mesh_instance = &renderer->mesh_instances[(u32)drawable->model.id];
-
-          // Check for frustum culling
-          f32 radius2 = length2(drawable->model.half_extents) * 2.0f;
-          if(!is_sphere_visible(&main_frustum, drawable->transform.position, radius2)) {
-            renderer->material_cull_count[i] += 1;
-            continue;
-          }
-
-          renderer->total_triangle_count += (mesh_instance->count / 3);
-
-          forward_pass_commands[renderer->total_draw_count + renderer->material_draw_count[i]] = {
-            .indexCount = mesh_instance->count,
-            .instanceCount = 1,
-            .firstIndex = mesh_instance->offset,
-            .vertexOffset = 0,
-            .firstInstance = index, // material index
-          };
-
-          renderer->material_draw_count[i] += 1;
+    job_wait(&counter);
+
+    // Sort every meshes instances near to far, then the commands by their nearest instance.
+    // Materials and lods are already grouped by the commands so distance is all that is left to sort by
+    if(SORT_DRAWS_FRONT_TO_BACK) {
+      for_every(i, renderer->materials_count) {
+        BuildCommandsContext* ctx = &contexts[i];
+
+        for_every(command_index, ctx->command_count) {
+          u32 first = ctx->unsorted_commands[command_index].firstInstance;
+          u32 count = ctx->unsorted_commands[command_index].instanceCount;
+
+          job_spawn(&counter, [ctx, first, count]() {
+            sort_mesh_instances(ctx, first, count);
+          });
         }
+      }
 
-        renderer->material_draw_offset[i] = renderer->total_draw_count;
-        renderer->total_draw_count += renderer->material_draw_count[i];
-        renderer->total_culled_count += renderer->material_cull_count[i];
-
-        // Write shadow pass commands
-        for_iter(u32, index, 0, batch->batch_count) {
-          Drawable* drawable = &batch->drawables_batch[index];
-          MeshInstance* mesh_instance = &renderer->mesh_instances[(u32)drawable->model.id];
-
-          // Check for frustum culling
-          f32 radius2 = length2(drawable->model.half_extents) * 2.0f;
-          if(!is_sphere_visible(&shadow_frustum, drawable->transform.position, radius2)) {
-            renderer->shadow_cull_count[i] += 1;
-            continue;
-          }
-
-          renderer->shadow_total_triangle_count += (mesh_instance->count / 3);
-
-          shadow_pass_commands[renderer->shadow_total_draw_count + renderer->shadow_draw_count[i]] = {
-            .indexCount = mesh_instance->count,
-            .instanceCount = 1,
-            .firstIndex = mesh_instance->offset,
-            .vertexOffset = 0,
-            .firstInstance = index, // material index
-          };
-
-          renderer->shadow_draw_count[i] += 1;
+      job_wait(&counter);
+
+      for_every(i, renderer->materials_count) {
+        if(contexts[i].command_count > 0) {
+          sort_mesh_commands(&contexts[i]);
         }
+      }
+    }
 
-        renderer->shadow_draw_offset[i] = renderer->shadow_total_draw_count;
-        renderer->shadow_total_draw_count += renderer->shadow_draw_count[i];
-        renderer->shadow_total_culled_count += renderer->shadow_cull_count[i];
+    // Update values
+    for_every(i, renderer->materials_count) {
+      MaterialInfo* info = &renderer->infos[i];
+      MaterialBatch* batch = &renderer->batches[i];
+      BuildCommandsContext* ctx = &contexts[i];
+
+      if(batch->batch_count == 0) {
+        continue;
       }
-    } */
+
+      unmap_buffer(&info->material_buffers[graphics->frame_index]);
+      unmap_buffer(&info->transform_buffers[graphics->frame_index]);
+      unmap_buffer(&info->instance_buffers[graphics->frame_index]);
+
+      // This frames copy of the render instances is up to date now
+      for_every(dirty_index, batch->dirty_counts[graphics->frame_index]) {
+        unset_bitset_bit(batch->dirty_bitsets[graphics->frame_index], batch->dirty_slots[graphics->frame_index][dirty_index]);
+      }
+      batch->dirty_counts[graphics->frame_index] = 0;
+
+      u32 batch_count = (u32)batch->batch_count;
+
+      // Draw counts are the number of commands, the totals count instances
+      renderer->total_draw_count += ctx->draw_count.load();
+      renderer->total_command_count += ctx->command_count;
+      renderer->material_draw_count[i] = ctx->command_count;
+      renderer->material_cull_count[i] = batch_count - ctx->draw_count.load();
+      renderer->total_culled_count += renderer->material_cull_count[i];
+      renderer->total_triangle_count += ctx->triangle_count;
+      renderer->total_occluded_count += ctx->occluded_count.load();
+
+      renderer->shadow_total_draw_count += ctx->shadow_draw_count.load();
+      renderer->shadow_total_command_count += ctx->shadow_command_count;
+      renderer->shadow_draw_count[i] = ctx->shadow_command_count;
+      renderer->shadow_cull_count[i] = batch_count - ctx->shadow_draw_count.load();
+      renderer->shadow_total_culled_count += renderer->shadow_cull_count[i];
+      renderer->shadow_total_triangle_count += ctx->shadow_triangle_count;
+    }
   }
 
   void draw_material_batches() {
+    if(HEADLESS) {
+      return;
+    }
+
     VkCommandBuffer commands = graphics->commands[graphics->frame_index];
     VkBuffer indirect_commands_buffer = renderer->forward_pass_commands[graphics->frame_index].buffer;
 
@@ -1495,25 +2095,33 @@ namespace quark {
     // save values
 
     renderer->saved_total_draw_count = renderer->total_draw_count;
+    renderer->saved_total_command_count = renderer->total_command_count;
     renderer->saved_total_culled_count = renderer->total_culled_count;
     renderer->saved_total_triangle_count = renderer->total_triangle_count;
+    renderer->saved_total_occluded_count = renderer->total_occluded_count;
 
     renderer->saved_shadow_total_draw_count = renderer->shadow_total_draw_count;
+    renderer->saved_shadow_total_command_count = renderer->shadow_total_command_count;
     renderer->saved_shadow_total_culled_count = renderer->shadow_total_culled_count;
     renderer->saved_shadow_total_triangle_count = renderer->shadow_total_triangle_count;
 
     // reset values
 
     renderer->total_draw_count = 0;
+    renderer->total_command_count = 0;
     renderer->total_culled_count = 0;
     renderer->total_triangle_count = 0;
+    renderer->total_occluded_count = 0;
+    renderer->occluder_count = 0;
 
     renderer->shadow_total_draw_count = 0;
+    renderer->shadow_total_command_count = 0;
     renderer->shadow_total_culled_count = 0;
     renderer->shadow_total_triangle_count = 0;
 
     for_every(i, renderer->materials_count) {
-      renderer->batches[i].batch_count = 0;
+      // Render instances stay, pushed drawables get pushed again next frame
+      renderer->batches[i].batch_count = renderer->batches[i].retained_count;
 
       renderer->material_draw_count[i] = 0;
       renderer->material_draw_offset[i] = 0;
@@ -1526,6 +2134,10 @@ namespace quark {
   }
 
   void draw_material_batches_depth_only(VkPipeline pipeline, VkBuffer commands_buffer, mat4* view_projection, u32* offsets, u32* counts) {
+    if(HEADLESS) {
+      return;
+    }
+
     VkCommandBuffer commands = graphics->commands[graphics->frame_index];
     // VkBuffer indirect_commands_buffer = renderer->indirect_commands[graphics->frame_index].buffer;
 
@@ -1581,12 +2193,49 @@ namespace quark {
 
   #define inc_bytes(buf, type, count) (type*)(buf); (buf) += sizeof(type) * (count)
 
-  void load_obj_file(const char* path, const char* name) {
-    TempStack scratch = begin_scratch(0, 0);
-    defer({
-      end_scratch(scratch);
-    });
+  // Name of the mesh asset for a lod of a cooked .qmesh, lod 0 keeps the plain name
+  static i32 get_lod_mesh_name(char* buffer, u64 buffer_size, const char* name, u32 lod_index) {
+    if(lod_index == 0) {
+      return sprintf(buffer, buffer_size, "%s", name);
+    }
+
+    return sprintf(buffer, buffer_size, "%s_lod%u", name, lod_index);
+  }
+
+  // The .qmodel that goes with a cooked .qmesh, unused slots repeat the last lod
+  static void write_generated_qmodel(const char* name, MeshFileLod* lods, u32 lod_count) {
+    char path[64];
+    sprintf(path, 64, "quark/qmodel/%s.qmodel", name);
+
+    File* f = open_file_panic_with_error(path, "wb", "Failed to open qmodel file for writing!");
+    defer(close_file(f));
+
+    const char* magic = "qmdl";
+    const u32 version = 2;
+    file_write(f, (void*)magic, 4);
+    file_write(f, (void*)&version, 4);
 
+    f32 angular_thresholds[4];
+    f32 lod_errors[4];
+    for_every(i, 4) {
+      MeshFileLod* lod = &lods[i < lod_count ? i : lod_count - 1];
+      angular_thresholds[i] = lod->threshold;
+      lod_errors[i] = lod->error;
+    }
+
+    file_write(f, angular_thresholds, 4 * sizeof(f32));
+    file_write(f, lod_errors, 4 * sizeof(f32));
+
+    for_every(i, 4) {
+      char mesh_name[64];
+      u32 str_len = get_lod_mesh_name(mesh_name, 64, name, i < lod_count ? i : lod_count - 1) + 1;
+      file_write(f, &str_len, 4);
+      file_write(f, mesh_name, str_len);
+    }
+  }
+
+  // Everything comes out of the given arena so cooking can run on the job system
+  static void cook_obj_file(const char* path, const char* name, Arena* arena) {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -1755,33 +2404,112 @@ namespace quark {
 
     meshopt_optimizeVertexCache(indices.data(), indices.data(), index_count, vertex_count);
 
-    u8* buffer_i = arena_push(scratch.arena, 2 * MB);
-    usize buffer_i_size = meshopt_encodeIndexBuffer(buffer_i, 2 * MB, indices.data(), indices.size());
+    // Every lod gets simplified from the source mesh so their errors stay comparable
+    u32 lod_count = LOD_CHAIN_LENGTH < 1 ? 1 : (LOD_CHAIN_LENGTH > 4 ? 4 : LOD_CHAIN_LENGTH);
+    f32 simplify_scale = meshopt_simplifyScale(&positions[0].x, vertex_count, sizeof(vec3));
+
+    std::vector<u32> lod_indices[4];
+    MeshFileLod lods[4] = {};
+
+    lod_indices[0] = indices;
 
-    u8* buffer_p = arena_push(scratch.arena, 2 * MB);
-    usize buffer_p_size = meshopt_encodeVertexBuffer(buffer_p, 2 * MB, positions.data(), positions.size(), sizeof(vec3));
+    for_range(i, 1, lod_count) {
+      f32 ratio = LOD_CHAIN_RATIOS[i];
+      usize target_index_count = (usize)(index_count * ratio) / 3 * 3;
 
-    u8* buffer_n = arena_push(scratch.arena, 2 * MB);
-    usize buffer_n_size = meshopt_encodeVertexBuffer(buffer_n, 2 * MB, quantized_tnb.data(), quantized_tnb.size(), sizeof(uvec3));
+      std::vector<u32>& lod = lod_indices[i];
+      lod.resize(index_count);
 
-    u8* buffer_u = arena_push(scratch.arena, 2 * MB);
-    usize buffer_u_size = meshopt_encodeVertexBuffer(buffer_u, 2 * MB, uvs.data(), uvs.size(), sizeof(vec2));
+      f32 error = 0.0f;
+      usize lod_index_count = 0;
+      if(ratio >= LOD_SLOPPY_BELOW_RATIO) {
+        lod_index_count = meshopt_simplify(lod.data(), indices.data(), index_count, &positions[0].x, vertex_count, sizeof(vec3), target_index_count, 1.0f, 0, &error);
+      } else {
+        lod_index_count = meshopt_simplifySloppy(lod.data(), indices.data(), index_count, &positions[0].x, vertex_count, sizeof(vec3), target_index_count, 1.0f, &error);
+      }
+
+      // Sloppy can collapse small meshes to nothing, just repeat the previous lod then
+      if(lod_index_count == 0) {
+        lod = lod_indices[i - 1];
+        lods[i].error = lods[i - 1].error;
+        continue;
+      }
+
+      lod.resize(lod_index_count);
+      meshopt_optimizeVertexCache(lod.data(), lod.data(), lod_index_count, vertex_count);
+      lods[i].error = max(error * simplify_scale, lods[i - 1].error);
+    }
+
+    // Give every lod its own compacted vertex range so the far lods only touch the vertices they use
+    {
+      std::vector<u32> lod_remap(vertex_count);
+      std::vector<u32> all_indices;
+      std::vector<vec3> all_positions;
+      std::vector<uvec3> all_tnb;
+      std::vector<vec2> all_uvs;
+
+      // Reference the pixel error at 1080p with a 90 degree fov for loaders that only read the thresholds
+      f32 reference_error_scale = get_lod_error_scale(90.0f, 1080.0f);
+
+      for_every(i, lod_count) {
+        std::vector<u32>& lod = lod_indices[i];
+        usize lod_vertex_count = meshopt_optimizeVertexFetchRemap(lod_remap.data(), lod.data(), lod.size(), vertex_count);
+        meshopt_remapIndexBuffer(lod.data(), lod.data(), lod.size(), lod_remap.data());
+
+        lods[i].vertex_offset = all_positions.size();
+        lods[i].vertex_count = lod_vertex_count;
+        lods[i].index_offset = all_indices.size();
+        lods[i].index_count = lod.size();
+        lods[i].threshold = lods[i].error > 0.0f ? reference_error_scale / (lods[i].error * lods[i].error) : F32_MAX;
+
+        all_indices.insert(all_indices.end(), lod.begin(), lod.end());
+        all_positions.resize(all_positions.size() + lod_vertex_count);
+        all_tnb.resize(all_tnb.size() + lod_vertex_count);
+        all_uvs.resize(all_uvs.size() + lod_vertex_count);
+
+        meshopt_remapVertexBuffer(&all_positions[lods[i].vertex_offset], positions.data(), vertex_count, sizeof(vec3), lod_remap.data());
+        meshopt_remapVertexBuffer(&all_tnb[lods[i].vertex_offset], quantized_tnb.data(), vertex_count, sizeof(uvec3), lod_remap.data());
+        meshopt_remapVertexBuffer(&all_uvs[lods[i].vertex_offset], uvs.data(), vertex_count, sizeof(vec2), lod_remap.data());
+      }
+
+      indices.swap(all_indices);
+      positions.swap(all_positions);
+      quantized_tnb.swap(all_tnb);
+      uvs.swap(all_uvs);
+    }
+
+    usize buffer_i_capacity = meshopt_encodeIndexBufferBound(indices.size(), positions.size());
+    u8* buffer_i = arena_push(arena, buffer_i_capacity);
+    usize buffer_i_size = meshopt_encodeIndexBuffer(buffer_i, buffer_i_capacity, indices.data(), indices.size());
+
+    usize buffer_p_capacity = meshopt_encodeVertexBufferBound(positions.size(), sizeof(vec3));
+    u8* buffer_p = arena_push(arena, buffer_p_capacity);
+    usize buffer_p_size = meshopt_encodeVertexBuffer(buffer_p, buffer_p_capacity, positions.data(), positions.size(), sizeof(vec3));
+
+    usize buffer_n_capacity = meshopt_encodeVertexBufferBound(quantized_tnb.size(), sizeof(uvec3));
+    u8* buffer_n = arena_push(arena, buffer_n_capacity);
+    usize buffer_n_size = meshopt_encodeVertexBuffer(buffer_n, buffer_n_capacity, quantized_tnb.data(), quantized_tnb.size(), sizeof(uvec3));
+
+    usize buffer_u_capacity = meshopt_encodeVertexBufferBound(uvs.size(), sizeof(vec2));
+    u8* buffer_u = arena_push(arena, buffer_u_capacity);
+    usize buffer_u_size = meshopt_encodeVertexBuffer(buffer_u, buffer_u_capacity, uvs.data(), uvs.size(), sizeof(vec2));
 
     // usize buffer_size = buffer_i_size + buffer_p_size + buffer_n_size + buffer_u_size;
-    u8* buffer = arena_push(scratch.arena, 0); // push_arena(scratch.arena, 8 * MB);
-    arena_copy(scratch.arena, buffer_i, buffer_i_size);
-    arena_copy(scratch.arena, buffer_p, buffer_p_size);
-    arena_copy(scratch.arena, buffer_n, buffer_n_size);
-    arena_copy(scratch.arena, buffer_u, buffer_u_size);
-    u8* end = arena_push(scratch.arena, 0);
+    u8* buffer = arena_push(arena, 0); // push_arena(arena, 8 * MB);
+    arena_copy(arena, buffer_i, buffer_i_size);
+    arena_copy(arena, buffer_p, buffer_p_size);
+    arena_copy(arena, buffer_n, buffer_n_size);
+    arena_copy(arena, buffer_u, buffer_u_size);
+    u8* end = arena_push(arena, 0);
     usize buffer_size = (usize)(end - buffer);
     // copy_mem(buffer, buffer_i, buffer_i_size);
     // copy_mem(buffer + buffer_i_size, buffer_p, buffer_p_size);
     // copy_mem(buffer + buffer_i_size + buffer_p_size, buffer_n, buffer_n_size);
     // copy_mem(buffer + buffer_i_size + buffer_p_size + buffer_n_size, buffer_u, buffer_u_size);
 
-    u8* buffer2 = arena_push(scratch.arena, 2 * MB);
-    i32 buffer2_size = LZ4_compress_default((const char*)buffer, (char*)buffer2, buffer_size, 2 * MB);
+    i32 buffer2_capacity = LZ4_compressBound(buffer_size);
+    u8* buffer2 = arena_push(arena, buffer2_capacity);
+    i32 buffer2_size = LZ4_compress_default((const char*)buffer, (char*)buffer2, buffer_size, buffer2_capacity);
 
     u32 before_size = indices.size() * sizeof(u32) + positions.size() * sizeof(vec3) + quantized_tnb.size() * sizeof(uvec3) + uvs.size() * sizeof(vec2);
     #ifdef DEBUG
@@ -1820,21 +2548,14 @@ namespace quark {
     header.positions_encoded_size = buffer_p_size;
     header.normals_encoded_size = buffer_n_size;
     header.uvs_encoded_size = buffer_u_size;
-    header.lod_count = 1;
+    header.lod_count = lod_count;
     header.half_extents = extents;
 
     file_write(f, &header, sizeof(MeshFileHeader));
 
     // dump_struct(&header);
 
-    MeshFileLod lod0 = {};
-    lod0.vertex_offset = 0;
-    lod0.vertex_count = positions.size();
-    lod0.index_offset = 0;
-    lod0.index_count = indices.size();
-    lod0.threshold = 0.5f;
-
-    file_write(f, &lod0, sizeof(MeshFileLod));
+    file_write(f, lods, lod_count * sizeof(MeshFileLod));
 
     // printf("%s\n", name);
 
@@ -1863,9 +2584,24 @@ namespace quark {
     // fwrite(positions.data(), sizeof(vec3), positions.size(), f);
     // fwrite(normals.data(), sizeof(vec3), normals.size(), f);
     // fwrite(uvs.data(), sizeof(vec3), uvs.size(), f);
+
+    write_generated_qmodel(name, lods, lod_count);
   }
 
-  void load_qmesh_file(const char* path, const char* name) {
+  void load_obj_file(const char* path, const char* name) {
+    TempStack scratch = begin_scratch(0, 0);
+    defer(end_scratch(scratch));
+
+    cook_obj_file(path, name, scratch.arena);
+  }
+
+  // Cooking only writes the .qmesh and .qmodel, those get registered when their folders load
+  void* decode_obj_file(const char* path, const char* name, Arena* arena) {
+    cook_obj_file(path, name, arena);
+    return 0;
+  }
+
+  void* decode_qmesh_file(const char* path, const char* name, Arena* arena) {
     static uint64_t UUID_LO = 0xa70e90948be13cb1;
     static uint64_t UUID_HI = 0x847f281e519ba44f;
 
@@ -1878,13 +2614,11 @@ namespace quark {
       panic("Attempted to load mesh file: " + name + ".qmesh but it was too small to be a mesh file!\n");
     }
 
-    TempStack scratch = begin_scratch(0, 0);
-    defer(end_scratch(scratch));
-
-    u8* raw_bytes = arena_push(scratch.arena, fsize);
+    u8* raw_bytes = arena_push(arena, fsize);
     file_read(f, raw_bytes, fsize);
 
-    MeshFile file = {};
+    MeshFile* file_ptr = arena_push_struct_zero(arena, MeshFile);
+    MeshFile& file = *file_ptr;
 
     file.header = inc_bytes(raw_bytes, MeshFileHeader, 1);
 
@@ -1899,27 +2633,28 @@ namespace quark {
     u32 comp_size = fsize - sizeof(MeshFileHeader) - (sizeof(MeshFileLod) * file.header->lod_count);
     // printf("comp_size: %u\n", comp_size);
 
-    // decompress
-    u8* decomp_bytes = arena_push(scratch.arena, 2 * MB);
-    i32 decomp_size = LZ4_decompress_safe((char*)raw_bytes, (char*)decomp_bytes, comp_size, 2 * MB);
+    // decompress, every encoded section starts 8 byte aligned
+    i32 decomp_capacity = file.header->indices_encoded_size + file.header->positions_encoded_size + file.header->normals_encoded_size + file.header->uvs_encoded_size + 4 * 8;
+    u8* decomp_bytes = arena_push(arena, decomp_capacity);
+    i32 decomp_size = LZ4_decompress_safe((char*)raw_bytes, (char*)decomp_bytes, comp_size, decomp_capacity);
     // printf("decomp_size: %u\n", decomp_size);
 
-    file.indices = (u32*)arena_push(scratch.arena, 2 * MB);
+    file.indices = arena_push_array(arena, u32, file.header->index_count);
     meshopt_decodeIndexBuffer(file.indices, file.header->index_count, sizeof(u32), decomp_bytes, file.header->indices_encoded_size);
     decomp_bytes += file.header->indices_encoded_size;
     decomp_bytes = (u8*)align_forward((usize)decomp_bytes, 8);
 
-    file.positions = (vec3*)arena_push(scratch.arena, 2 * MB);
+    file.positions = arena_push_array(arena, vec3, file.header->vertex_count);
     meshopt_decodeVertexBuffer(file.positions, file.header->vertex_count, sizeof(vec3), decomp_bytes, file.header->positions_encoded_size);
     decomp_bytes += file.header->positions_encoded_size;
     decomp_bytes = (u8*)align_forward((usize)decomp_bytes, 8);
 
-    file.normals = (vec3*)arena_push(scratch.arena, 2 * MB);
+    file.normals = arena_push_array(arena, vec3, file.header->vertex_count);
     meshopt_decodeVertexBuffer(file.normals, file.header->vertex_count, sizeof(vec3), decomp_bytes, file.header->normals_encoded_size);
     decomp_bytes += file.header->normals_encoded_size;
     decomp_bytes = (u8*)align_forward((usize)decomp_bytes, 8);
 
-    file.uvs = (vec2*)arena_push(scratch.arena, 2 * MB);
+    file.uvs = arena_push_array(arena, vec2, file.header->vertex_count);
     meshopt_decodeVertexBuffer(file.uvs, file.header->vertex_count, sizeof(vec2), decomp_bytes, file.header->uvs_encoded_size);
     decomp_bytes += file.header->uvs_encoded_size;
     decomp_bytes = (u8*)align_forward((usize)decomp_bytes, 8);
@@ -1949,19 +2684,44 @@ namespace quark {
     // file.uvs = inc_bytes(decomp_bytes, vec2, file.header->vertex_count);
     // decomp_bytes = (u8*)align_forward((usize)decomp_bytes, 8);
 
-    MeshId id = (MeshId)renderer->mesh_counts;
-    renderer->mesh_counts += 1;
+    return file_ptr;
+  }
 
-    struct MeshScale : vec3 {};
+  void register_qmesh_file(void* decoded, const char* path, const char* name) {
+    MeshFile file = *(MeshFile*)decoded;
 
-    renderer->mesh_instances[(u32)id] = create_mesh(file.positions, file.normals, file.uvs, file.header->vertex_count, file.indices, file.header->index_count);
-    renderer->mesh_scales[(u32)id] = normalize_to_max_length(file.header->half_extents, 2.0f);
+    if(renderer->mesh_counts + file.header->lod_count > MAX_MESH_COUNT) {
+      panic("Attempted to load more than MAX_MESH_COUNT meshes!\n");
+    }
 
-    #ifdef DEBUG
-    log_message(name + ": " + file.header->index_count);
-    #endif
+    // Every lod is its own mesh, indices are local to the lods vertex range
+    for_every(i, file.header->lod_count) {
+      MeshFileLod* lod = &file.lods[i];
 
-    add_asset(name, id);
+      MeshId id = (MeshId)renderer->mesh_counts;
+      renderer->mesh_counts += 1;
+
+      renderer->mesh_instances[(u32)id] = create_mesh(
+        file.positions + lod->vertex_offset, file.normals + lod->vertex_offset, file.uvs + lod->vertex_offset, lod->vertex_count,
+        file.indices + lod->index_offset, lod->index_count
+      );
+      renderer->mesh_scales[(u32)id] = normalize_to_max_length(file.header->half_extents, 2.0f);
+
+      #ifdef DEBUG
+      log_message(name + ": " + lod->index_count);
+      #endif
+
+      char lod_name[256];
+      get_lod_mesh_name(lod_name, 256, name, i);
+      add_asset(lod_name, id);
+    }
+  }
+
+  void load_qmesh_file(const char* path, const char* name) {
+    TempStack scratch = begin_scratch(0, 0);
+    defer(end_scratch(scratch));
+
+    register_qmesh_file(decode_qmesh_file(path, name, scratch.arena), path, name);
   }
 
   void load_qmodel_file(const char* path, const char* name) {
@@ -1977,12 +2737,18 @@ namespace quark {
     file_read(file, &version, 4);
 
     assert(magic == *(u32*)"qmdl");
-    assert(version == 1);
+    assert(version == 1 || version == 2);
 
     f32 angular_thresholds[4];
+    f32 lod_errors[4] = {};
 
     file_read(file, angular_thresholds, 4 * sizeof(f32));
 
+    // Version 2 is written when cooking an .obj and adds the lod errors
+    if(version >= 2) {
+      file_read(file, lod_errors, 4 * sizeof(f32));
+    }
+
     char* meshes[4];
 
     for_every(i, 4) {
@@ -2000,6 +2766,7 @@ namespace quark {
 
     for_every(i, 4) {
       instance.angular_thresholds[i] = angular_thresholds[i];
+      instance.lod_errors[i] = lod_errors[i];
       instance.mesh_ids[i] = *get_asset<MeshId>(meshes[i]);
     }
 
@@ -2008,41 +2775,69 @@ namespace quark {
     add_asset(name, id);
   }
 
-  void load_png_file(const char* path, const char* name) {
-    Image* image = &renderer->textures[renderer->texture_count];
+  // stbi allocates the pixels itself, register_png_file() frees them once they are on the gpu
+  struct DecodedPng {
+    stbi_uc* pixels;
+    i32 width;
+    i32 height;
+  };
+
+  void* decode_png_file(const char* path, const char* name, Arena* arena) {
+    DecodedPng* png = arena_push_struct_zero(arena, DecodedPng);
 
-    int width, height, channels;
-    stbi_uc* pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+    int channels;
+    png->pixels = stbi_load(path, &png->width, &png->height, &channels, STBI_rgb_alpha);
 
-    if(!pixels) {
+    if(!png->pixels) {
       panic("Failed to load texture file \"" + path + "\"");
     }
 
-    u64 image_size = width * height * 4;
+    return png;
+  }
+
+  void register_png_file(void* decoded, const char* path, const char* name) {
+    DecodedPng* png = (DecodedPng*)decoded;
+    Image* image = &renderer->textures[renderer->texture_count];
+
+    u64 image_size = png->width * png->height * 4;
 
     ImageInfo info = {
-      .resolution = { width, height },
+      .resolution = { png->width, png->height },
       .format = ImageFormat::LinearRgba8,
       .type = ImageType::Texture,
       .samples = ImageSamples::One,
     };
     create_images(image, 1, &info);
 
-    write_buffer(&graphics->staging_buffer, 0, pixels, 0, image_size);
+    // Textures go through the start of the staging buffer directly, so finish the mesh uploads first
+    flush_uploads();
+
+    write_buffer(&graphics->staging_buffer, 0, png->pixels, 0, image_size);
 
     VkCommandBuffer commands = begin_quick_commands2();
     copy_buffer_to_image(commands, image, &graphics->staging_buffer);
     transition_image(commands, image, ImageUsage::Texture);
     end_quick_commands2(commands);
 
-    stbi_image_free(pixels);
+    stbi_image_free(png->pixels);
 
     add_asset(name, (ImageId)renderer->texture_count);
 
     renderer->texture_count += 1;
   }
 
+  void load_png_file(const char* path, const char* name) {
+    TempStack scratch = begin_scratch(0, 0);
+    defer(end_scratch(scratch));
+
+    register_png_file(decode_png_file(path, name, scratch.arena), path, name);
+  }
+
   VkShaderModule create_shader_module(const char* path) {
+    if(HEADLESS) {
+      return VK_NULL_HANDLE;
+    }
+
     TempStack scratch = begin_scratch(0, 0);
     defer(end_scratch(scratch));
 
@@ -6,6 +6,7 @@
 #define DRAW_ID gl_DrawID
 #define BASE_VERTEX gl_BaseVertex
 #define BASE_INSTANCE gl_BaseInstance
+#define INSTANCE_INDEX gl_InstanceIndex
 
 layout (location = 0) in vec3 VERTEX_POSITION;
 
@@ -31,6 +32,10 @@ layout (set = 1, binding = 2) readonly buffer Transforms {
   Transform transforms[];
 };
 
+layout (set = 1, binding = 3) readonly buffer InstanceIndices {
+  uint instance_indices[];
+};
+
 vec3 rotate(vec3 v, vec4 q) {
   // https://blog.molecular-matters.com/2013/05/24/a-faster-quaternion-vector-multiplication/
   // vec3 t = 2.0f * cross(q.xyz, v);
@@ -47,7 +52,7 @@ vec3 rotate(vec3 v, vec4 q) {
 }
 
 void main() {
-  const uint INDEX = BASE_INSTANCE;
+  const uint INDEX = instance_indices[INSTANCE_INDEX];
 
   const vec3 position = transforms[INDEX].position.xyz;
   const vec4 rotation = transforms[INDEX].rotation.xyzw;
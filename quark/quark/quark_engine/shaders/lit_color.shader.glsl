@@ -24,10 +24,14 @@ layout (set = 1, binding = 2) readonly buffer Transforms {
   Transform transforms[];
 };
 
+layout (set = 1, binding = 3) readonly buffer InstanceIndices {
+  uint instance_indices[];
+};
+
 // SECTION: VERTEX
 
 void main() {
-  INDEX = BASE_INSTANCE;
+  INDEX = instance_indices[INSTANCE_INDEX];
 
   vec3 NORMAL = unpack_normal(VERTEX_TNB.y);
 
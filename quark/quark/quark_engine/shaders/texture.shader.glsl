@@ -29,10 +29,14 @@ layout (set = 1, binding = 2, std430) readonly buffer Transforms {
   Transform transforms[];
 };
 
+layout (set = 1, binding = 3, std430) readonly buffer InstanceIndices {
+  uint instance_indices[];
+};
+
 // SECTION: VERTEX
 
 void main() {
-  INDEX = BASE_INSTANCE;
+  INDEX = instance_indices[INSTANCE_INDEX];
 
   const vec3 position = transforms[INDEX].position.xyz;
   const vec4 rotation = transforms[INDEX].rotation;
@@ -9,9 +9,18 @@
     #include <windows.h>
     #include <dbghelp.h>
 
+  #else
+
+    #include <link.h>
+    #include <dlfcn.h>
+    #include <string.h>
+
   #endif
 
   #include <lz4.h>
+  #include <time.h>
+
+  #include <thread>
 
 #pragma clang diagnostic pop
 
@@ -20,46 +29,158 @@ namespace quark {
 // Structs
 //
 
-  struct FileBuffer {
-    Arena* arena;
-    u8* start;
-    usize size;
-    usize read_pos;
+  // Buffers writes into chunks and lz4 compresses each one as it fills up, so memory stays
+  // bounded by the chunk size. Chunks alternate between two buffers since the lz4 stream refers back to the previous one
+  struct SnapshotWriter {
+    File* file;
+    LZ4_stream_t* stream;
+    u8* chunks[2];
+    u32 chunk_index;
+    u32 chunk_used;
+    u8* compressed;
+    u64 compressed_size;
+  };
+
+  // Decompresses one chunk at a time into two alternating buffers, same as the writer
+  struct SnapshotReader {
+    File* file;
+    LZ4_streamDecode_t* stream;
+    u8* chunks[2];
+    u32 chunk_index;
+    u32 chunk_size;
+    u32 chunk_capacity;
+    u32 read_pos;
+    u8* compressed;
   };
 
+  constexpr u32 SNAPSHOT_CHUNK_SIZE = 1 * MB;
+  constexpr u32 SNAPSHOT_MAX_CHUNK_SIZE = 64 * MB;
+
 //
 // Functions
 //
 
-  FileBuffer create_fileb(Arena* arena) {
-    return FileBuffer {
-      .arena = arena,
-      .start = arena_push(arena, 0),
-      .size = 0,
-      .read_pos = 0,
+  SnapshotWriter begin_snapshot_writer(Arena* arena, File* file) {
+    SnapshotWriter writer = {
+      .file = file,
+      .stream = (LZ4_stream_t*)arena_push(arena, sizeof(LZ4_stream_t)),
+      .chunks = { arena_push(arena, SNAPSHOT_CHUNK_SIZE), arena_push(arena, SNAPSHOT_CHUNK_SIZE) },
+      .chunk_index = 0,
+      .chunk_used = 0,
+      .compressed = arena_push(arena, LZ4_COMPRESSBOUND(SNAPSHOT_CHUNK_SIZE)),
+      .compressed_size = 0,
     };
+
+    LZ4_initStream(writer.stream, sizeof(LZ4_stream_t));
+    return writer;
+  }
+
+  void flush_snapshot_chunk(SnapshotWriter* writer) {
+    if(writer->chunk_used == 0) {
+      return;
+    }
+
+    i32 compressed_size = LZ4_compress_fast_continue(writer->stream, (const char*)writer->chunks[writer->chunk_index],
+      (char*)writer->compressed, writer->chunk_used, LZ4_COMPRESSBOUND(SNAPSHOT_CHUNK_SIZE), 1);
+
+    // Every chunk is its uncompressed size, compressed size, then the compressed bytes
+    u32 sizes[2] = { writer->chunk_used, (u32)compressed_size };
+    file_write(writer->file, sizes, sizeof(sizes));
+    file_write(writer->file, writer->compressed, compressed_size);
+    writer->compressed_size += sizeof(sizes) + compressed_size;
+
+    writer->chunk_index ^= 1;
+    writer->chunk_used = 0;
+  }
+
+  void write_snapshot(SnapshotWriter* writer, void* src, u64 size) {
+    u8* bytes = (u8*)src;
+
+    while(size != 0) {
+      u64 space = SNAPSHOT_CHUNK_SIZE - writer->chunk_used;
+      u64 count = size < space ? size : space;
+
+      copy_mem(writer->chunks[writer->chunk_index] + writer->chunk_used, bytes, count);
+      writer->chunk_used += count;
+      bytes += count;
+      size -= count;
+
+      if(writer->chunk_used == SNAPSHOT_CHUNK_SIZE) {
+        flush_snapshot_chunk(writer);
+      }
+    }
   }
 
-  void write_fileb(FileBuffer* buffer, void* src, u32 element_size, u32 element_count) {
-    arena_copy(buffer->arena, src, element_size * element_count);
+  // Writes the last chunk and an empty one to mark the end
+  void end_snapshot_writer(SnapshotWriter* writer) {
+    flush_snapshot_chunk(writer);
 
-    buffer->size += element_size * element_count;
-    buffer->size = align_forward(buffer->size, 8);
+    u32 sizes[2] = { 0, 0 };
+    file_write(writer->file, sizes, sizeof(sizes));
   }
 
-  void read_fileb(FileBuffer* buffer, void* dst, u32 element_size, u32 element_count) {
-    copy_mem(dst, buffer->start + buffer->read_pos, element_size * element_count);
+  SnapshotReader begin_snapshot_reader(Arena* arena, File* file, u32 chunk_capacity) {
+    if(chunk_capacity == 0 || chunk_capacity > SNAPSHOT_MAX_CHUNK_SIZE) {
+      panic("Attempted to load a snapshot but its chunks were too big!\n");
+    }
+
+    SnapshotReader reader = {
+      .file = file,
+      .stream = (LZ4_streamDecode_t*)arena_push_zero(arena, sizeof(LZ4_streamDecode_t)),
+      .chunks = { arena_push(arena, chunk_capacity), arena_push(arena, chunk_capacity) },
+      .chunk_index = 0,
+      .chunk_size = 0,
+      .chunk_capacity = chunk_capacity,
+      .read_pos = 0,
+      .compressed = arena_push(arena, LZ4_COMPRESSBOUND(chunk_capacity)),
+    };
 
-    buffer->read_pos += element_size * element_count;
-    buffer->read_pos = align_forward(buffer->read_pos, 8);
+    LZ4_setStreamDecode(reader.stream, 0, 0);
+    return reader;
   }
 
-  void write_fileb_comp(FileBuffer* buffer, void* src, u32 element_size, u32 element_count) {
+  void read_snapshot_chunk(SnapshotReader* reader) {
+    u32 sizes[2] = {};
+    file_read(reader->file, sizes, sizeof(sizes));
+
+    if(sizes[0] == 0 || sizes[0] > reader->chunk_capacity || sizes[1] > (u32)LZ4_COMPRESSBOUND(reader->chunk_capacity)) {
+      panic("Attempted to load a snapshot but it ended early or was corrupted!\n");
+    }
+
+    file_read(reader->file, reader->compressed, sizes[1]);
+
+    reader->chunk_index ^= 1;
+    i32 size = LZ4_decompress_safe_continue(reader->stream, (const char*)reader->compressed,
+      (char*)reader->chunks[reader->chunk_index], sizes[1], reader->chunk_capacity);
+
+    if(size < 0 || (u32)size != sizes[0]) {
+      panic("Attempted to load a snapshot but it was corrupted!\n");
+    }
+
+    reader->chunk_size = size;
+    reader->read_pos = 0;
   }
 
-  void read_fileb_comp(FileBuffer* buffer, void* dst, u32 byte_size) {
+  void read_snapshot(SnapshotReader* reader, void* dst, u64 size) {
+    u8* bytes = (u8*)dst;
+
+    while(size != 0) {
+      if(reader->read_pos == reader->chunk_size) {
+        read_snapshot_chunk(reader);
+      }
+
+      u64 available = reader->chunk_size - reader->read_pos;
+      u64 count = size < available ? size : available;
+
+      copy_mem(bytes, reader->chunks[reader->chunk_index] + reader->read_pos, count);
+      reader->read_pos += count;
+      bytes += count;
+      size -= count;
+    }
   }
 
+#ifdef _WIN64
+
   #pragma comment(lib, "dbghelp.lib")
   i32 find_static_section(const char* module_name, usize* static_size, void** static_ptr) {
     #ifdef DEBUG
@@ -86,6 +207,72 @@ namespace quark {
     return 1;
   }
 
+#else
+
+  struct FindModuleInfo {
+    const char* module_name;
+    std::string path;
+  };
+
+  // Plugins are dlopen'd with a relative path so match on the file name
+  static i32 find_module_callback(dl_phdr_info* info, usize size, void* data) {
+    FindModuleInfo* find = (FindModuleInfo*)data;
+
+    const char* file_name = strrchr(info->dlpi_name, '/');
+    file_name = file_name ? file_name + 1 : info->dlpi_name;
+
+    if(strcmp(file_name, find->module_name) == 0) {
+      find->path = info->dlpi_name;
+      return 1;
+    }
+
+    return 0;
+  }
+
+  // Every module has its own __start_quark_static/__stop_quark_static, so ask the module itself through quark_get_static_section()
+  i32 find_static_section(const char* module_name, usize* static_size, void** static_ptr) {
+    #ifdef DEBUG
+    log_message("Loading quark_static section for " + module_name);
+    #endif
+
+    *static_size = 0;
+    *static_ptr = 0;
+
+    FindModuleInfo find = { .module_name = module_name };
+    if(dl_iterate_phdr(find_module_callback, &find) == 0) {
+      return 1;
+    }
+
+    // RTLD_NOLOAD only hands back a reference to the already loaded module
+    void* handle = dlopen(find.path.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+    if(handle == 0) {
+      return 1;
+    }
+
+    using GetStaticSection = void (*)(usize*, void**);
+    GetStaticSection get_static_section = (GetStaticSection)dlsym(handle, "quark_get_static_section");
+
+    // dlsym also searches the module's dependencies, make sure this isn't the engine's copy
+    Dl_info symbol_info = {};
+    if(get_static_section != 0 && dladdr((void*)get_static_section, &symbol_info) != 0 && find.path == symbol_info.dli_fname) {
+      get_static_section(static_size, static_ptr);
+    }
+
+    dlclose(handle);
+
+    if(*static_ptr == 0) {
+      return 1;
+    }
+
+    #ifdef DEBUG
+    log_message("quark_static section found with size: " + (u32)*static_size);
+    #endif
+
+    return 0;
+  }
+
+#endif
+
   struct StaticSection {
     std::string name;
     usize size;
@@ -102,19 +289,549 @@ namespace quark {
     });
   }
 
-  void save_snapshot(const char* file) {
+  static void find_static_sections() {
     for_every(i, static_sections.size()) {
       StaticSection* section = &static_sections[i];
       if(section->ptr == 0) {
         find_static_section(section->name.c_str(), &section->size, &section->ptr);
       }
     }
+  }
+
+//
+// Snapshot Files
+//
+
+  constexpr u32 SNAPSHOT_MAGIC = 0x706e7371; // "qsnp"
+  constexpr u64 SNAPSHOT_PAGE_SIZE = 4 * KB;
+
+  enum struct SnapshotKind : u32 {
+    Keyframe = 0,
+    Delta = 1,
+    Mapped = 2, // Uncompressed keyframe, see SnapshotMappedWriter
+  };
+
+  // Written uncompressed in front of the chunks
+  struct SnapshotFileHeader {
+    u32 magic;
+    SnapshotKind kind;
+    u64 id;
+    u64 base_id;    // The snapshot a delta goes on top of, 0 for keyframes
+    u32 chunk_size; // Largest uncompressed chunk
+    u32 _pad0;
+  };
+
+  // The ecs counters in one place so deltas can diff them like any other region
+  struct SnapshotEcsCounters {
+    u32 first_entity;
+    u32 last_entity;
+    u32 first_empty_entity;
+    u32 entity_commit_count;
+  };
+
+  struct SnapshotRegion {
+    u8* ptr;
+    u64 size;
+    bool trackable; // Lives at the same address every snapshot, so the os can track writes to it
+  };
+
+  // A region as of the last snapshot. Regions the os tracks writes to only need their size,
+  // the rest keep a copy to diff against
+  struct SnapshotBaseRegion {
+    u64 size;
+    bool tracked;
+    std::vector<u8> data;
+  };
+
+  // Mapped keyframes start their data a page after the header, and every piece a page or bigger starts on a page,
+  // so loading copies page aligned tables straight out of the mapping
+  struct SnapshotMappedWriter {
+    File* file;
+    u64 offset;
+  };
+
+  bool SNAPSHOT_KEEP_DELTA_BASE = true;
+  bool SNAPSHOT_MAPPED = false;
+
+  // Every region as of the last snapshot that was saved or loaded, in get_snapshot_regions() order
+  std::vector<SnapshotBaseRegion> _snapshot_base;
+  u64 _snapshot_base_id = 0;
+
+  static u64 create_snapshot_id() {
+    static u64 counter = 0;
+    counter += 1;
+    return ((u64)time(0) << 24) ^ counter;
+  }
+
+  static SnapshotEcsCounters get_snapshot_ecs_counters(EcsContext* ctx) {
+    return SnapshotEcsCounters {
+      .first_entity = ctx->first_entity,
+      .last_entity = ctx->last_entity,
+      .first_empty_entity = ctx->first_empty_entity,
+      .entity_commit_count = ctx->entity_commit_count,
+    };
+  }
+
+  // Static sections, the ecs counters, the bitset of every table, then the data of every table
+  static std::vector<SnapshotRegion> get_snapshot_regions(EcsContext* ctx, SnapshotEcsCounters* counters) {
+    std::vector<SnapshotRegion> regions;
+
+    for_every(i, static_sections.size()) {
+      regions.push_back({ (u8*)static_sections[i].ptr, static_sections[i].size, true });
+    }
+
+    regions.push_back({ (u8*)counters, sizeof(SnapshotEcsCounters), false });
+
+    for_every(i, ctx->component_table_count) {
+      regions.push_back({ (u8*)ctx->component_bitsets[i], counters->entity_commit_count / 8, true });
+    }
+
+    for_every(i, ctx->component_table_count) {
+      regions.push_back({ (u8*)ctx->component_datas[i], ctx->component_commit_sizes[i], true });
+    }
+
+    return regions;
+  }
+
+  // Only writes after this show up in the next delta. Regions whose writes the os stops tracking get a fresh copy to diff against
+  static void reset_snapshot_write_tracking(std::vector<SnapshotRegion>* regions) {
+    TempStack scratch = begin_scratch(0, 0);
+    defer(end_scratch(scratch));
+
+    usize count = regions->size();
+    MemRange* ranges = arena_push_array(scratch.arena, MemRange, count);
+    bool* tracked = arena_push_array(scratch.arena, bool, count);
+
+    for_every(i, count) {
+      ranges[i] = { (*regions)[i].ptr, (*regions)[i].size };
+    }
+
+    os_reset_written_pages(ranges, tracked, count);
+
+    for_every(i, count) {
+      SnapshotRegion* region = &(*regions)[i];
+      SnapshotBaseRegion* base = &_snapshot_base[i];
+
+      bool was_tracked = base->tracked;
+      base->tracked = tracked[i] && region->trackable;
+
+      if(base->tracked) {
+        base->data.clear();
+      } else if(was_tracked) {
+        base->data.assign(region->ptr, region->ptr + region->size);
+      }
+    }
+  }
+
+  // Starts tracking writes and copies every region the os can't track writes to.
+  // Without copy_untracked those are left for fill_snapshot_base_from_keyframe()
+  static bool capture_snapshot_base(EcsContext* ctx, u64 id, bool copy_untracked = true) {
+    if(!SNAPSHOT_KEEP_DELTA_BASE) {
+      _snapshot_base.clear();
+      _snapshot_base_id = 0;
+      return false;
+    }
+
+    SnapshotEcsCounters counters = get_snapshot_ecs_counters(ctx);
+    std::vector<SnapshotRegion> regions = get_snapshot_regions(ctx, &counters);
+
+    _snapshot_base.resize(regions.size());
+    reset_snapshot_write_tracking(&regions);
+
+    for_every(i, regions.size()) {
+      SnapshotBaseRegion* base = &_snapshot_base[i];
+      base->size = regions[i].size;
+
+      if(!base->tracked && copy_untracked) {
+        base->data.assign(regions[i].ptr, regions[i].ptr + regions[i].size);
+      }
+    }
+
+    _snapshot_base_id = id;
+    return true;
+  }
+
+  static SnapshotWriter begin_snapshot_file(Arena* arena, File* f, SnapshotKind kind, u64 id, u64 base_id) {
+    SnapshotFileHeader header = {
+      .magic = SNAPSHOT_MAGIC,
+      .kind = kind,
+      .id = id,
+      .base_id = base_id,
+      .chunk_size = SNAPSHOT_CHUNK_SIZE,
+    };
+
+    file_write(f, &header, sizeof(SnapshotFileHeader));
+    return begin_snapshot_writer(arena, f);
+  }
+
+  static void read_snapshot_file_header(File* f, SnapshotFileHeader* header) {
+    if(file_size(f) < sizeof(SnapshotFileHeader)) {
+      panic("Attempted to load a snapshot but it was too small to be a snapshot!\n");
+    }
+
+    file_read(f, header, sizeof(SnapshotFileHeader));
+    if(header->magic != SNAPSHOT_MAGIC) {
+      panic("Attempted to load a snapshot but it was not the correct format!\n");
+    }
+  }
+
+  static SnapshotReader begin_snapshot_file_read(Arena* arena, File* f, SnapshotKind kind, SnapshotFileHeader* header) {
+    read_snapshot_file_header(f, header);
+    if(header->kind != kind) {
+      panic("Attempted to load a snapshot but it was not the correct format!\n");
+    }
+
+    return begin_snapshot_reader(arena, f, header->chunk_size);
+  }
+
+  static u64 get_mapped_piece_offset(u64 offset, u64 size) {
+    return size >= SNAPSHOT_PAGE_SIZE ? align_forward(offset, SNAPSHOT_PAGE_SIZE) : offset;
+  }
+
+  static SnapshotMappedWriter begin_snapshot_mapped_file(File* f, u64 id) {
+    static u8 zeros[SNAPSHOT_PAGE_SIZE] = {};
+
+    SnapshotFileHeader header = {
+      .magic = SNAPSHOT_MAGIC,
+      .kind = SnapshotKind::Mapped,
+      .id = id,
+      .base_id = 0,
+      .chunk_size = 0,
+    };
+
+    file_write(f, &header, sizeof(SnapshotFileHeader));
+    file_write(f, zeros, SNAPSHOT_PAGE_SIZE - sizeof(SnapshotFileHeader));
+
+    return SnapshotMappedWriter {
+      .file = f,
+      .offset = SNAPSHOT_PAGE_SIZE,
+    };
+  }
+
+  static void write_snapshot_mapped(SnapshotMappedWriter* w, void* src, u64 size) {
+    static u8 zeros[SNAPSHOT_PAGE_SIZE] = {};
+
+    u64 offset = get_mapped_piece_offset(w->offset, size);
+    file_write(w->file, zeros, offset - w->offset);
+    file_write(w->file, src, size);
+    w->offset = offset + size;
+  }
+
+  // A table has nothing to save if no word in [0, word_count) has a bit set.
+  // The empty flag summary tracks free slots instead, so that one is never skipped
+  static bool is_table_empty(EcsContext* ctx, u32 table, u32 word_count) {
+    if(table == ctx->empty_flag_id) {
+      return false;
+    }
+
+    u64* summary = ctx->component_summaries[table];
+    for_every(i, word_count / 64) {
+      if(summary[i] != 0) {
+        return false;
+      }
+    }
+
+    u32 tail = word_count % 64;
+    return tail == 0 || (summary[word_count / 64] & ((1ull << tail) - 1)) == 0;
+  }
+
+  // Keyframes only hold [0, last_entity] of every table, and skip the data of tables with no entities in that range.
+  // The static sections are written whole with their size so a different build gets caught.
+  // write(void* src, u64 size) gets every piece in file order
+  template <typename F>
+  static void write_keyframe(EcsContext* ctx, F write) {
+    for_every(i, static_sections.size()) {
+      u64 size = static_sections[i].size;
+      write(&size, sizeof(u64));
+      write(static_sections[i].ptr, size);
+    }
+
+    SnapshotEcsCounters counters = get_snapshot_ecs_counters(ctx);
+    write(&counters, sizeof(SnapshotEcsCounters));
+    write(&ctx->component_table_count, sizeof(u32));
+
+    u32 live_word_count = ctx->last_entity + 1;
+    u64 live_entity_count = (u64)live_word_count * 64;
+
+    for_every(i, ctx->component_table_count) {
+      u32 word_count = is_table_empty(ctx, i, live_word_count) ? 0 : live_word_count;
+      write(&word_count, sizeof(u32));
+
+      if(word_count == 0) {
+        continue;
+      }
+
+      write(ctx->component_bitsets[i], word_count * sizeof(u64));
+
+      u64 data_size = live_entity_count * ctx->component_sizes_in_bytes[i];
+      data_size = data_size < ctx->component_commit_sizes[i] ? data_size : ctx->component_commit_sizes[i];
+      write(&data_size, sizeof(u64));
+      write(ctx->component_datas[i], data_size);
+    }
+  }
+
+  // The other side of write_keyframe(), read(void* dst, u64 size) fills every piece in file order
+  template <typename F>
+  static void read_keyframe(EcsContext* ctx, F read) {
+    for_every(i, static_sections.size()) {
+      u64 size = 0;
+      read(&size, sizeof(u64));
+      if(size != static_sections[i].size) {
+        panic("Tried to load a snapshot saved with a different " + static_sections[i].name.c_str() + " build!\n");
+      }
+
+      read(static_sections[i].ptr, size);
+    }
+
+    SnapshotEcsCounters counters = {};
+    read(&counters, sizeof(SnapshotEcsCounters));
+
+    u32 table_count = 0;
+    read(&table_count, sizeof(u32));
+    if(table_count != ctx->component_table_count) {
+      panic("Tried to load a snapshot with a different number of component tables!\n");
+    }
+
+    ctx->first_entity = counters.first_entity;
+    ctx->last_entity = counters.last_entity;
+    ctx->first_empty_entity = counters.first_empty_entity;
+    commit_ecs_entities(counters.entity_commit_count);
+
+    u32 commit_word_count = ctx->entity_commit_count / 64;
+    u32 live_word_count = counters.last_entity + 1;
+    live_word_count = live_word_count < commit_word_count ? live_word_count : commit_word_count;
+
+    for_every(i, ctx->component_table_count) {
+      u64* bitset = ctx->component_bitsets[i];
+
+      u32 word_count = 0;
+      read(&word_count, sizeof(u32));
+      if(word_count > live_word_count) {
+        panic("Attempted to load a snapshot but it was corrupted!\n");
+      }
+
+      read(bitset, word_count * sizeof(u64));
+
+      // skipped tables are empty up to last_entity, and past it everything reads as unused
+      u8 fill = i == ctx->empty_flag_id ? 0xff : 0x00;
+      memset(bitset + word_count, 0x00, (live_word_count - word_count) * sizeof(u64));
+      memset(bitset + live_word_count, fill, (commit_word_count - live_word_count) * sizeof(u64));
+
+      if(word_count == 0) {
+        continue;
+      }
+
+      u64 data_size = 0;
+      read(&data_size, sizeof(u64));
+      if(data_size != 0) {
+        u64 component_size = ctx->component_sizes_in_bytes[i];
+        u64 entity_count = (data_size + component_size - 1) / component_size;
+        entity_count = entity_count > ECS_MAX_STORAGE ? ECS_MAX_STORAGE : entity_count;
+        commit_ecs_table(i, entity_count);
+
+        read(ctx->component_datas[i], data_size);
+      }
+    }
+  }
+
+  // Fills an untracked base region with src, and zeros past it
+  static void fill_snapshot_base_region(SnapshotBaseRegion* base, u8* src, u64 size) {
+    if(base->tracked) {
+      return;
+    }
+
+    u64 count = size < base->size ? size : base->size;
+    base->data.assign(base->size, 0);
+    if(count != 0) {
+      copy_mem(base->data.data(), src, count);
+    }
+  }
+
+  // Fills the untracked regions of the base from a keyframe payload, the way loading that keyframe would leave them.
+  // The base has to be sized by capture_snapshot_base() first. Mapped payloads are padded like write_snapshot_mapped()
+  static void fill_snapshot_base_from_keyframe(EcsContext* ctx, u8* payload, bool mapped) {
+    u64 offset = SNAPSHOT_PAGE_SIZE;
+    auto read = [&](u64 size) {
+      if(mapped) {
+        offset = get_mapped_piece_offset(offset, size);
+      }
+
+      u8* src = payload + offset - SNAPSHOT_PAGE_SIZE;
+      offset += size;
+      return src;
+    };
+
+    SnapshotBaseRegion* base = _snapshot_base.data();
+
+    for_every(i, static_sections.size()) {
+      u64 size = 0;
+      copy_mem(&size, read(sizeof(u64)), sizeof(u64));
+      fill_snapshot_base_region(base++, read(size), size);
+    }
+
+    SnapshotEcsCounters counters = {};
+    copy_mem(&counters, read(sizeof(SnapshotEcsCounters)), sizeof(SnapshotEcsCounters));
+    fill_snapshot_base_region(base++, (u8*)&counters, sizeof(SnapshotEcsCounters));
+
+    u32 table_count = 0;
+    copy_mem(&table_count, read(sizeof(u32)), sizeof(u32));
+
+    SnapshotBaseRegion* bitset_bases = base;
+    SnapshotBaseRegion* data_bases = base + table_count;
+
+    for_every(i, table_count) {
+      u32 word_count = 0;
+      copy_mem(&word_count, read(sizeof(u32)), sizeof(u32));
+
+      // Same fill as read_keyframe(), everything past last_entity reads as unused
+      SnapshotBaseRegion* bitset_base = &bitset_bases[i];
+      u8* bitset = read(word_count * sizeof(u64));
+      fill_snapshot_base_region(bitset_base, bitset, word_count * sizeof(u64));
+
+      u64 live_size = (u64)(counters.last_entity + 1) * sizeof(u64);
+      if(!bitset_base->tracked && i == ctx->empty_flag_id && live_size < bitset_base->size) {
+        memset(bitset_base->data.data() + live_size, 0xff, bitset_base->size - live_size);
+      }
+
+      if(word_count == 0) {
+        fill_snapshot_base_region(&data_bases[i], bitset, 0);
+        continue;
+      }
+
+      u64 data_size = 0;
+      copy_mem(&data_size, read(sizeof(u64)), sizeof(u64));
+      fill_snapshot_base_region(&data_bases[i], read(data_size), data_size);
+    }
+  }
+
+//
+// Background Snapshots
+//
+
+  // Only one save is in flight at a time, the payload lives in the arena until the thread is joined
+  struct BackgroundSnapshotSave {
+    bool in_flight;
+    std::atomic_bool finished;
+    std::thread thread;
+    Arena* arena;
+    File* file;
+    bool mapped;
+    SnapshotWriter writer;
+    u8* payload;
+    u64 payload_size;
+    bool fill_base;
+    u64 file_bytes;
+    Timestamp start_time;
+  };
+
+  BackgroundSnapshotSave _background_save;
+
+  // Joins the save thread once it is done, returns false if it is still writing and wait is false
+  static bool finish_background_snapshot_save(bool wait) {
+    BackgroundSnapshotSave* save = &_background_save;
+    if(!save->in_flight) {
+      return true;
+    }
+
+    if(!wait && !save->finished.load()) {
+      return false;
+    }
+
+    save->thread.join();
+    free_arena(save->arena);
+    save->in_flight = false;
+
+    f64 delta_time = get_timestamp_difference(save->start_time, get_timestamp());
+    log_message("Background snapshot save took " + (f32)delta_time * 1000.0f + "ms, " + (f32)save->file_bytes / (f32)MB + "mb");
+    return true;
+  }
+
+  bool is_snapshot_save_finished() {
+    return finish_background_snapshot_save(false);
+  }
+
+  void wait_for_snapshot_save() {
+    finish_background_snapshot_save(true);
+  }
+
+  void save_snapshot_async(const char* file) {
+    wait_for_snapshot_save();
+    find_static_sections();
+
+    BackgroundSnapshotSave* save = &_background_save;
+    save->start_time = get_timestamp();
+
+    EcsContext* ctx = get_resource(EcsContext);
+
+    save->arena = get_arena();
+    save->file = open_file_panic_with_error(file, "wb", "Failed to open snapshot file for saving!\n");
+
+    // Writes after this go in the next delta, the thread fills the rest of the base from the payload
+    u64 id = create_snapshot_id();
+    save->fill_base = capture_snapshot_base(ctx, id, false);
+
+    // The capture is the only part the frame pays for, the payload is the keyframe before compression.
+    // Mapped payloads are padded like write_snapshot_mapped() so the thread only has to write them out
+    save->mapped = SNAPSHOT_MAPPED;
+    save->payload = arena_push_with_alignment(save->arena, 0, 1);
+
+    u64 offset = SNAPSHOT_PAGE_SIZE;
+    write_keyframe(ctx, [save, &offset](void* src, u64 size) {
+      if(save->mapped) {
+        u64 aligned = get_mapped_piece_offset(offset, size);
+        arena_push_zero_with_alignment(save->arena, aligned - offset, 1);
+        offset = aligned + size;
+      }
+
+      arena_copy_with_alignment(save->arena, src, size, 1);
+    });
+    save->payload_size = arena_push_with_alignment(save->arena, 0, 1) - save->payload;
+
+    if(save->mapped) {
+      begin_snapshot_mapped_file(save->file, id);
+    } else {
+      save->writer = begin_snapshot_file(save->arena, save->file, SnapshotKind::Keyframe, id, 0);
+    }
+
+    Timestamp t1 = get_timestamp();
+    log_message("Capturing snapshot took " + (f32)get_timestamp_difference(save->start_time, t1) * 1000.0f + "ms");
+
+    save->in_flight = true;
+    save->finished.store(false);
+    save->thread = std::thread([save, ctx]() {
+      if(save->mapped) {
+        file_write(save->file, save->payload, save->payload_size);
+        save->file_bytes = SNAPSHOT_PAGE_SIZE + save->payload_size;
+      } else {
+        write_snapshot(&save->writer, save->payload, save->payload_size);
+        end_snapshot_writer(&save->writer);
+        save->file_bytes = sizeof(SnapshotFileHeader) + save->writer.compressed_size;
+      }
+
+      close_file(save->file);
+
+      if(save->fill_base) {
+        fill_snapshot_base_from_keyframe(ctx, save->payload, save->mapped);
+      }
+
+      save->finished.store(true);
+    });
+  }
+
+//
+// Snapshots
+//
+
+  void save_snapshot(const char* file) {
+    wait_for_snapshot_save();
+    find_static_sections();
 
     Timestamp t0 = get_timestamp();
+    u64 file_bytes = 0;
     defer({
       Timestamp t1 = get_timestamp();
       f64 delta_time = get_timestamp_difference(t0, t1);
-      log_message("Saving snapshot took " + (f32)delta_time * 1000.0f + "ms");
+      log_message("Saving snapshot took " + (f32)delta_time * 1000.0f + "ms, " + (f32)file_bytes / (f32)MB + "mb");
     });
 
     File* f = open_file_panic_with_error(file, "wb", "Failed to open snapshot file for saving!\n");
@@ -130,34 +847,31 @@ namespace quark {
     Arena* arena = get_arena();
     defer(free_arena(arena));
 
-    FileBuffer b = create_fileb(arena);
-
-    for_every(i, static_sections.size()) {
-      write_fileb(&b, static_sections[i].ptr, 1, static_sections[i].size);
-    }
+    // Capture the base before writing so writes from here on land in the next delta
+    u64 id = create_snapshot_id();
+    capture_snapshot_base(ctx, id);
 
-    write_fileb(&b, &ctx->first_entity, sizeof(u32), 1);
-    write_fileb(&b, &ctx->last_entity, sizeof(u32), 1);
-    write_fileb(&b, &ctx->first_empty_entity, sizeof(u32), 1);
-    for_every(i, ctx->component_table_count) {
-      write_fileb(&b, ctx->component_bitsets[i], sizeof(u32), ECS_MAX_STORAGE / 32);
-      write_fileb(&b, ctx->component_datas[i], ctx->component_sizes_in_bytes[i], ECS_MAX_STORAGE);
-    }
+    if(SNAPSHOT_MAPPED) {
+      SnapshotMappedWriter w = begin_snapshot_mapped_file(f, id);
+      write_keyframe(ctx, [&](void* src, u64 size) {
+        write_snapshot_mapped(&w, src, size);
+      });
 
-    u8* ptr = arena_push(arena, 8 * MB);
-    i32 compress_size = LZ4_compress_default((const char*)b.start, (char*)ptr, b.size, 8 * MB);
+      file_bytes = w.offset;
+    } else {
+      SnapshotWriter w = begin_snapshot_file(arena, f, SnapshotKind::Keyframe, id, 0);
+      write_keyframe(ctx, [&](void* src, u64 size) {
+        write_snapshot(&w, src, size);
+      });
 
-    file_write(f, ptr, compress_size);
+      end_snapshot_writer(&w);
+      file_bytes = sizeof(SnapshotFileHeader) + w.compressed_size;
+    }
   }
 
   void load_snapshot(const char* file) {
-    for_every(i, static_sections.size()) {
-      StaticSection* section = &static_sections[i];
-      if(section->ptr == 0) {
-        print("Found section for: " + section->name.c_str());
-        find_static_section(section->name.c_str(), &section->size, &section->ptr);
-      }
-    }
+    wait_for_snapshot_save();
+    find_static_sections();
 
     Timestamp t0 = get_timestamp();
     defer({
@@ -179,40 +893,266 @@ namespace quark {
 
     EcsContext* ctx = get_resource(EcsContext);
 
-    FileBuffer b = create_fileb(arena);
+    SnapshotFileHeader header = {};
+    read_snapshot_file_header(f, &header);
+
+    if(header.kind == SnapshotKind::Mapped) {
+      // One pass straight from the page cache, instead of read + decompress + copy
+      MappedFile mapped = {};
+      if(!map_file(&mapped, file, true)) {
+        panic("Failed to map snapshot state file for loading!\n");
+      }
+      defer(unmap_file(&mapped));
+
+      u64 offset = SNAPSHOT_PAGE_SIZE;
+      read_keyframe(ctx, [&](void* dst, u64 size) {
+        offset = get_mapped_piece_offset(offset, size);
+        if(offset + size > mapped.size) {
+          panic("Attempted to load a snapshot but it was corrupted!\n");
+        }
+
+        copy_mem(dst, mapped.data + offset, size);
+        offset += size;
+      });
+    } else if(header.kind == SnapshotKind::Keyframe) {
+      SnapshotReader r = begin_snapshot_reader(arena, f, header.chunk_size);
+      read_keyframe(ctx, [&](void* dst, u64 size) {
+        read_snapshot(&r, dst, size);
+      });
+    } else {
+      panic("Attempted to load a snapshot but it was not the correct format!\n");
+    }
+
+    update_ecs_summaries();
+    update_ecs_free_entities();
+    capture_snapshot_base(ctx, header.id);
+  }
+
+//
+// Snapshot Deltas
+//
+
+  // Pages past the end of the base are always dirty. Tracked regions ask the os which pages got written,
+  // and assume every page did if it can't tell, untracked ones diff against their copy
+  static void find_snapshot_dirty_pages(Arena* arena, SnapshotRegion* region, SnapshotBaseRegion* base, std::vector<u32>* dirty_pages) {
+    TempStack stack = begin_temp_stack(arena);
+    defer(end_temp_stack(stack));
+
+    u64 page_count = (region->size + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE;
+    u64* written_pages = arena_push_array_zero(arena, u64, page_count / 64 + 1);
+    bool written_known = base->tracked && os_get_written_pages(region->ptr, region->size, SNAPSHOT_PAGE_SIZE, written_pages);
+
+    for_every(j, page_count) {
+      u64 offset = j * SNAPSHOT_PAGE_SIZE;
+      u64 page_size = region->size - offset < SNAPSHOT_PAGE_SIZE ? region->size - offset : SNAPSHOT_PAGE_SIZE;
+
+      bool dirty = offset + page_size > base->size;
+      if(!dirty && base->tracked) {
+        dirty = !written_known || (written_pages[j / 64] & (1ull << (j % 64))) != 0;
+      } else if(!dirty) {
+        dirty = memcmp(region->ptr + offset, base->data.data() + offset, page_size) != 0;
+      }
+
+      if(dirty) {
+        dirty_pages->push_back(j);
+      }
+    }
+  }
+
+  void save_snapshot_delta(const char* file) {
+    wait_for_snapshot_save();
+    find_static_sections();
+
+    Timestamp t0 = get_timestamp();
+    u64 dirty_size = 0;
+    defer({
+      Timestamp t1 = get_timestamp();
+      f64 delta_time = get_timestamp_difference(t0, t1);
+      log_message("Saving snapshot delta took " + (f32)delta_time * 1000.0f + "ms, " + (f32)dirty_size / (f32)KB + "kb changed");
+    });
+
+    EcsContext* ctx = get_resource(EcsContext);
+
+    SnapshotEcsCounters counters = get_snapshot_ecs_counters(ctx);
+    std::vector<SnapshotRegion> regions = get_snapshot_regions(ctx, &counters);
 
-    usize fsize = file_size(f);
+    if(_snapshot_base_id == 0 || _snapshot_base.size() != regions.size()) {
+      panic("Tried to save a snapshot delta without a base, save or load a full snapshot first!\n");
+    }
+
+    File* f = open_file_panic_with_error(file, "wb", "Failed to open snapshot delta file for saving!\n");
+    defer(close_file(f));
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    u64 id = create_snapshot_id();
+    SnapshotWriter w = begin_snapshot_file(arena, f, SnapshotKind::Delta, id, _snapshot_base_id);
+
+    std::vector<std::vector<u32>> dirty_pages(regions.size());
+    for_every(i, regions.size()) {
+      find_snapshot_dirty_pages(arena, &regions[i], &_snapshot_base[i], &dirty_pages[i]);
+    }
+
+    // Reset before the pages get read, so a write that lands in between shows up in the next delta instead of getting lost
+    reset_snapshot_write_tracking(&regions);
+
+    // Every region is its size, the indices of the pages that changed since the base, then those pages.
+    // Untracked regions copy the new pages into the base so the next delta chains on top of this one
+    for_every(i, regions.size()) {
+      SnapshotRegion* region = &regions[i];
+      SnapshotBaseRegion* base = &_snapshot_base[i];
+      std::vector<u32>* pages = &dirty_pages[i];
+
+      u32 dirty_page_count = pages->size();
+      write_snapshot(&w, &region->size, sizeof(u64));
+      write_snapshot(&w, &dirty_page_count, sizeof(u32));
+      write_snapshot(&w, pages->data(), dirty_page_count * sizeof(u32));
+
+      base->size = region->size;
+      if(!base->tracked) {
+        base->data.resize(region->size);
+      }
+
+      for_every(j, dirty_page_count) {
+        u64 offset = (*pages)[j] * SNAPSHOT_PAGE_SIZE;
+        u64 page_size = region->size - offset < SNAPSHOT_PAGE_SIZE ? region->size - offset : SNAPSHOT_PAGE_SIZE;
+
+        write_snapshot(&w, region->ptr + offset, page_size);
+        if(!base->tracked) {
+          copy_mem(base->data.data() + offset, region->ptr + offset, page_size);
+        }
+
+        dirty_size += page_size;
+      }
+    }
+
+    end_snapshot_writer(&w);
+
+    _snapshot_base_id = id;
+  }
 
-    u8* ptr = arena_push(arena, 8 * MB);
-    file_read(f, ptr, fsize);
+  static u64 read_snapshot_delta_region_size(SnapshotReader* r) {
+    u64 size = 0;
+    read_snapshot(r, &size, sizeof(u64));
+    return size;
+  }
 
-    b.start = arena_push(arena, 64 * MB);
-    b.size = LZ4_decompress_safe((const char*)ptr, (char*)b.start, fsize, 64 * MB);
+  // dst has to be backed for size bytes
+  static void apply_snapshot_delta_region(SnapshotReader* r, u8* dst, u64 size, SnapshotBaseRegion* base, std::vector<u32>* dirty_pages) {
+    u32 dirty_page_count = 0;
+    read_snapshot(r, &dirty_page_count, sizeof(u32));
 
-    Timestamp s0 = get_timestamp();
+    dirty_pages->resize(dirty_page_count);
+    read_snapshot(r, dirty_pages->data(), dirty_page_count * sizeof(u32));
+
+    base->size = size;
+    if(!base->tracked) {
+      base->data.resize(size);
+    }
+
+    for_every(j, dirty_page_count) {
+      u64 offset = (u64)(*dirty_pages)[j] * SNAPSHOT_PAGE_SIZE;
+      if(offset >= size) {
+        panic("Attempted to load a snapshot delta but it was corrupted!\n");
+      }
+
+      u64 page_size = size - offset < SNAPSHOT_PAGE_SIZE ? size - offset : SNAPSHOT_PAGE_SIZE;
+
+      read_snapshot(r, dst + offset, page_size);
+      if(!base->tracked) {
+        copy_mem(base->data.data() + offset, dst + offset, page_size);
+      }
+    }
+  }
+
+  void load_snapshot_delta(const char* file) {
+    wait_for_snapshot_save();
+    find_static_sections();
+
+    Timestamp t0 = get_timestamp();
+    defer({
+      Timestamp t1 = get_timestamp();
+      f64 delta_time = get_timestamp_difference(t0, t1);
+      log_message("Loading snapshot delta took " + (f32)delta_time * 1000.0f + "ms");
+    });
+
+    Arena* arena = get_arena();
+    defer(free_arena(arena));
+
+    File* f = open_file_panic_with_error(file, "rb", "Failed to open snapshot delta file for loading!\n");
+    defer(close_file(f));
+
+    EcsContext* ctx = get_resource(EcsContext);
+
+    SnapshotFileHeader header = {};
+    SnapshotReader r = begin_snapshot_file_read(arena, f, SnapshotKind::Delta, &header);
+
+    if(header.base_id == 0 || header.base_id != _snapshot_base_id) {
+      panic("Tried to load a snapshot delta that does not go on top of the current state, load the snapshots before it first!\n");
+    }
+
+    if(_snapshot_base.size() != static_sections.size() + 1 + 2 * ctx->component_table_count) {
+      panic("Tried to load a snapshot delta but the snapshot base does not match the world!\n");
+    }
+
+    SnapshotBaseRegion* base = _snapshot_base.data();
+    std::vector<u32> dirty_pages;
 
     for_every(i, static_sections.size()) {
-      read_fileb(&b, static_sections[i].ptr, 1, static_sections[i].size);
+      u64 size = read_snapshot_delta_region_size(&r);
+      if(size != static_sections[i].size) {
+        panic("Tried to load a snapshot delta saved with a different " + static_sections[i].name.c_str() + " build!\n");
+      }
+
+      apply_snapshot_delta_region(&r, (u8*)static_sections[i].ptr, size, base++, &dirty_pages);
+    }
+
+    SnapshotEcsCounters counters = get_snapshot_ecs_counters(ctx);
+    if(read_snapshot_delta_region_size(&r) != sizeof(SnapshotEcsCounters)) {
+      panic("Attempted to load a snapshot delta but it was corrupted!\n");
     }
 
-    read_fileb(&b, &ctx->first_entity, sizeof(u32), 1);
-    read_fileb(&b, &ctx->last_entity, sizeof(u32), 1);
-    read_fileb(&b, &ctx->first_empty_entity, sizeof(u32), 1);
+    apply_snapshot_delta_region(&r, (u8*)&counters, sizeof(SnapshotEcsCounters), base++, &dirty_pages);
+
+    ctx->first_entity = counters.first_entity;
+    ctx->last_entity = counters.last_entity;
+    ctx->first_empty_entity = counters.first_empty_entity;
+    commit_ecs_entities(counters.entity_commit_count);
+
     for_every(i, ctx->component_table_count) {
-      read_fileb(&b, ctx->component_bitsets[i], sizeof(u32), ECS_MAX_STORAGE / 32);
-      read_fileb(&b, ctx->component_datas[i], ctx->component_sizes_in_bytes[i], ECS_MAX_STORAGE);
+      u64 size = read_snapshot_delta_region_size(&r);
+      if(size > ctx->entity_commit_count / 8) {
+        panic("Attempted to load a snapshot delta but it was corrupted!\n");
+      }
+
+      apply_snapshot_delta_region(&r, (u8*)ctx->component_bitsets[i], size, base++, &dirty_pages);
     }
-    Timestamp s1 = get_timestamp();
-    #ifdef DEBUG
-    log_message("Time to read_fileb: " + (f32)get_timestamp_difference(s0, s1) * 1000.0f + "ms, " + (f32)b.size / (f32)(1 * MB) +"mb");
-    #endif
 
-    // fread(&ctx->ecs_entity_head, sizeof(u32), 1, f);
-    // fread(&ctx->ecs_entity_tail, sizeof(u32), 1, f);
-    // for_every(i, ctx->ecs_table_count) {
-    //   fread(ctx->ecs_bool_table[i], sizeof(u32), ECS_MAX_STORAGE / 32, f);
-    //   fread(ctx->ecs_comp_table[i], ctx->ecs_comp_sizes[i], ECS_MAX_STORAGE, f);
-    // }
-  }
+    for_every(i, ctx->component_table_count) {
+      u64 size = read_snapshot_delta_region_size(&r);
+      if(size != 0) {
+        u64 component_size = ctx->component_sizes_in_bytes[i];
+        u64 entity_count = (size + component_size - 1) / component_size;
+        entity_count = entity_count > ECS_MAX_STORAGE ? ECS_MAX_STORAGE : entity_count;
+        commit_ecs_table(i, entity_count);
+      }
+
+      if(size > ctx->component_commit_sizes[i]) {
+        panic("Attempted to load a snapshot delta but it was corrupted!\n");
+      }
 
+      apply_snapshot_delta_region(&r, (u8*)ctx->component_datas[i], size, base++, &dirty_pages);
+    }
+
+    update_ecs_summaries();
+    update_ecs_free_entities();
+
+    // Loading wrote every dirty page, those are part of the base now
+    counters = get_snapshot_ecs_counters(ctx);
+    std::vector<SnapshotRegion> regions = get_snapshot_regions(ctx, &counters);
+    reset_snapshot_write_tracking(&regions);
+
+    _snapshot_base_id = header.id;
+  }
 };
@@ -53,7 +53,7 @@ namespace quark {
 
     _ui->ptr = (UiVertex*)map_buffer(&_ui->ui_vertex_buffers[0]);
 
-    {
+    if(!HEADLESS) {
       VkPipelineLayoutCreateInfo layout_info = {};
       layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
       layout_info.setLayoutCount = 0;
@@ -278,19 +278,22 @@ namespace quark {
 
     unmap_buffer(&_ui->ui_vertex_buffers[_resource_index]);
 
-    // Info: draw depth only
-    VkDeviceSize offsets[] = { 0, };
-    VkBuffer buffers[] = {
-      _ui->ui_vertex_buffers[_resource_index].buffer,
-    };
+    // The vertices still get built when HEADLESS, only the draw is skipped
+    if(!HEADLESS) {
+      // Info: draw depth only
+      VkDeviceSize offsets[] = { 0, };
+      VkBuffer buffers[] = {
+        _ui->ui_vertex_buffers[_resource_index].buffer,
+      };
 
-    vkCmdBindVertexBuffers(commands, 0, count_of(buffers), buffers, offsets);
+      vkCmdBindVertexBuffers(commands, 0, count_of(buffers), buffers, offsets);
 
-    VkPipeline pipeline = _ui->ui_pipeline;
+      VkPipeline pipeline = _ui->ui_pipeline;
 
-    vkCmdBindPipeline(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      vkCmdBindPipeline(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-    vkCmdDraw(commands, _ui->ui_vertex_count, 1, 0, 0);
+      vkCmdDraw(commands, _ui->ui_vertex_count, 1, 0, 0);
+    }
 
     _ui->ui_vertex_count = 0;
 
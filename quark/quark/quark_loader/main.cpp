@@ -12,6 +12,8 @@ using namespace quark;
 
 #if defined(_WIN32) || defined(_WIN64)
   static const char* LIB_EXT = ".dll";
+#else
+  static const char* LIB_EXT = ".so";
 #endif
 
 std::vector<std::string> parse_deps(const char* deps) {
@@ -44,7 +46,19 @@ std::vector<std::string> parse_deps(const char* deps) {
   return values;
 }
 
-int main() {
+int main(int argc, char** argv) {
+  // --headless runs without a window or gpu, so the cpu side of a frame can be profiled anywhere
+  // --benchmarks lets plugins register their benchmarks
+  for(int i = 1; i < argc; i += 1) {
+    if(strcmp(argv[i], "--headless") == 0) {
+      quark::HEADLESS = true;
+    }
+
+    if(strcmp(argv[i], "--benchmarks") == 0) {
+      quark::RUN_BENCHMARKS = true;
+    }
+  }
+
   quark::init();
 
   // TODO(sean): automatic library dep shit loading shit
@@ -95,6 +109,8 @@ int main() {
 
   #ifdef _WIN64
   quark::add_plugin_name("quark_engine.dll");
+  #else
+  quark::add_plugin_name("libquark_engine.so");
   #endif
   quark::run();
 
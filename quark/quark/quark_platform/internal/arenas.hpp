@@ -8,6 +8,23 @@
 namespace quark {
 #endif
 
+//
+// Commit
+//
+
+  inline void arena_commit(Arena* arena, u8* ptr, usize size) {
+    if(arena->page_kind == PageKind::Small) {
+      os_commit_mem(ptr, size);
+      return;
+    }
+
+    // An arena is only reported as huge as its worst backed range
+    PageKind kind = os_commit_mem_huge(ptr, size);
+    if((u32)kind < (u32)arena->page_kind) {
+      arena->page_kind = kind;
+    }
+  }
+
 //
 // Custom Alignment
 //
@@ -20,7 +37,7 @@ namespace quark {
   
     // lazy
     while(arena->position > arena->commit_size) {
-      os_commit_mem(arena->ptr + arena->commit_size, arena->commit_size);
+      arena_commit(arena, arena->ptr + arena->commit_size, arena->commit_size);
       arena->commit_size *= 2;
     }
   
@@ -103,7 +120,9 @@ namespace quark {
   }
   
   inline void arena_reset(Arena* arena) {
-    os_decommit_mem(arena->ptr + 2 * MB, arena->position - 2 * MB);
+    if(arena->commit_size > 2 * MB) {
+      os_decommit_mem(arena->ptr + 2 * MB, arena->commit_size - 2 * MB);
+    }
   
     arena->position = 0;
     arena->commit_size = 2 * MB;
@@ -0,0 +1,47 @@
+#pragma once
+
+// This file is only meant to be included inside of quark_platform.hpp
+// quark_platform.hpp is included so LSP works
+#include "../quark_platform.hpp"
+
+#ifndef QUARK_PLATFORM_INLINES
+namespace quark {
+#endif
+
+//
+// Job Spawning
+//
+
+  template <typename F>
+  inline void job_spawn(JobCounter* counter, F f) {
+    static_assert(sizeof(F) <= JOB_DATA_SIZE, "Job captures too much state, capture a pointer to it instead!");
+    static_assert(alignof(F) <= 16, "Job captures are over-aligned!");
+    static_assert(std::is_trivially_copyable<F>::value, "Job captures must be trivially copyable!");
+
+    Job job;
+    job.function = [](void* data) { (*(F*)data)(); };
+    job.counter = counter;
+    copy_mem(job.data, &f, sizeof(F));
+
+    job_push(&job);
+  }
+
+  template <typename F>
+  inline void job_parallel_for(usize count, usize batch_size, F f) {
+    JobCounter counter = {};
+    F* f_ptr = &f;
+
+    for(usize start = 0; start < count; start += batch_size) {
+      usize end = (start + batch_size) < count ? (start + batch_size) : count;
+
+      job_spawn(&counter, [f_ptr, start, end]() {
+        (*f_ptr)(start, end);
+      });
+    }
+
+    job_wait(&counter);
+  }
+
+#ifndef QUARK_PLATFORM_INLINES
+};
+#endif
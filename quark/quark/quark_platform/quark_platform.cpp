@@ -4,9 +4,12 @@
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Weverything"
 
-  #include <io.h>
   #include <stdio.h>
+  #include <stdarg.h>
 
+  #include <atomic>
+  #include <condition_variable>
+  #include <mutex>
   #include <string>
   #include <thread>
 
@@ -14,8 +17,21 @@
 
     // @info disabled until application security is actually needed
     #define _CRT_SECURE_NO_WARNINGS
+    #include <io.h>
     #include <windows.h>
 
+  #else
+
+    #include <dlfcn.h>
+    #include <errno.h>
+    #include <execinfo.h>
+    #include <fcntl.h>
+    #include <string.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <time.h>
+    #include <unistd.h>
+
   #endif
 
 #pragma clang diagnostic pop
@@ -25,7 +41,10 @@ namespace quark {
 // Window API
 //
 
+  bool HEADLESS = false;
+
   GLFWwindow* _window_ptr;
+  bool _window_should_close = false; // Only used when HEADLESS
   std::string _window_name;
   ivec2 _window_dimensions;
   bool _window_enable_cursor = false;
@@ -37,7 +56,6 @@ namespace quark {
   vec2 _window_mouse_pos_accum;
   vec2 _window_scroll_pos_accum;
 
-  ThreadPool* _thread_pool;
   thread_id _main_thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
 
   vec2 _mouse_position;
@@ -90,6 +108,15 @@ namespace quark {
       panic("Attempted to create the window twice!");
     }
 
+    // No monitor to ask, so use a fixed size unless one was set
+    if(HEADLESS) {
+      if(_window_dimensions.x <= 0 || _window_dimensions.y <= 0) {
+        _window_dimensions = { 1920, 1080 };
+      }
+
+      return;
+    }
+
     glfwInit();
 
     if(!glfwVulkanSupported()) {
@@ -130,6 +157,10 @@ namespace quark {
   }
 
   void deinit_window() {
+    if(HEADLESS) {
+      return;
+    }
+
     glfwDestroyWindow(_window_ptr);
     glfwTerminate();
   }
@@ -147,14 +178,27 @@ namespace quark {
   }
 
   bool get_window_should_close() {
+    if(HEADLESS) {
+      return _window_should_close;
+    }
+
     return glfwWindowShouldClose(_window_ptr) == GLFW_TRUE;
   }
 
   MouseMode get_mouse_mode() {
+    if(HEADLESS) {
+      return MouseMode::Visible;
+    }
+
     return (MouseMode)glfwGetInputMode(_window_ptr, GLFW_CURSOR);
   }
 
   void set_window_name(const char* window_name) {
+    if(HEADLESS) {
+      _window_name = window_name;
+      return;
+    }
+
     glfwSetWindowTitle(_window_ptr, window_name);
   }
 
@@ -163,10 +207,19 @@ namespace quark {
   }
 
   void set_window_should_close() {
+    if(HEADLESS) {
+      _window_should_close = true;
+      return;
+    }
+
     glfwSetWindowShouldClose(_window_ptr, GLFW_TRUE);
   }
 
   void set_mouse_mode(MouseMode mouse_mode) {
+    if(HEADLESS) {
+      return;
+    }
+
     glfwSetInputMode(_window_ptr, GLFW_CURSOR, (i32)mouse_mode);
   }
 
@@ -237,11 +290,19 @@ namespace quark {
   }
 
   InputState get_key_state(KeyCode key) {
+    if(HEADLESS) {
+      return InputState::Release;
+    }
+
     int code = RawInputId { .bits = (i32)key }.value;
     return (InputState)glfwGetKey(_window_ptr, code);
   }
 
   InputState get_mouse_button_state(MouseButtonCode mouse_button) {
+    if(HEADLESS) {
+      return InputState::Release;
+    }
+
     int code = RawInputId { .bits = (i32)mouse_button }.value;
     return (InputState)glfwGetMouseButton(_window_ptr, code);
   }
@@ -336,7 +397,9 @@ namespace quark {
 //
 
   void update_window_inputs() {
-    glfwPollEvents();
+    if(!HEADLESS) {
+      glfwPollEvents();
+    }
 
     _mouse_position -= _mouse_accumulator;
     _scroll_position += _scroll_accumulator;
@@ -352,8 +415,35 @@ namespace quark {
 // Timing API
 //
 
+#ifdef _WIN64
+
+  // Query the performance counter directly, glfwGetTime() needs glfwInit() which HEADLESS skips
+  static Timestamp get_monotonic_time() {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (Timestamp)counter.QuadPart / (Timestamp)frequency.QuadPart;
+  }
+
+#else
+
+  static Timestamp get_monotonic_time() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (Timestamp)ts.tv_sec + (Timestamp)ts.tv_nsec / 1000000000.0;
+  }
+
+#endif
+
+  // Rebase on load so timestamps stay small like glfwGetTime(),
+  // some callers narrow these to f32
+  static Timestamp _timestamp_base = get_monotonic_time();
+
   Timestamp get_timestamp() {
-    return glfwGetTime();
+    return get_monotonic_time() - _timestamp_base;
   }
 
   Timestamp get_timestamp_difference(Timestamp t0, Timestamp t1) {
@@ -361,38 +451,319 @@ namespace quark {
   }
 
 //
-// Threadpool API
+// Job System API
 //
 
+  // Chase-Lev work stealing deque, the owning worker pushes and pops at the bottom
+  // while other workers steal from the top
+  // "Correct and Efficient Work-Stealing for Weak Memory Models" (Le, Pop, Cohen, Nardelli 2013)
+  constexpr i64 JOB_DEQUE_CAPACITY = 4096;
+  constexpr i64 JOB_DEQUE_MASK = JOB_DEQUE_CAPACITY - 1;
+
+  struct alignas(64) JobDeque {
+    std::atomic_int64_t top;
+    alignas(64) std::atomic_int64_t bottom;
+    alignas(64) Job jobs[JOB_DEQUE_CAPACITY];
+  };
+
+  static bool job_deque_push(JobDeque* deque, Job* job) {
+    i64 b = deque->bottom.load(std::memory_order_relaxed);
+    i64 t = deque->top.load(std::memory_order_acquire);
+
+    if(b - t >= JOB_DEQUE_CAPACITY) {
+      return false;
+    }
+
+    deque->jobs[b & JOB_DEQUE_MASK] = *job;
+    std::atomic_thread_fence(std::memory_order_release);
+    deque->bottom.store(b + 1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  static bool job_deque_pop(JobDeque* deque, Job* out_job) {
+    i64 b = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64 t = deque->top.load(std::memory_order_relaxed);
+
+    // Empty
+    if(t > b) {
+      deque->bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    *out_job = deque->jobs[b & JOB_DEQUE_MASK];
+
+    // Last job, race the thieves for it
+    if(t == b) {
+      bool won = deque->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      deque->bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+
+    return true;
+  }
+
+  static bool job_deque_steal(JobDeque* deque, Job* out_job) {
+    i64 t = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64 b = deque->bottom.load(std::memory_order_acquire);
+
+    if(t >= b) {
+      return false;
+    }
+
+    Job job = deque->jobs[t & JOB_DEQUE_MASK];
+    if(!deque->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return false;
+    }
+
+    *out_job = job;
+    return true;
+  }
+
+  struct JobSystem {
+    i32 worker_count;
+    JobDeque* deques;
+    std::thread* threads;
+
+    // Number of jobs sitting in deques, used to put idle workers to sleep
+    std::atomic_int32_t queued_count;
+    std::atomic_int32_t sleeping_count;
+    std::atomic_bool quit;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+  };
+
+  static JobSystem _job_system = {};
+  static bool _job_system_initted = false;
+  static thread_local i32 _job_worker_index = -1;
+  static thread_local void* _job_context = 0;
+
+  static void job_run(Job* job) {
+    void* previous_context = _job_context;
+    _job_context = job->context;
+
+    job->function(job->data);
+
+    _job_context = previous_context;
+
+    if(job->counter != 0) {
+      job->counter->value.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  // Pop from our own deque first, then try to steal from everyone else
+  static bool job_try_run_one(i32 worker_index) {
+    Job job;
+
+    if(job_deque_pop(&_job_system.deques[worker_index], &job)) {
+      _job_system.queued_count.fetch_sub(1, std::memory_order_relaxed);
+      job_run(&job);
+      return true;
+    }
+
+    for_range(i, 1, _job_system.worker_count) {
+      i32 victim = (worker_index + i) % _job_system.worker_count;
+
+      if(job_deque_steal(&_job_system.deques[victim], &job)) {
+        _job_system.queued_count.fetch_sub(1, std::memory_order_relaxed);
+        job_run(&job);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  static void job_worker_main(i32 worker_index) {
+    _job_worker_index = worker_index;
+
+    while(!_job_system.quit.load(std::memory_order_relaxed)) {
+      if(job_try_run_one(worker_index)) {
+        continue;
+      }
+
+      // Spin for a little bit before going to sleep since work tends to come in bursts
+      bool found = false;
+      for_every(spin, 64) {
+        if(_job_system.queued_count.load(std::memory_order_relaxed) > 0) {
+          found = true;
+          break;
+        }
+
+        std::this_thread::yield();
+      }
+
+      if(found) {
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_job_system.sleep_mutex);
+      _job_system.sleeping_count.fetch_add(1, std::memory_order_seq_cst);
+      _job_system.sleep_condition.wait(lock, []() {
+        return _job_system.queued_count.load(std::memory_order_seq_cst) > 0 || _job_system.quit.load(std::memory_order_relaxed);
+      });
+      _job_system.sleeping_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
   void init_thread_pool() {
+    if(_job_system_initted) {
+      panic("Attempted to init the job system twice!");
+    }
+
     // TODO: do something smarter for thread count
-    _thread_pool = create_thread_pool(std::thread::hardware_concurrency() - 2, 1024);
+    i32 thread_count = (i32)std::thread::hardware_concurrency() - 2;
+    thread_count = thread_count < 1 ? 1 : thread_count;
+
+    _job_system.worker_count = thread_count + 1;
+    _job_system.deques = new JobDeque[_job_system.worker_count];
+    _job_system.threads = new std::thread[thread_count];
+
+    _job_system.queued_count = 0;
+    _job_system.sleeping_count = 0;
+    _job_system.quit = false;
+
+    // The calling (main) thread is worker 0
+    _job_worker_index = 0;
+    _job_system_initted = true;
+
+    for_every(i, thread_count) {
+      _job_system.threads[i] = std::thread(job_worker_main, (i32)i + 1);
+    }
+  }
+
+  void deinit_thread_pool() {
+    if(!_job_system_initted) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_job_system.sleep_mutex);
+      _job_system.quit = true;
+    }
+    _job_system.sleep_condition.notify_all();
+
+    for_every(i, _job_system.worker_count - 1) {
+      _job_system.threads[i].join();
+    }
+
+    delete[] _job_system.threads;
+    delete[] _job_system.deques;
+
+    _job_system_initted = false;
   }
 
-  void deinit_thread_pool() {}
+  void job_push(Job* job) {
+    job->context = _job_context;
+
+    if(job->counter != 0) {
+      job->counter->value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Nobody to hand the job to yet, so just run it
+    if(!_job_system_initted) {
+      job_run(job);
+      return;
+    }
+
+    if(_job_worker_index < 0) {
+      panic("job_push() called from a thread that is not part of the job system!");
+    }
+
+    // Deque is full, run it inline rather than growing
+    if(!job_deque_push(&_job_system.deques[_job_worker_index], job)) {
+      job_run(job);
+      return;
+    }
+
+    _job_system.queued_count.fetch_add(1, std::memory_order_seq_cst);
+
+    if(_job_system.sleeping_count.load(std::memory_order_seq_cst) > 0) {
+      std::lock_guard<std::mutex> lock(_job_system.sleep_mutex);
+      _job_system.sleep_condition.notify_one();
+    }
+  }
+
+  void job_wait(JobCounter* counter) {
+    while(counter->value.load(std::memory_order_acquire) > 0) {
+      if(_job_worker_index < 0 || !job_try_run_one(_job_worker_index)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  bool job_is_finished(JobCounter* counter) {
+    return counter->value.load(std::memory_order_acquire) == 0;
+  }
+
+  void* job_get_context() {
+    return _job_context;
+  }
+
+  void job_set_context(void* context) {
+    _job_context = context;
+  }
+
+  i32 job_worker_index() {
+    // Before init everything runs inline on the calling thread
+    return _job_system_initted ? _job_worker_index : 0;
+  }
+
+  i32 job_worker_count() {
+    return _job_system_initted ? _job_system.worker_count : 1;
+  }
 
   thread_id main_thread_id() {
     return _main_thread_id;
   }
 
+//
+// Threadpool API
+//
+
+  static JobCounter _thread_pool_counter = {};
+
   void thread_pool_push(VoidFunctionPtr work_func) {
-    ::thread_pool_push(_thread_pool, work_func);
+    job_spawn(&_thread_pool_counter, [work_func]() {
+      work_func();
+    });
   }
 
-  void thread_pool_start() {
-    ::thread_pool_start(_thread_pool);
-  }
+  void thread_pool_start() {}
 
   void thread_pool_join() {
-    ::thread_pool_join(_thread_pool);
+    job_wait(&_thread_pool_counter);
   }
 
   bool thread_pool_is_finished() {
-    return ::thread_pool_is_finished(_thread_pool);
+    return job_is_finished(&_thread_pool_counter);
   }
 
   isize thread_pool_thread_count() {
-    return (isize)::thread_pool_thread_count(_thread_pool);
+    return (isize)job_worker_count();
+  }
+
+//
+// Write Tracking API
+//
+
+  // Set the bit of every page of [ptr, ptr + size) that [start, end) overlaps
+  static void mark_written_pages(u8* ptr, usize size, usize page_size, u64* written_pages, u8* start, u8* end) {
+    start = start > ptr ? start : ptr;
+    end = end < ptr + size ? end : ptr + size;
+    if(start >= end) {
+      return;
+    }
+
+    usize first = (usize)(start - ptr) / page_size;
+    usize last = (usize)(end - 1 - ptr) / page_size;
+    for(usize i = first; i <= last; i += 1) {
+      written_pages[i / 64] |= 1ull << (i % 64);
+    }
   }
 
 //
@@ -461,8 +832,9 @@ namespace quark {
 // Memory API
 //
 
+  // Regular pages only, see os_commit_mem_huge()
   u8* os_reserve_mem(usize size) {
-    return (u8*)VirtualAlloc(0, size, MEM_RESERVE | MEM_PHYSICAL | MEM_LARGE_PAGES, PAGE_NOACCESS);
+    return (u8*)VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
   }
   
   void os_release_mem(u8* ptr) {
@@ -470,13 +842,113 @@ namespace quark {
   }
   
   void os_commit_mem(u8* ptr, usize size) {
-    VirtualAlloc(ptr, size, MEM_COMMIT | MEM_PHYSICAL | MEM_LARGE_PAGES, PAGE_READWRITE);
+    VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
   }
   
   void os_decommit_mem(u8* ptr, usize size) {
     VirtualFree(ptr, size, MEM_DECOMMIT);
   }
 
+  PageKind os_commit_mem_huge(u8* ptr, usize size) {
+    // Large pages on windows have to be committed up-front with SeLockMemoryPrivilege,
+    // which doesn't fit the lazy commit model, so these stay regular pages
+    os_commit_mem(ptr, size);
+    return PageKind::Small;
+  }
+
+//
+// Write Tracking API
+//
+
+  u8* os_reserve_mem_tracked(usize size) {
+    return (u8*)VirtualAlloc(0, size, MEM_RESERVE | MEM_WRITE_WATCH, PAGE_NOACCESS);
+  }
+
+  // MEM_WRITE_WATCH can't be combined with MEM_LARGE_PAGES
+  PageKind os_commit_mem_huge_tracked(u8* ptr, usize size) {
+    os_commit_mem(ptr, size);
+    return PageKind::Small;
+  }
+
+  // Only memory reserved with MEM_WRITE_WATCH resets, everything else is untracked
+  void os_reset_written_pages(MemRange* ranges, bool* tracked, usize count) {
+    for_every(i, count) {
+      tracked[i] = ranges[i].size == 0 || ResetWriteWatch(ranges[i].ptr, ranges[i].size) == 0;
+    }
+  }
+
+  bool os_get_written_pages(u8* ptr, usize size, usize page_size, u64* written_pages) {
+    // GetWriteWatch hands back the addresses of written pages a batch at a time
+    void* addresses[512];
+    u8* cursor = ptr;
+    u8* end = ptr + size;
+
+    while(cursor < end) {
+      ULONG_PTR count = count_of(addresses);
+      ULONG granularity = 0;
+      if(GetWriteWatch(0, cursor, (SIZE_T)(end - cursor), addresses, &count, &granularity) != 0) {
+        return false;
+      }
+
+      for_every(i, count) {
+        u8* page = (u8*)addresses[i];
+        mark_written_pages(ptr, size, page_size, written_pages, page, page + granularity);
+      }
+
+      if(count < count_of(addresses)) {
+        break;
+      }
+
+      cursor = (u8*)addresses[count - 1] + granularity;
+    }
+
+    return true;
+  }
+
+//
+// Mapped File API
+//
+
+  bool map_file(MappedFile* mapped, const char* filename, bool sequential) {
+    *mapped = {};
+
+    DWORD flags = sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, flags, 0);
+    if(file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    defer(CloseHandle(file));
+
+    LARGE_INTEGER size = {};
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      return false;
+    }
+
+    // The view keeps the mapping alive so both handles can go
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if(mapping == 0) {
+      return false;
+    }
+    defer(CloseHandle(mapping));
+
+    u8* data = (u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(data == 0) {
+      return false;
+    }
+
+    mapped->data = data;
+    mapped->size = (usize)size.QuadPart;
+    return true;
+  }
+
+  void unmap_file(MappedFile* mapped) {
+    if(mapped->data != 0) {
+      UnmapViewOfFile(mapped->data);
+    }
+
+    *mapped = {};
+  }
+
 //
 // Zero Mem API
 //
@@ -493,12 +965,352 @@ namespace quark {
     CopyMemory(dst, src, size);
   }
 
+//
+// Posix
+//
+
+#else
+
+//
+// Shared Library API
+//
+
+  struct LibraryPosix {
+    void* handle;
+  };
+
+  Library* load_library(const char* library_path) {
+    void* handle = dlopen(library_path, RTLD_NOW | RTLD_LOCAL);
+
+    if(handle == 0) {
+      printf("dlopen error: %s\n", dlerror());
+      panic("Failed to find shared library!");
+    }
+
+    LibraryPosix* library = (LibraryPosix*)malloc(sizeof(LibraryPosix));
+    library->handle = handle;
+
+    return (Library*)library;
+  }
+
+  void unload_library(Library* library_ptr) {
+    LibraryPosix* library = (LibraryPosix*)library_ptr;
+
+    dlclose(library->handle);
+    free(library_ptr);
+  }
+
+  VoidFunctionPtr library_get_function(Library* library_ptr, const char* function_name) {
+    LibraryPosix* library = (LibraryPosix*)library_ptr;
+
+    VoidFunctionPtr function = (VoidFunctionPtr) dlsym(library->handle, function_name);
+    if(function == 0) {
+      panic("Failed to find function in shared library!");
+    }
+
+    return function;
+  }
+
+  void library_run_function(Library* library_ptr, const char* function_name) {
+    library_get_function(library_ptr, function_name)();
+  }
+
+  bool library_has_function(Library* library_ptr, const char* function_name) {
+    LibraryPosix* library = (LibraryPosix*)library_ptr;
+
+    VoidFunctionPtr function = (VoidFunctionPtr) dlsym(library->handle, function_name);
+    if(function == 0) {
+      return false;
+    }
+
+    return true;
+  }
+
+//
+// Memory API
+//
+
+  // munmap needs the length of the mapping but os_release_mem() only gets the pointer,
+  // so we stash the mapping in a header page in front of the returned pointer.
+  // The returned pointer is 2MB aligned so commits can be backed by huge pages
+  struct ReserveHeader {
+    u8* base;
+    usize size;
+  };
+
+  static usize os_page_size() {
+    static usize page_size = (usize)sysconf(_SC_PAGESIZE);
+    return page_size;
+  }
+
+  u8* os_reserve_mem(usize size) {
+    usize page_size = os_page_size();
+    usize mapping_size = size + HUGE_PAGE_SIZE + page_size;
+
+    u8* base = (u8*)mmap(0, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED) {
+      return 0;
+    }
+
+    u8* ptr = (u8*)align_forward((usize)(base + page_size), HUGE_PAGE_SIZE);
+
+    ReserveHeader* header = (ReserveHeader*)(ptr - sizeof(ReserveHeader));
+    mprotect(ptr - page_size, page_size, PROT_READ | PROT_WRITE);
+    header->base = base;
+    header->size = mapping_size;
+
+    return ptr;
+  }
+
+  void os_release_mem(u8* ptr) {
+    ReserveHeader* header = (ReserveHeader*)(ptr - sizeof(ReserveHeader));
+    munmap(header->base, header->size);
+  }
+
+  void os_commit_mem(u8* ptr, usize size) {
+    if(mprotect(ptr, size, PROT_READ | PROT_WRITE) != 0) {
+      panic("Failed to commit memory!");
+    }
+  }
+
+  void os_decommit_mem(u8* ptr, usize size) {
+    // Map fresh PROT_NONE pages over the range, this hands back the physical pages
+    // (including hugetlb ones, which MADV_DONTNEED does not reliably free) and keeps the reservation
+    mmap(ptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+  }
+
+  static bool thp_is_enabled() {
+    File* f = 0;
+    if(open_file(&f, "/sys/kernel/mm/transparent_hugepage/enabled", "r") != 0) {
+      return false;
+    }
+    defer(close_file(f));
+
+    char mode[64] = {};
+    fread(mode, 1, sizeof(mode) - 1, (FILE*)f);
+
+    // The active mode is bracketed, "madvise" and "always" both honor MADV_HUGEPAGE
+    return strstr(mode, "[never]") == 0;
+  }
+
+  // Cleared on the first failed MAP_HUGETLB so an empty hugetlb pool only costs one extra syscall
+  static std::atomic<bool> _hugetlb_available = true;
+
+  static PageKind commit_mem_huge(u8* ptr, usize size, bool allow_hugetlb) {
+    static bool thp_enabled = thp_is_enabled();
+
+    #ifdef MAP_HUGETLB
+    if(allow_hugetlb && _hugetlb_available.load(std::memory_order_relaxed)) {
+      void* huge = mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+      if(huge != MAP_FAILED) {
+        return PageKind::HugeTLB;
+      }
+
+      _hugetlb_available.store(false, std::memory_order_relaxed);
+    }
+    #endif
+
+    // A failed MAP_FIXED may already have unmapped the range so remap instead of mprotect
+    void* small = mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if(small == MAP_FAILED) {
+      panic("Failed to commit memory!");
+    }
+
+    #ifdef MADV_HUGEPAGE
+    if(thp_enabled && madvise(ptr, size, MADV_HUGEPAGE) == 0) {
+      return PageKind::THP;
+    }
+    #endif
+
+    return PageKind::Small;
+  }
+
+  PageKind os_commit_mem_huge(u8* ptr, usize size) {
+    return commit_mem_huge(ptr, size, true);
+  }
+
+//
+// Write Tracking API
+//
+
+  // Bit 55 of a /proc/self/pagemap entry, the kernel sets it on the first write after a clear_refs reset
+  constexpr u64 PAGEMAP_SOFT_DIRTY = 1ull << 55;
+
+  u8* os_reserve_mem_tracked(usize size) {
+    return os_reserve_mem(size);
+  }
+
+  // clear_refs skips hugetlb mappings so their soft-dirty bits never reset, THP keeps them per 2MB page
+  PageKind os_commit_mem_huge_tracked(u8* ptr, usize size) {
+    return commit_mem_huge(ptr, size, false);
+  }
+
+  static bool clear_soft_dirty_bits() {
+    int fd = ::open("/proc/self/clear_refs", O_WRONLY);
+    if(fd < 0) {
+      return false;
+    }
+    defer(::close(fd));
+
+    return ::write(fd, "4", 1) == 1;
+  }
+
+  static bool read_pagemap(u8* ptr, usize count, u64* entries) {
+    static int fd = ::open("/proc/self/pagemap", O_RDONLY);
+    if(fd < 0) {
+      return false;
+    }
+
+    usize size = count * sizeof(u64);
+    off_t offset = (off_t)((usize)ptr / os_page_size() * sizeof(u64));
+    return pread(fd, entries, size, offset) == (ssize_t)size;
+  }
+
+  // Kernels without CONFIG_MEM_SOFT_DIRTY still take the reset, so check a page reads clean after it and dirty after a write
+  static bool soft_dirty_is_supported() {
+    usize page_size = os_page_size();
+    volatile u8* page = (volatile u8*)mmap(0, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(page == MAP_FAILED) {
+      return false;
+    }
+    defer(munmap((void*)page, page_size));
+
+    page[0] = 1;
+    if(!clear_soft_dirty_bits()) {
+      return false;
+    }
+
+    u64 clean = 0;
+    if(!read_pagemap((u8*)page, 1, &clean) || (clean & PAGEMAP_SOFT_DIRTY) != 0) {
+      return false;
+    }
+
+    page[0] = 2;
+
+    u64 dirty = 0;
+    return read_pagemap((u8*)page, 1, &dirty) && (dirty & PAGEMAP_SOFT_DIRTY) != 0;
+  }
+
+  static bool soft_dirty_supported() {
+    static bool supported = soft_dirty_is_supported();
+    return supported;
+  }
+
+  // Resetting write protects every page in the process, so the first write to each one after this takes a fault
+  void os_reset_written_pages(MemRange* ranges, bool* tracked, usize count) {
+    bool reset = soft_dirty_supported() && clear_soft_dirty_bits();
+
+    for_every(i, count) {
+      tracked[i] = reset;
+    }
+  }
+
+  bool os_get_written_pages(u8* ptr, usize size, usize page_size, u64* written_pages) {
+    if(!soft_dirty_supported()) {
+      return false;
+    }
+
+    usize os_page = os_page_size();
+    u8* end = ptr + size;
+
+    u64 entries[512];
+    for(u8* cursor = ptr - (usize)ptr % os_page; cursor < end; cursor += count_of(entries) * os_page) {
+      usize count = ((usize)(end - cursor) + os_page - 1) / os_page;
+      count = count < count_of(entries) ? count : count_of(entries);
+
+      if(!read_pagemap(cursor, count, entries)) {
+        return false;
+      }
+
+      for_every(i, count) {
+        if((entries[i] & PAGEMAP_SOFT_DIRTY) != 0) {
+          mark_written_pages(ptr, size, page_size, written_pages, cursor + i * os_page, cursor + (i + 1) * os_page);
+        }
+      }
+    }
+
+    return true;
+  }
+
+//
+// Mapped File API
+//
+
+  bool map_file(MappedFile* mapped, const char* filename, bool sequential) {
+    *mapped = {};
+
+    int fd = ::open(filename, O_RDONLY);
+    if(fd < 0) {
+      return false;
+    }
+    defer(::close(fd));
+
+    struct stat info = {};
+    if(fstat(fd, &info) != 0 || info.st_size == 0) {
+      return false;
+    }
+
+    // The mapping holds its own reference to the file so fd can go
+    u8* data = (u8*)mmap(0, (usize)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+      return false;
+    }
+
+    if(sequential) {
+      madvise(data, (usize)info.st_size, MADV_SEQUENTIAL);
+    }
+
+    mapped->data = data;
+    mapped->size = (usize)info.st_size;
+    return true;
+  }
+
+  void unmap_file(MappedFile* mapped) {
+    if(mapped->data != 0) {
+      munmap(mapped->data, mapped->size);
+    }
+
+    *mapped = {};
+  }
+
+//
+// Zero Mem API
+//
+
+  void zero_mem(void* ptr, usize count) {
+    memset(ptr, 0, count);
+  }
+
+//
+// Copy Mem API
+//
+
+  void copy_mem(void* dst, void* src, usize size) {
+    memcpy(dst, src, size);
+  }
+
 #endif
 
+//
+// Page Kind API
+//
+
+  const char* get_page_kind_name(PageKind kind) {
+    switch(kind) {
+      case PageKind::Small:   return "4KB";
+      case PageKind::THP:     return "2MB (THP)";
+      case PageKind::HugeTLB: return "2MB (HugeTLB)";
+    }
+
+    return "Unknown";
+  }
+
 //
 // Arena API
 //
 
+  bool ARENA_USE_HUGE_PAGES = true;
+
   struct ArenaPool {
     Arena arenas[32] = {};
     bool thread_locks_initted = false;
@@ -513,6 +1325,9 @@ namespace quark {
       -1,-1,-1,-1,
     };
     bool allocated[32] = {};
+
+    // Jobs log and panic too, which grab arenas from the pool
+    std::mutex lock;
   };
   
   const usize max_arena_count = 32;
@@ -522,6 +1337,8 @@ namespace quark {
   #define CURRENT_THREAD_ID 1
   
   Arena* get_arena_internal(Arena** conflicts, usize conflict_count, int search_thread_id) {
+    std::lock_guard<std::mutex> guard(_arena_pool.lock);
+
     Arena* arena = 0;
 
     for(int i = 0; i < max_arena_count; i += 1) {
@@ -555,7 +1372,13 @@ namespace quark {
   
     if(!_arena_pool.allocated[i]) {
       arena->ptr = os_reserve_mem(virtual_reserve_size);
-      os_commit_mem(arena->ptr, 2 * MB);
+
+      if(ARENA_USE_HUGE_PAGES) {
+        arena->page_kind = os_commit_mem_huge(arena->ptr, 2 * MB);
+      } else {
+        os_commit_mem(arena->ptr, 2 * MB);
+        arena->page_kind = PageKind::Small;
+      }
   
       arena->position = 0;
       arena->commit_size = 2 * MB;
@@ -580,10 +1403,21 @@ namespace quark {
   void free_arena(Arena* arena) {
     arena_reset(arena);
 
+    std::lock_guard<std::mutex> guard(_arena_pool.lock);
     usize i = (arena - _arena_pool.arenas);
     _arena_pool.thread_locks[i] = -1;
   }
   
+  void log_arena_pool_info() {
+    // Plain printf since log_message() grabs an arena from the pool we are printing
+    for_every(i, max_arena_count) {
+      if(!_arena_pool.allocated[i]) { continue; }
+
+      Arena* arena = &_arena_pool.arenas[i];
+      printf("[MESSAGE] Arena %d: %lluMB committed, backed by %s pages\n", (i32)i, (unsigned long long)(arena->commit_size / MB), get_page_kind_name(arena->page_kind));
+    }
+  }
+
   TempStack begin_temp_stack(Arena* arena) {
     return TempStack {
       .arena = arena,
@@ -853,6 +1687,19 @@ namespace quark {
     exit(-1);
   }
 
+#else
+
+  void panic_real(const char* message, const char* file, usize line) {
+    printf("Panicked at message: \"%s\", %s:%llu\n", message, file, (unsigned long long)line);
+    fflush(stdout);
+
+    void* frames[32];
+    int frame_count = backtrace(frames, count_of(frames));
+    backtrace_symbols_fd(frames, frame_count, STDERR_FILENO);
+
+    exit(-1);
+  }
+
 #endif
 
 //
@@ -861,7 +1708,12 @@ namespace quark {
 
   i32 open_file(File** file, const char* filename, const char* mode) {
     // TODO: Use something that supports ACTUAL 64-bits
+    #ifdef _WIN64
     return fopen_s((FILE**)file, filename, mode);
+    #else
+    *file = (File*)fopen(filename, mode);
+    return *file == 0 ? errno : 0;
+    #endif
   }
   
   void close_file(File* file) {
@@ -911,7 +1763,11 @@ namespace quark {
   }
 
   bool file_exists(const char* filename) {
+    #ifdef _WIN64
     return _access(filename, 0) != -1;
+    #else
+    return access(filename, F_OK) != -1;
+    #endif
   }
 
   bool path_exists(const char* path) {
@@ -925,7 +1781,11 @@ namespace quark {
   int sprintf(char* buffer, u64 buffer_size, const char* format, ...) {
     va_list args;
     va_start(args, format);
+    #ifdef _WIN64
     int len = ::vsprintf_s(buffer, buffer_size, format, args); // TODO: This is arbitrary, figure something out...
+    #else
+    int len = ::vsnprintf(buffer, buffer_size, format, args);
+    #endif
     va_end(args);
 
     return len;
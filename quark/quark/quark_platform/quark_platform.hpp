@@ -11,7 +11,9 @@
   #include <stdio.h>
   
   #include <GLFW/glfw3.h>
-  #include <threadpool.hpp>
+
+  #include <atomic>
+  #include <type_traits>
 
 #pragma clang diagnostic pop
 
@@ -24,6 +26,10 @@ namespace quark {
 // Window API
 //
 
+  // Run without a window, input always reads as released and the engine skips the gpu.
+  // Set before init_window()
+  platform_var bool HEADLESS;
+
   platform_api void init_window();
   platform_api void deinit_window();
 
@@ -250,29 +256,77 @@ namespace quark {
   platform_api Timestamp get_timestamp_difference(Timestamp t0, Timestamp t1);
 
 //
-// Threadpool API
+// Job System API
 //
 
-  using VoidFunctionPtr = void (*)();
+  using JobFunctionPtr = void (*)(void* data);
+
+  constexpr usize JOB_DATA_SIZE = 48;
+
+  // Tracks how many jobs are still in flight
+  // Wait on a counter instead of joining the whole pool so unrelated work can overlap
+  struct JobCounter {
+    std::atomic_int32_t value;
+  };
 
+  // The captured state of a job is copied inline so spawning never allocates
+  struct Job {
+    JobFunctionPtr function;
+    JobCounter* counter;
+    void* context; // Filled in by job_push(), see job_get_context()
+    alignas(16) u8 data[JOB_DATA_SIZE];
+  };
+
+  // Starts the worker threads, the calling thread becomes worker 0
   platform_api void init_thread_pool();
   platform_api void deinit_thread_pool();
 
+  // Push a job onto the calling workers deque, idle workers will steal from it
+  // Jobs can push more jobs, so nested spawning is fine
+  platform_api void job_push(Job* job);
+
+  // Run jobs until the counter hits zero, the calling thread helps out instead of blocking
+  platform_api void job_wait(JobCounter* counter);
+
+  platform_api bool job_is_finished(JobCounter* counter);
+
+  // Opaque state that follows the jobs instead of the threads, a job starts out with the context of whoever pushed it.
+  // A worker that runs someone else's job inside job_wait() gets that job's context for the duration
+  platform_api void* job_get_context();
+  platform_api void job_set_context(void* context);
+
+  // Index of the calling thread in [0, job_worker_count()), the main thread is worker 0
+  platform_api i32 job_worker_index();
+  platform_api i32 job_worker_count();
+
+  // Spawn a lambda as a job, captures must be trivially copyable and fit in JOB_DATA_SIZE
+  template <typename F> inline void job_spawn(JobCounter* counter, F f);
+
+  // Split [0, count) into batches and run f(start, end) for each batch across the workers
+  // Returns once every batch has finished
+  template <typename F> inline void job_parallel_for(usize count, usize batch_size, F f);
+
+//
+// Threadpool API
+// These are kept around for older code and just wrap the job system
+//
+
+  using VoidFunctionPtr = void (*)();
+
   // Push a work function into the threadpools queue
-  // Work will begin on the function when thread_pool_start() or thread_pool_join() is called
+  // Work may begin immediately, wait on it with thread_pool_join()
   platform_api void thread_pool_push(VoidFunctionPtr work_function_ptr);
 
-  // Tell the threadpool to begin working but dont wait on threads to complete (defer joining to a later stage)
+  // Does nothing, pushed work is already running
   platform_api void thread_pool_start();
 
-  // Tell the threadpool to begin working and wait until all threads have finished their work
-  // If the threadpool is already working then this function waits until all the threads have finished their work
+  // Wait until all work pushed with thread_pool_push() has finished
   platform_api void thread_pool_join();
 
   // Check if the threadpool has finished the current batch of work
   platform_api bool thread_pool_is_finished();
   
-  // Returns the number of threads committed to this threadpool
+  // Returns the number of workers in the job system
   platform_api isize thread_pool_thread_count();
 
 //
@@ -297,6 +351,45 @@ namespace quark {
   platform_api void os_commit_mem(u8* ptr, usize size);
   platform_api void os_decommit_mem(u8* ptr, usize size);
 
+  // What actually ended up backing a committed range
+  declare_enum(PageKind, u32,
+    Small   = 0, // Regular 4KB pages
+    THP     = 1, // madvise(MADV_HUGEPAGE), the kernel promotes to 2MB pages when it can
+    HugeTLB = 2, // MAP_HUGETLB, 2MB pages from the reserved hugetlb pool
+  );
+
+  constexpr usize HUGE_PAGE_SIZE = 2 * MB;
+
+  // Commit memory and try to back it with 2MB pages, falling back to 4KB pages
+  // ptr and size should be multiples of HUGE_PAGE_SIZE
+  platform_api PageKind os_commit_mem_huge(u8* ptr, usize size);
+
+  platform_api const char* get_page_kind_name(PageKind kind);
+
+//
+// Write Tracking API
+//
+
+  struct MemRange {
+    u8* ptr;
+    usize size;
+  };
+
+  // Same as os_reserve_mem() but windows can track writes to it, linux can track writes to any memory
+  platform_api u8* os_reserve_mem_tracked(usize size);
+
+  // os_commit_mem_huge() for memory from os_reserve_mem_tracked(), writes stay trackable so this never uses hugetlb pages.
+  // Linux tracks THP backed memory per 2MB page, so one write marks the whole page as written
+  platform_api PageKind os_commit_mem_huge_tracked(u8* ptr, usize size);
+
+  // Start a new write tracking window over every range, tracked[i] is false when writes to ranges[i] can't be tracked.
+  // Linux uses soft-dirty bits which only reset for the whole process, so reset everything you track in one call
+  platform_api void os_reset_written_pages(MemRange* ranges, bool* tracked, usize count);
+
+  // Sets bit i of written_pages when [ptr + i * page_size, ptr + (i + 1) * page_size) may have been written since the last reset.
+  // written_pages has to be zeroed, returns false when the writes couldn't be read so the caller has to assume everything changed
+  platform_api bool os_get_written_pages(u8* ptr, usize size, usize page_size, u64* written_pages);
+
 //
 // Zero Memory API
 //
@@ -349,13 +442,20 @@ namespace quark {
     u8* ptr;
     usize position;
     usize commit_size;
+    PageKind page_kind;
   };
 
   constexpr usize PTR_ALIGNMENT = 8;
+
+  // Back newly created arenas with 2MB pages where the OS allows it
+  platform_var bool ARENA_USE_HUGE_PAGES;
   
   platform_api Arena* get_arena();
   platform_api void free_arena(Arena* arena);
 
+  // Print the committed size and backing page kind of every allocated arena
+  platform_api void log_arena_pool_info();
+
 //
 // Custom Alignment
 //
@@ -434,6 +534,12 @@ namespace quark {
 
   #include "internal/arenas.hpp"
 
+//
+// Job System API Definitions
+//
+
+  #include "internal/jobs.hpp"
+
 //
 // Allocator API
 //
@@ -550,6 +656,20 @@ namespace quark {
   platform_api bool file_exists(const char* filename);
   platform_api bool path_exists(const char* path);
 
+//
+// Mapped File API
+//
+
+  struct MappedFile {
+    u8* data;
+    usize size;
+  };
+
+  // Read only view of a whole file, returns false if it can't be opened or is empty.
+  // sequential hints that it gets read front to back once, so the os reads ahead further and drops pages behind
+  platform_api bool map_file(MappedFile* mapped, const char* filename, bool sequential);
+  platform_api void unmap_file(MappedFile* mapped);
+
 //
 // String API
 //
@@ -36,6 +36,7 @@ VERT_HEADER = """
 #define DRAW_ID gl_DrawID
 #define BASE_VERTEX gl_BaseVertex
 #define BASE_INSTANCE gl_BaseInstance
+#define INSTANCE_INDEX gl_InstanceIndex
 """
 
 FRAG_HEADER = """
@@ -127,10 +128,15 @@ def compile_ext_shader(path):
     f.truncate()
     f.close()
 
+GLSLANG_VALIDATOR = os.environ.get("GLSLANG_VALIDATOR", "glslangValidator")
+
+failed_paths = []
+
 def compile_spv_shader(path):
     spv_path = path + ".spv"
-    cmd = "glsLangValidator "  + path + " -V --target-env vulkan1.2 -o " + spv_path
-    os.system(cmd)
+    cmd = "\"" + GLSLANG_VALIDATOR + "\" "  + path + " -V --target-env vulkan1.2 -o " + spv_path
+    if os.system(cmd) != 0:
+        failed_paths.append(path)
 
 if __name__ == "__main__":
     ext_shader_paths = []
@@ -166,11 +172,20 @@ if __name__ == "__main__":
     for thread in threads:
         thread.join()
 
+    if len(failed_paths) > 0:
+        for path in ext_shader_paths:
+            os.remove(path.replace(".shader.glsl", ".vert"))
+            os.remove(path.replace(".shader.glsl", ".frag"))
+
+        print("Failed to compile: " + ", ".join(failed_paths))
+        exit(-1)
+
     spv_paths = []
     for path in zip(shader_paths, output_paths):
         if path[0].find(".ext") != -1: continue
         full_path = path[0] + ".spv"
         name = os.path.basename(full_path)
+        os.makedirs(path[1], exist_ok=True)
         shutil.move(full_path, path[1] + name)
 
     for path in ext_shader_paths: